@@ -32,6 +32,7 @@ LOCAL_SRC_FILES := ./db/builder.cc \
 ./db/log_reader.cc \
 ./db/log_writer.cc \
 ./db/memtable.cc \
+./db/range_del.cc \
 ./db/repair.cc \
 ./db/table_cache.cc \
 ./db/version_edit.cc \
@@ -40,6 +41,7 @@ LOCAL_SRC_FILES := ./db/builder.cc \
 ./port/port_android.cc \
 ./table/block.cc \
 ./table/block_builder.cc \
+./table/filter_block.cc \
 ./table/format.cc \
 ./table/iterator.cc \
 ./table/merger.cc \
@@ -47,18 +49,25 @@ LOCAL_SRC_FILES := ./db/builder.cc \
 ./table/table_builder.cc \
 ./table/two_level_iterator.cc \
 ./util/arena.cc \
+./util/bloom.cc \
 ./util/cache.cc \
 ./util/coding.cc \
 ./util/comparator.cc \
 ./util/crc32c.cc \
 ./util/env.cc \
 ./util/env_posix.cc \
+./util/filter_policy.cc \
 ./util/hash.cc \
 ./util/histogram.cc \
 ./util/logging.cc \
+./util/merge_operator.cc \
 ./util/options.cc \
+./util/perf_context.cc \
+./util/pinnable_slice.cc \
+./util/statistics.cc \
 ./util/status.cc \
 ./util/testharness.cc \
-./util/testutil.cc
+./util/testutil.cc \
+./util/thread_pool.cc
 
 include $(BUILD_SHARED_LIBRARY)
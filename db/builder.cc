@@ -6,6 +6,7 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "include/db.h"
@@ -14,6 +15,17 @@
 
 namespace leveldb {
 
+CompressionType CompressionForLevel(const Options& options, int level) {
+  const std::vector<CompressionType>& per_level = options.compression_per_level;
+  if (per_level.empty()) {
+    return options.compression;
+  }
+  if (level >= static_cast<int>(per_level.size())) {
+    level = per_level.size() - 1;
+  }
+  return per_level[level];
+}
+
 /* BuildTable 逻辑, 按我理解, 明明是线性的逻辑, 原文七扭八拗:
  * 1. 创建 SST 文件 filename.
  * 2. 遍历 iter, 将 key, value 写入 SST 文件中, 更新 filemeta, 以及 version edit.
@@ -31,15 +43,21 @@ Status BuildTable(const std::string& dbname,
                   const Options& options,
                   TableCache* table_cache,
                   Iterator* iter,
+                  Iterator* range_del_iter,
                   FileMetaData* meta,
                   VersionEdit* edit) {
   Status s;
   meta->file_size = 0;
   iter->SeekToFirst();
+  if (range_del_iter != NULL) {
+    range_del_iter->SeekToFirst();
+  }
+  const bool has_range_dels = (range_del_iter != NULL &&
+                               range_del_iter->Valid());
 
   std::string fname = TableFileName(dbname, meta->number);
   // 当 *iter 为空时, 不会创建 fname 指定的文件. 我觉得这里没有必要, 毕竟下面总会 DeleteFile
-  if (iter->Valid()) {
+  if (iter->Valid() || has_range_dels) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -47,7 +65,10 @@ Status BuildTable(const std::string& dbname,
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    const bool has_data = iter->Valid();
+    if (has_data) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
@@ -64,6 +85,34 @@ Status BuildTable(const std::string& dbname,
       builder->Add(key, iter->value());
     }
 
+    // The file's key range must cover its range tombstones too, so that
+    // reads and compactions of the range find the file.
+    const InternalKeyComparator* icmp =
+        static_cast<const InternalKeyComparator*>(options.comparator);
+    bool first = !has_data;
+    for (; s.ok() && has_range_dels && range_del_iter->Valid();
+         range_del_iter->Next()) {
+      RangeTombstone tombstone;
+      if (!ParseRangeTombstone(range_del_iter->key(), range_del_iter->value(),
+                               &tombstone)) {
+        s = Status::Corruption("corrupted range tombstone");
+        break;
+      }
+      builder->AddRangeTombstone(range_del_iter->key(),
+                                 range_del_iter->value());
+      InternalKey start, end;
+      start.DecodeFrom(range_del_iter->key());
+      end = InternalKey(tombstone.end, kMaxSequenceNumber,
+                        kTypeRangeDeletion);
+      if (first || icmp->Compare(start, meta->smallest) < 0) {
+        meta->smallest = start;
+      }
+      if (first || icmp->Compare(end, meta->largest) > 0) {
+        meta->largest = end;
+      }
+      first = false;
+    }
+
     // Finish and check for builder errors
     if (s.ok()) {
       s = builder->Finish();
@@ -99,10 +148,14 @@ Status BuildTable(const std::string& dbname,
   if (!iter->status().ok()) {  // 如果 !s->ok(), 那么 s 自身状态不就丢失了没?
     s = iter->status();
   }
+  if (range_del_iter != NULL && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
 
+  meta->has_range_tombstones = has_range_dels;
   if (s.ok() && meta->file_size > 0) {
     edit->AddFile(0, meta->number, meta->file_size,
-                  meta->smallest, meta->largest);
+                  meta->smallest, meta->largest, has_range_dels);
   } else {
     env->DeleteFile(fname);
   }
@@ -5,11 +5,11 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include "include/options.h"
 #include "include/status.h"
 
 namespace leveldb {
 
-struct Options;
 struct FileMetaData;
 
 class Env;
@@ -22,7 +22,9 @@ class VersionEdit;
 // *meta will be filled with metadata about the generated table, and
 // large value refs and the added file information will be added to
 // *edit.  If no data is present in *iter, meta->file_size will be set
-// to zero, and no Table file will be produced.
+// to zero, and no Table file will be produced.  The range tombstones
+// yielded by *range_del_iter, which may be NULL, are stored in the
+// table's range tombstone block and widen the key range in *meta.
 // 这个时候才会把 large value refs 更新到 VersionEdit 中啊. 不过确实只有这个时候才能更新, 只有这个时候才知道
 // file number 嘛.
 //
@@ -32,9 +34,14 @@ extern Status BuildTable(const std::string& dbname,
                          const Options& options,
                          TableCache* table_cache,
                          Iterator* iter,
+                         Iterator* range_del_iter,
                          FileMetaData* meta,
                          VersionEdit* edit);
 
+// Return the compression to use for tables written to "level", taken
+// from options.compression_per_level when it is set.
+extern CompressionType CompressionForLevel(const Options& options, int level);
+
 }
 
 #endif  // STORAGE_LEVELDB_DB_BUILDER_H_
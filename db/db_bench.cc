@@ -3,15 +3,24 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <sys/types.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
 #include "db/db_impl.h"
 #include "db/version_set.h"
 #include "include/cache.h"
 #include "include/db.h"
 #include "include/env.h"
+#include "include/filter_policy.h"
 #include "include/write_batch.h"
+#include "port/port.h"
 #include "util/histogram.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -22,8 +31,27 @@
 //      writeseq    -- write N values in sequential key order
 //      writerandom -- write N values in random key order
 //      writebig    -- write N/1000 100K valuesin random order
+//      writerandomthreads -- write N values in random key order from
+//                     --write_threads concurrent threads
 //      readseq     -- read N values sequentially
 //      readrandom  -- read N values in random order
+//      readmissing -- read N missing keys in random order
+//      readhot     -- read N times in random order from 1% section of DB
+//      seekrandom  -- N random seeks
+//      deleterandom -- delete N keys in random order
+//      readwhilewriting -- --threads readers run readrandom while one
+//                     extra thread keeps writing random keys
+//      readrandomwriterandom -- N random ops, --readwritepercent of them
+//                     reads and the rest writes
+//   YCSB core workloads, run over the N records written by ycsbload and
+//   doing --ycsb_ops operations per thread:
+//      ycsbload    -- write N records in sequential key order
+//      ycsba       -- 50% reads, 50% updates; zipfian
+//      ycsbb       -- 95% reads, 5% updates; zipfian
+//      ycsbc       -- 100% reads; zipfian
+//      ycsbd       -- 95% reads, 5% inserts; latest
+//      ycsbe       -- 95% short scans, 5% inserts; zipfian
+//      ycsbf       -- 50% reads, 50% read-modify-writes; zipfian
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      heapprofile -- Dump a heap profile (if supported by this port)
@@ -31,16 +59,20 @@
 //      nosync      -- switch to asynchronous writes (the default)
 //      tenth       -- divide N by 10 (i.e., following benchmarks are smaller)
 //      normal      -- reset N back to its normal value (1000000)
+// Every benchmark except the meta operations is run by --threads threads
+// at once, each doing N operations, and their stats are merged.
 static const char* FLAGS_benchmarks =
     "writeseq,"
     "writeseq,"
     "writerandom,"
-    "sync,tenth,tenth,writerandom,nosync,normal,"
+    "sync,tenth,tenth,writerandom,writerandomthreads,nosync,normal,"
     "readseq,"
     "readrandom,"
+    "readmissing,"
     "compact,"
     "readseq,"
     "readrandom,"
+    "readmissing,"
     "writebig";
 
 // Number of key/values to place in database
@@ -60,9 +92,57 @@ static double FLAGS_compression_ratio = 0.25;
 // Print histogram of operation timings
 static bool FLAGS_histogram = false;
 
+// Print one JSON object per benchmark instead of the text report
+static bool FLAGS_json = false;
+
 // Number of bytes to buffer in memtable before compacting
 static int FLAGS_write_buffer_size = 1 << 20;
 
+// Number of concurrent threads to run each benchmark with
+static int FLAGS_threads = 1;
+
+// Random reads fetch values with the PinnableSlice Get(), which avoids
+// copying values that come from table files
+static bool FLAGS_pin_slice = false;
+
+// Percentage of reads in readrandomwriterandom; the rest are writes
+static int FLAGS_readwritepercent = 90;
+
+// Number of concurrent writer threads used by writerandomthreads
+static int FLAGS_write_threads = 8;
+
+// Maximum number of level compactions allowed to run concurrently
+static int FLAGS_max_background_compactions = 1;
+
+// Maximum number of threads a single compaction may be split across
+static int FLAGS_max_subcompactions = 1;
+
+// Let grouped writers insert into the memtable in parallel
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Bloom filter bits per key.
+// Negative means use no bloom filter.
+static int FLAGS_bloom_bits = 10;
+
+// Operations done by each thread in the ycsb* workloads.
+// Negative means use N.
+static int FLAGS_ycsb_ops = -1;
+
+// Key distribution of the ycsb* workloads: uniform, zipfian, scrambled,
+// hotspot or latest.  NULL means use the distribution of the workload.
+static const char* FLAGS_ycsb_distribution = NULL;
+
+// Skew of the zipfian distributions
+static double FLAGS_zipfian_constant = 0.99;
+
+// For the hotspot distribution: the fraction of the records that gets
+// --hotspot_op_fraction of the operations
+static double FLAGS_hotspot_set_fraction = 0.2;
+static double FLAGS_hotspot_op_fraction = 0.8;
+
+// Longest scan of ycsbe; scan lengths are uniform in [1, this]
+static int FLAGS_ycsb_max_scan_length = 100;
+
 namespace leveldb {
 
 // Helper for quickly generating random data.
@@ -100,66 +180,110 @@ class RandomGenerator {
     return Slice(data_.data() + pos_ - len, len);
   }
 };
-}
 
 /* 在该类实现中, 一项 benchmark 在开始时应该调用 Start(), 在结束之后调用 Stop(), 在这项 benchmark 内每一步
  * 操作完成之后调用 FinishedSingleOp().
  *
  * 今后在需要 benchmark 的场合可以参考这里的实现.
  *
- * Benchmark 中所有随机数生成器的种子都初始化为一个固定值: 301, 按我理解是想让每次 benchmark 都运行在固定的环境中.
+ * Each benchmark thread owns a Stats; they are merged with Merge() once
+ * every thread has finished and the result is printed with Report().
  */
-class Benchmark {
+class Stats {
  private:
-  Cache* cache_;  // 用作 options 中的 block_cache.
-  DB* db_;
-  // 存放着后续 writeseq 等 benchmark 的操作执行次数. 初始值为 FLAGS_num, 可以通过 tenth 等指令来调整.
-  int num_;
-  // 作为后续 writeseq 等 benchmark 中 WriteOptions::sync 的值.
-  bool sync_;
-  // 参见其使用场所.
-  int heap_counter_;
-  // 一项 benchmark 的开始时间.
+  // 一项 benchmark 的开始时间与结束时间.
   double start_;
-  // 一项 benchmark 中上一次操作的结束时间
-  double last_op_finish_;
+  double finish_;
+  // Time this thread spent between Start() and Stop()
+  double seconds_;
+  // 存放着一项 benchmark 的操作总次数.
+  int done_;
+  // 用来控制一项 benchmark 中何时输出进度这类信息的个东西. 参见其使用场景.
+  int next_report_;     // When to report next
   // 一项 benchmark 读或写的字节数.
   int64_t bytes_;
-  // 用来在一项 benchmark 中存放一些文本信息, 参见其使用场景.
-  std::string message_;
+  // 一项 benchmark 中上一次操作的结束时间
+  double last_op_finish_;
   // 存放着一项 benchmark 每次操作的耗时.
   Histogram hist_;
-  RandomGenerator gen_;
-  Random rand_;
+  // Every op's latency in micros, for exact percentiles
+  std::vector<double> latencies_;
+  // 用来在一项 benchmark 中存放一些文本信息, 参见其使用场景.
+  std::string message_;
+  // Named counts, in the order they were first added
+  std::vector<std::pair<std::string, int64_t> > counters_;
 
-  // State kept for progress messages
-  // 存放着一项 benchmark 的操作总次数.
-  int done_;
-  // 用来控制一项 benchmark 中何时输出进度这类信息的个东西. 参见其使用场景.
-  int next_report_;     // When to report next
+ public:
+  Stats() { Start(); }
 
   void Start() {
     // 这里乘以 10^-6, 而不是除以 10^6 是因为乘法效果高于除法么
     start_ = Env::Default()->NowMicros() * 1e-6;
+    finish_ = start_;
+    seconds_ = 0;
+    done_ = 0;
+    next_report_ = 100;
     bytes_ = 0;
-    message_.clear();
     last_op_finish_ = start_;
     hist_.Clear();
-    done_ = 0;
-    next_report_ = 100;
+    latencies_.clear();
+    message_.clear();
+    counters_.clear();
   }
 
-  void FinishedSingleOp() {
-    if (FLAGS_histogram) {
-      double now = Env::Default()->NowMicros() * 1e-6;
-      double micros = (now - last_op_finish_) * 1e6;
-      hist_.Add(micros);
-      if (micros > 20000) {  // 20 ms
-        fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
-        fflush(stderr);
+  void Merge(const Stats& other) {
+    hist_.Merge(other.hist_);
+    latencies_.insert(latencies_.end(), other.latencies_.begin(),
+                      other.latencies_.end());
+    done_ += other.done_;
+    bytes_ += other.bytes_;
+    seconds_ += other.seconds_;
+    if (other.start_ < start_) start_ = other.start_;
+    if (other.finish_ > finish_) finish_ = other.finish_;
+
+    for (size_t i = 0; i < other.counters_.size(); i++) {
+      AddCounter(other.counters_[i].first, other.counters_[i].second);
+    }
+
+    // Just keep the messages from one thread
+    if (message_.empty()) message_ = other.message_;
+  }
+
+  void Stop() {
+    finish_ = Env::Default()->NowMicros() * 1e-6;
+    seconds_ = finish_ - start_;
+  }
+
+  void AddMessage(Slice msg) {
+    if (!message_.empty()) {
+      message_.push_back(' ');
+    }
+    message_.append(msg.data(), msg.size());
+  }
+
+  // Add "n" to the count called "name".  Counts are summed over the
+  // threads by Merge() and reported as "(name:count ...)".
+  void AddCounter(const std::string& name, int64_t n) {
+    for (size_t i = 0; i < counters_.size(); i++) {
+      if (counters_[i].first == name) {
+        counters_[i].second += n;
+        return;
       }
-      last_op_finish_ = now;
     }
+    counters_.push_back(std::make_pair(name, n));
+  }
+
+  void FinishedSingleOp() {
+    // Always timed, since the report includes the latency percentiles
+    double now = Env::Default()->NowMicros() * 1e-6;
+    double micros = (now - last_op_finish_) * 1e6;
+    hist_.Add(micros);
+    latencies_.push_back(micros);
+    if (FLAGS_histogram && micros > 20000) {  // 20 ms
+      fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
+      fflush(stderr);
+    }
+    last_op_finish_ = now;
 
     done_++;
     if (done_ >= next_report_) {
@@ -177,44 +301,391 @@ class Benchmark {
     }
   }
 
-  void Stop(const Slice& name) {
-    double finish = Env::Default()->NowMicros() * 1e-6;
+  void AddBytes(int64_t n) {
+    bytes_ += n;
+  }
+
+  // Return the latency below which p percent of the ops completed,
+  // using the nearest-rank method.
+  // REQUIRES: latencies_ is sorted and not empty
+  double Percentile(double p) const {
+    size_t rank = static_cast<size_t>(ceil(p / 100.0 * latencies_.size()));
+    if (rank < 1) rank = 1;
+    if (rank > latencies_.size()) rank = latencies_.size();
+    return latencies_[rank - 1];
+  }
 
+  void Report(const Slice& name, int threads) {
     // Pretend at least one op was done in case we are running a benchmark
-    // that does nto call FinishedSingleOp().
+    // that does not call FinishedSingleOp().
     if (done_ < 1) done_ = 1;
 
-    if (bytes_ > 0) {
-      char rate[100];
-      snprintf(rate, sizeof(rate), "%5.1f MB/s",
-               (bytes_ / 1048576.0) / (finish - start_));
-      if (!message_.empty()) {
-        message_.push_back(' ');
+    // Throughput is computed on the elapsed time of the whole run, while
+    // the per-op latency is computed on the sum of the per-thread times.
+    double elapsed = finish_ - start_;
+    double micros_per_op = seconds_ * 1e6 / done_;
+    double ops_per_sec = (elapsed > 0 ? done_ / elapsed : 0.0);
+    double mb_per_sec = (elapsed > 0 ? (bytes_ / 1048576.0) / elapsed : 0.0);
+    std::sort(latencies_.begin(), latencies_.end());
+    double p50 = 0, p95 = 0, p99 = 0, p999 = 0, p9999 = 0, max = 0;
+    if (!latencies_.empty()) {
+      p50 = Percentile(50);
+      p95 = Percentile(95);
+      p99 = Percentile(99);
+      p999 = Percentile(99.9);
+      p9999 = Percentile(99.99);
+      max = latencies_.back();
+    }
+
+    std::string message;
+    if (!counters_.empty()) {
+      message.push_back('(');
+      for (size_t i = 0; i < counters_.size(); i++) {
+        char count[100];
+        snprintf(count, sizeof(count), "%s%s:%lld", (i > 0 ? " " : ""),
+                 counters_[i].first.c_str(),
+                 static_cast<long long>(counters_[i].second));
+        message.append(count);
       }
-      message_.append(rate);
+      message.push_back(')');
+    }
+    if (!message_.empty()) {
+      if (!message.empty()) message.push_back(' ');
+      message.append(message_);
+    }
+
+    if (FLAGS_json) {
+      std::string escaped;
+      for (size_t i = 0; i < message.size(); i++) {
+        if (message[i] == '"' || message[i] == '\\') escaped.push_back('\\');
+        escaped.push_back(message[i]);
+      }
+      fprintf(stdout,
+              "{\"benchmark\": \"%s\", \"threads\": %d, \"ops\": %d, "
+              "\"micros_per_op\": %.3f, \"ops_per_sec\": %.0f, "
+              "\"mb_per_sec\": %.1f, \"p50\": %.2f, \"p95\": %.2f, "
+              "\"p99\": %.2f, \"p99.9\": %.2f, \"p99.99\": %.2f, "
+              "\"max\": %.2f, \"message\": \"%s\"}\n",
+              name.ToString().c_str(), threads, done_, micros_per_op,
+              ops_per_sec, mb_per_sec, p50, p95, p99, p999, p9999, max,
+              escaped.c_str());
+      fflush(stdout);
+      return;
     }
 
-    fprintf(stdout, "%-12s : %10.3f micros/op;%s%s\n",
+    std::string extra;
+    if (bytes_ > 0 && elapsed > 0) {
+      char rate[100];
+      snprintf(rate, sizeof(rate), "%5.1f MB/s", mb_per_sec);
+      extra = rate;
+    }
+    if (!message.empty()) {
+      if (!extra.empty()) extra.push_back(' ');
+      extra.append(message);
+    }
+
+    fprintf(stdout, "%-12s : %10.3f micros/op %10.0f ops/sec;%s%s\n",
             name.ToString().c_str(),
-            (finish - start_) * 1e6 / done_,
-            (message_.empty() ? "" : " "),
-            message_.c_str());
+            micros_per_op,
+            ops_per_sec,
+            (extra.empty() ? "" : " "),
+            extra.c_str());
+    if (!latencies_.empty()) {
+      fprintf(stdout, "%-12s   p50: %.2f  p95: %.2f  p99: %.2f  "
+              "p99.9: %.2f  p99.99: %.2f  max: %.2f micros\n", "",
+              p50, p95, p99, p999, p9999, max);
+    }
     if (FLAGS_histogram) {
       fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
     }
     fflush(stdout);
   }
+};
+
+// State shared by all concurrent executions of the same benchmark.
+struct SharedState {
+  port::Mutex mu;
+  port::CondVar cv;
+  int total;
+
+  // Each thread goes through the following states:
+  //    (1) initializing
+  //    (2) waiting for others to be initialized
+  //    (3) running
+  //    (4) done
+  int num_initialized;
+  int num_done;
+  bool start;
+
+  SharedState() : cv(&mu), total(0), num_initialized(0), num_done(0),
+                  start(false) { }
+};
+
+// Per-thread state for concurrent executions of the same benchmark.
+struct ThreadState {
+  int tid;             // 0..n-1 when running in n threads
+  Random rand;         // Has different seeds for different threads
+  Stats stats;
+  SharedState* shared;
+
+  ThreadState(int index)
+      : tid(index),
+        rand(301 + index),
+        shared(NULL) {
+  }
+};
+
+// Picks record numbers in [0, n) from the skewed distribution of
+// "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.),
+// as YCSB does.  Small record numbers are the most popular.  "n" may
+// grow between calls, which the "latest" distribution relies on.
+class ZipfianGenerator {
+ public:
+  // Computing the constants for "n" records takes n pow() calls, so they
+  // are computed up front rather than by the first Next().
+  ZipfianGenerator(double theta, uint64_t n)
+      : theta_(theta),
+        alpha_(1.0 / (1.0 - theta)),
+        zeta2_(1.0 + pow(0.5, theta)),
+        n_(0),
+        zetan_(0),
+        eta_(0) {
+    if (n > 0) Resize(n);
+  }
+
+  uint64_t Next(Random* rnd, uint64_t n) {
+    if (n != n_) Resize(n);
+    const double u = rnd->Next() / 2147483647.0;
+    const double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < zeta2_ && n > 1) return 1;
+    uint64_t r = static_cast<uint64_t>(n * pow(eta_ * u - eta_ + 1, alpha_));
+    return (r < n) ? r : n - 1;
+  }
+
+ private:
+  const double theta_;
+  const double alpha_;
+  const double zeta2_;
+  uint64_t n_;
+  double zetan_;    // Sum of 1/i^theta for i in [1, n_]
+  double eta_;
+
+  void Resize(uint64_t n) {
+    // Extend the sum incrementally when records were added
+    if (n < n_) {
+      n_ = 0;
+      zetan_ = 0;
+    }
+    for (uint64_t i = n_ + 1; i <= n; i++) {
+      zetan_ += 1.0 / pow(static_cast<double>(i), theta_);
+    }
+    n_ = n;
+    eta_ = (1 - pow(2.0 / n, 1 - theta_)) / (1 - zeta2_ / zetan_);
+  }
+};
+
+enum KeyDistribution {
+  kUniform,
+  kZipfian,
+  kScrambledZipfian,  // Zipfian, but the popular records are spread out
+  kHotspot,           // A fraction of the records gets a fraction of ops
+  kLatest             // Zipfian over the most recently inserted records
+};
+
+static bool ParseDistribution(const Slice& name, KeyDistribution* dist) {
+  if (name == Slice("uniform")) {
+    *dist = kUniform;
+  } else if (name == Slice("zipfian")) {
+    *dist = kZipfian;
+  } else if (name == Slice("scrambled")) {
+    *dist = kScrambledZipfian;
+  } else if (name == Slice("hotspot")) {
+    *dist = kHotspot;
+  } else if (name == Slice("latest")) {
+    *dist = kLatest;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Chooses the record each YCSB operation works on.
+class KeyChooser {
+ public:
+  // "records" is the expected number of records, for which the Zipfian
+  // constants are precomputed.
+  KeyChooser(KeyDistribution dist, uint64_t records)
+      : dist_(dist),
+        zipf_(FLAGS_zipfian_constant, dist == kUniform || dist == kHotspot
+                                      ? 0 : records) { }
+
+  // REQUIRES: records > 0
+  uint64_t Next(Random* rnd, uint64_t records) {
+    switch (dist_) {
+      case kZipfian:
+        return zipf_.Next(rnd, records);
+      case kScrambledZipfian: {
+        uint64_t rank = zipf_.Next(rnd, records);
+        return Scramble(rank) % records;
+      }
+      case kHotspot: {
+        uint64_t hot = static_cast<uint64_t>(
+            records * FLAGS_hotspot_set_fraction);
+        if (hot < 1) hot = 1;
+        if (hot >= records ||
+            rnd->Next() / 2147483647.0 < FLAGS_hotspot_op_fraction) {
+          return rnd->Next() % hot;
+        }
+        return hot + rnd->Next() % (records - hot);
+      }
+      case kLatest:
+        return records - 1 - zipf_.Next(rnd, records);
+      case kUniform:
+      default:
+        return rnd->Next() % records;
+    }
+  }
+
+ private:
+  KeyDistribution dist_;
+  ZipfianGenerator zipf_;
+
+  // FNV-1a over the bytes of "v"
+  static uint64_t Scramble(uint64_t v) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < 8; i++) {
+      h ^= (v >> (i * 8)) & 0xff;
+      h *= 0x100000001b3ull;
+    }
+    return h;
+  }
+};
+
+// Operation mix of one of the core YCSB workloads.  The percentages add
+// up to 100.
+struct YCSBWorkload {
+  int read;
+  int update;
+  int insert;
+  int scan;
+  int read_modify_write;
+  KeyDistribution dist;
+};
+
+static const YCSBWorkload kYCSBWorkloadA = { 50, 50, 0, 0, 0, kZipfian };
+static const YCSBWorkload kYCSBWorkloadB = { 95, 5, 0, 0, 0, kZipfian };
+static const YCSBWorkload kYCSBWorkloadC = { 100, 0, 0, 0, 0, kZipfian };
+static const YCSBWorkload kYCSBWorkloadD = { 95, 0, 5, 0, 0, kLatest };
+static const YCSBWorkload kYCSBWorkloadE = { 0, 0, 5, 95, 0, kZipfian };
+static const YCSBWorkload kYCSBWorkloadF = { 50, 0, 0, 0, 50, kZipfian };
+
+}
+
+/* Benchmark 中所有随机数生成器的种子都初始化为一个固定值: 301 + 线程编号, 按我理解是想让每次 benchmark 都
+ * 运行在固定的环境中.
+ */
+class Benchmark {
+ private:
+  Cache* cache_;  // 用作 options 中的 block_cache.
+  const FilterPolicy* filter_policy_;
+  DB* db_;
+  // 存放着后续 writeseq 等 benchmark 的操作执行次数. 初始值为 FLAGS_num, 可以通过 tenth 等指令来调整.
+  int num_;
+  // 作为后续 writeseq 等 benchmark 中 WriteOptions::sync 的值.
+  bool sync_;
+  // 参见其使用场所.
+  int heap_counter_;
+  // Records visible to the ycsb* workloads; inserts append to them.
+  std::atomic<int> ycsb_records_;
+
+  struct ThreadArg {
+    Benchmark* bm;
+    SharedState* shared;
+    ThreadState* thread;
+    void (Benchmark::*method)(ThreadState*);
+  };
+
+  static void ThreadBody(void* v) {
+    ThreadArg* arg = reinterpret_cast<ThreadArg*>(v);
+    SharedState* shared = arg->shared;
+    ThreadState* thread = arg->thread;
+    {
+      MutexLock l(&shared->mu);
+      shared->num_initialized++;
+      if (shared->num_initialized >= shared->total) {
+        shared->cv.SignalAll();
+      }
+      while (!shared->start) {
+        shared->cv.Wait();
+      }
+    }
+
+    thread->stats.Start();
+    (arg->bm->*(arg->method))(thread);
+    thread->stats.Stop();
+
+    {
+      MutexLock l(&shared->mu);
+      shared->num_done++;
+      if (shared->num_done >= shared->total) {
+        shared->cv.SignalAll();
+      }
+    }
+  }
+
+  // Run "method" concurrently in "n" threads, all released at the same
+  // time, and report their merged Stats under "name".
+  void RunBenchmark(int n, Slice name,
+                    void (Benchmark::*method)(ThreadState*)) {
+    SharedState shared;
+    shared.total = n;
+
+    ThreadArg* arg = new ThreadArg[n];
+    for (int i = 0; i < n; i++) {
+      arg[i].bm = this;
+      arg[i].method = method;
+      arg[i].shared = &shared;
+      arg[i].thread = new ThreadState(i);
+      arg[i].thread->shared = &shared;
+      Env::Default()->StartThread(ThreadBody, &arg[i]);
+    }
+
+    shared.mu.Lock();
+    while (shared.num_initialized < n) {
+      shared.cv.Wait();
+    }
+
+    shared.start = true;
+    shared.cv.SignalAll();
+    while (shared.num_done < n) {
+      shared.cv.Wait();
+    }
+    shared.mu.Unlock();
+
+    for (int i = 1; i < n; i++) {
+      arg[0].thread->stats.Merge(arg[i].thread->stats);
+    }
+    arg[0].thread->stats.Report(name, n);
+
+    for (int i = 0; i < n; i++) {
+      delete arg[i].thread;
+    }
+    delete[] arg;
+  }
 
  public:
   enum Order { SEQUENTIAL, RANDOM };
 
   Benchmark() : cache_(NewLRUCache(200<<20)),
+                filter_policy_(FLAGS_bloom_bits >= 0
+                               ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                               : NULL),
                 db_(NULL),
                 num_(FLAGS_num),
                 sync_(false),
                 heap_counter_(0),
-                bytes_(0),
-                rand_(301) {
+                ycsb_records_(FLAGS_num) {
     std::vector<std::string> files;
     Env::Default()->GetChildren("/tmp/dbbench", &files);
     for (int i = 0; i < files.size(); i++) {
@@ -230,6 +701,7 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete filter_policy_;
   }
 
   void Run() {
@@ -238,10 +710,16 @@ class Benchmark {
     options.max_open_files = 10000;
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.filter_policy = filter_policy_;
 
-    Start();
+    Stats open_stats;
     Status s = DB::Open(options, "/tmp/dbbench", &db_);
-    Stop("open");
+    open_stats.Stop();
+    open_stats.Report("open", 1);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
       exit(1);
@@ -260,21 +738,54 @@ class Benchmark {
         benchmarks = sep + 1;
       }
 
-      Start();
+      int num_threads = FLAGS_threads;
+      void (Benchmark::*method)(ThreadState*) = NULL;
       if (name == Slice("writeseq")) {
-        Write(SEQUENTIAL, num_, FLAGS_value_size);
+        method = &Benchmark::WriteSeq;
       } else if (name == Slice("writerandom")) {
-        Write(RANDOM, num_, FLAGS_value_size);
+        method = &Benchmark::WriteRandom;
       } else if (name == Slice("writebig")) {
-        Write(RANDOM, num_ / 1000, 100 * 1000);
+        method = &Benchmark::WriteBig;
+      } else if (name == Slice("writerandomthreads")) {
+        num_threads = FLAGS_write_threads;
+        method = &Benchmark::WriteRandomShare;
       } else if (name == Slice("readseq")) {
-        Read(SEQUENTIAL);
+        method = &Benchmark::ReadSequential;
       } else if (name == Slice("readrandom")) {
-        Read(RANDOM);
+        method = &Benchmark::ReadRandom;
+      } else if (name == Slice("readmissing")) {
+        method = &Benchmark::ReadMissing;
+      } else if (name == Slice("readhot")) {
+        method = &Benchmark::ReadHot;
+      } else if (name == Slice("seekrandom")) {
+        method = &Benchmark::SeekRandom;
+      } else if (name == Slice("deleterandom")) {
+        method = &Benchmark::DeleteRandom;
+      } else if (name == Slice("readwhilewriting")) {
+        num_threads++;  // Add extra thread for writing
+        method = &Benchmark::ReadWhileWriting;
+      } else if (name == Slice("readrandomwriterandom")) {
+        method = &Benchmark::ReadRandomWriteRandom;
+      } else if (name == Slice("ycsbload")) {
+        method = &Benchmark::YCSBLoad;
+      } else if (name == Slice("ycsba")) {
+        method = &Benchmark::YCSBA;
+      } else if (name == Slice("ycsbb")) {
+        method = &Benchmark::YCSBB;
+      } else if (name == Slice("ycsbc")) {
+        method = &Benchmark::YCSBC;
+      } else if (name == Slice("ycsbd")) {
+        method = &Benchmark::YCSBD;
+      } else if (name == Slice("ycsbe")) {
+        method = &Benchmark::YCSBE;
+      } else if (name == Slice("ycsbf")) {
+        method = &Benchmark::YCSBF;
       } else if (name == Slice("compact")) {
-        Compact();
+        num_threads = 1;
+        method = &Benchmark::Compact;
       } else if (name == Slice("heapprofile")) {
-        HeapProfile();
+        num_threads = 1;
+        method = &Benchmark::HeapProfile;
       } else if (name == Slice("sync")) {
         sync_ = true;
       } else if (name == Slice("nosync")) {
@@ -286,60 +797,321 @@ class Benchmark {
       } else {
         fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
       }
-      Stop(name);
+
+      if (method != NULL) {
+        if (num_threads < 1) num_threads = 1;
+        RunBenchmark(num_threads, name, method);
+      }
+    }
+  }
+
+ private:
+  void WriteSeq(ThreadState* thread) {
+    DoWrite(thread, SEQUENTIAL, num_, FLAGS_value_size);
+  }
+
+  void WriteRandom(ThreadState* thread) {
+    DoWrite(thread, RANDOM, num_, FLAGS_value_size);
+  }
+
+  void WriteBig(ThreadState* thread) {
+    DoWrite(thread, RANDOM, num_ / 1000, 100 * 1000);
+  }
+
+  // Write N values split evenly across the --write_threads concurrent
+  // writers.  With sync writes this measures how well concurrent commits
+  // are grouped into a single log sync.
+  void WriteRandomShare(ThreadState* thread) {
+    DoWrite(thread, RANDOM, num_ / thread->shared->total, FLAGS_value_size);
+    if (thread->tid == 0) {
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(%d threads)", thread->shared->total);
+      thread->stats.AddMessage(msg);
     }
   }
 
-  void Write(Order order, int num_entries, int value_size) {
+  void DoWrite(ThreadState* thread, Order order, int num_entries,
+               int value_size) {
+    RandomGenerator gen;
     WriteBatch batch;
     Status s;
-    std::string val;
     WriteOptions options;
     options.sync = sync_;
+    int64_t bytes = 0;
     for (int i = 0; i < num_entries; i++) {
       // 这里为啥要取余? 直接使用 rand_.Next() 不行么?
-      const int k = (order == SEQUENTIAL) ? i : (rand_.Next() % FLAGS_num);
+      const int k = (order == SEQUENTIAL) ? i
+                                          : (thread->rand.Next() % FLAGS_num);
       char key[100];
       snprintf(key, sizeof(key), "%012d", k);
       batch.Clear();
-      batch.Put(key, gen_.Generate(value_size));
+      batch.Put(key, gen.Generate(value_size));
       s = db_->Write(options, &batch);
-      bytes_ += value_size + strlen(key);
+      bytes += value_size + strlen(key);
       if (!s.ok()) {
         fprintf(stderr, "put error: %s\n", s.ToString().c_str());
         exit(1);
       }
-      FinishedSingleOp();
+      thread->stats.FinishedSingleOp();
     }
+    thread->stats.AddBytes(bytes);
   }
 
-  void Read(Order order) {
+  void ReadSequential(ThreadState* thread) {
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int i = 0;
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); i < num_ && iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+  }
+
+  // Get "num_" keys picked uniformly from [0, range), plus "suffix" to
+  // aim at keys that are never written, and report how many were found.
+  // read random 这里没有统计 bytes_, 我本来以为是疏漏了, 没想到最新版 rocksdb 也没有更新, 所以大概是有
+  // 科学道理的.
+  void DoRead(ThreadState* thread, int range, const char* suffix) {
     ReadOptions options;
-    if (order == SEQUENTIAL) {
-      Iterator* iter = db_->NewIterator(options);
-      int i = 0;
-      for (iter->SeekToFirst(); i < num_ && iter->Valid(); iter->Next()) {
-        bytes_ += iter->key().size() + iter->value().size();
-        FinishedSingleOp();
-        ++i;
+    std::string value;
+    PinnableSlice pinned;
+    int found = 0;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % range;
+      snprintf(key, sizeof(key), "%012d%s", k, suffix);
+      Status s = FLAGS_pin_slice ? db_->Get(options, key, &pinned)
+                                 : db_->Get(options, key, &value);
+      if (s.ok()) {
+        found++;
       }
-      delete iter;
-    } else {
-      // read random 这里没有统计 bytes_, 我本来以为是疏漏了, 没想到最新版 rocksdb 也没有更新, 所以大概是有
-      // 科学道理的.
-      std::string value;
-      for (int i = 0; i < num_; i++) {
-        char key[100];
-        const int k = (order == SEQUENTIAL) ? i : (rand_.Next() % FLAGS_num);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddCounter("reads", num_);
+    thread->stats.AddCounter("found", found);
+  }
+
+  void ReadRandom(ThreadState* thread) {
+    DoRead(thread, FLAGS_num, "");
+  }
+
+  void ReadMissing(ThreadState* thread) {
+    DoRead(thread, FLAGS_num, ".");
+  }
+
+  // Reads confined to the first 1% of the key space, which stays in the
+  // block cache.
+  void ReadHot(ThreadState* thread) {
+    DoRead(thread, (FLAGS_num + 99) / 100, "");
+  }
+
+  void SeekRandom(ThreadState* thread) {
+    ReadOptions options;
+    Iterator* iter = db_->NewIterator(options);
+    int found = 0;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%012d", k);
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) found++;
+      thread->stats.FinishedSingleOp();
+    }
+    delete iter;
+    thread->stats.AddCounter("seeks", num_);
+    thread->stats.AddCounter("found", found);
+  }
+
+  void DeleteRandom(ThreadState* thread) {
+    WriteOptions options;
+    options.sync = sync_;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%012d", k);
+      Status s = db_->Delete(options, key);
+      if (!s.ok()) {
+        fprintf(stderr, "del error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+  }
+
+  // Thread 0 keeps writing random keys until the other threads are done
+  // with their random reads.  Only the reads are measured.
+  void ReadWhileWriting(ThreadState* thread) {
+    if (thread->tid > 0) {
+      ReadRandom(thread);
+      return;
+    }
+
+    RandomGenerator gen;
+    WriteOptions options;
+    options.sync = sync_;
+    while (true) {
+      {
+        MutexLock l(&thread->shared->mu);
+        if (thread->shared->num_done + 1 >= thread->shared->total) {
+          // Other threads have finished
+          break;
+        }
+      }
+      const int k = thread->rand.Next() % FLAGS_num;
+      char key[100];
+      snprintf(key, sizeof(key), "%012d", k);
+      Status s = db_->Put(options, key, gen.Generate(FLAGS_value_size));
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+    }
+
+    // Do not count any of the preceding work in the stats
+    thread->stats.Start();
+  }
+
+  // Each op is a Get with probability --readwritepercent and a Put
+  // otherwise.
+  void ReadRandomWriteRandom(ThreadState* thread) {
+    RandomGenerator gen;
+    ReadOptions read_options;
+    WriteOptions write_options;
+    write_options.sync = sync_;
+    std::string value;
+    int reads = 0;
+    int found = 0;
+    int writes = 0;
+    for (int i = 0; i < num_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%012d", k);
+      const int pick = thread->rand.Uniform(100);
+      if (pick < FLAGS_readwritepercent) {
+        if (db_->Get(read_options, key, &value).ok()) {
+          found++;
+        }
+        reads++;
+      } else {
+        Status s = db_->Put(write_options, key,
+                            gen.Generate(FLAGS_value_size));
+        if (!s.ok()) {
+          fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+          exit(1);
+        }
+        writes++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddCounter("reads", reads);
+    thread->stats.AddCounter("writes", writes);
+    thread->stats.AddCounter("found", found);
+  }
+
+  // Write records [0, N), split across the threads.
+  void YCSBLoad(ThreadState* thread) {
+    const int total = thread->shared->total;
+    const int64_t num = FLAGS_num;
+    const int begin = num * thread->tid / total;
+    const int end = num * (thread->tid + 1) / total;
+    RandomGenerator gen;
+    WriteOptions options;
+    options.sync = sync_;
+    int64_t bytes = 0;
+    for (int k = begin; k < end; k++) {
+      char key[100];
+      snprintf(key, sizeof(key), "%012d", k);
+      Status s = db_->Put(options, key, gen.Generate(FLAGS_value_size));
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      bytes += FLAGS_value_size + strlen(key);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    ycsb_records_ = FLAGS_num;
+  }
+
+  void YCSBA(ThreadState* thread) { DoYCSB(thread, kYCSBWorkloadA); }
+  void YCSBB(ThreadState* thread) { DoYCSB(thread, kYCSBWorkloadB); }
+  void YCSBC(ThreadState* thread) { DoYCSB(thread, kYCSBWorkloadC); }
+  void YCSBD(ThreadState* thread) { DoYCSB(thread, kYCSBWorkloadD); }
+  void YCSBE(ThreadState* thread) { DoYCSB(thread, kYCSBWorkloadE); }
+  void YCSBF(ThreadState* thread) { DoYCSB(thread, kYCSBWorkloadF); }
+
+  void DoYCSB(ThreadState* thread, const YCSBWorkload& workload) {
+    KeyDistribution dist = workload.dist;
+    if (FLAGS_ycsb_distribution != NULL) {
+      ParseDistribution(FLAGS_ycsb_distribution, &dist);
+    }
+    const int records = ycsb_records_.load();
+    KeyChooser chooser(dist, records > 0 ? records : 1);
+    RandomGenerator gen;
+    ReadOptions read_options;
+    WriteOptions write_options;
+    write_options.sync = sync_;
+    std::string value;
+    const int ops = (FLAGS_ycsb_ops >= 0) ? FLAGS_ycsb_ops : num_;
+    int reads = 0, found = 0, updates = 0, inserts = 0, scans = 0, rmws = 0;
+
+    // Do not count setting up the chooser in the stats
+    thread->stats.Start();
+    for (int i = 0; i < ops; i++) {
+      char key[100];
+      Status s;
+      const int pick = thread->rand.Uniform(100);
+      if (pick < workload.insert) {
+        const int k = ycsb_records_.fetch_add(1);
+        snprintf(key, sizeof(key), "%012d", k);
+        s = db_->Put(write_options, key, gen.Generate(FLAGS_value_size));
+        inserts++;
+      } else {
+        const int records = ycsb_records_.load();
+        const int k = chooser.Next(&thread->rand, records > 0 ? records : 1);
         snprintf(key, sizeof(key), "%012d", k);
-        db_->Get(options, key, &value);
-        FinishedSingleOp();
+        const int op = pick - workload.insert;
+        if (op < workload.read) {
+          if (db_->Get(read_options, key, &value).ok()) found++;
+          reads++;
+        } else if (op < workload.read + workload.update) {
+          s = db_->Put(write_options, key, gen.Generate(FLAGS_value_size));
+          updates++;
+        } else if (op < workload.read + workload.update + workload.scan) {
+          const int len =
+              1 + thread->rand.Uniform(FLAGS_ycsb_max_scan_length);
+          Iterator* iter = db_->NewIterator(read_options);
+          iter->Seek(key);
+          for (int j = 0; j < len && iter->Valid(); j++) {
+            iter->Next();
+          }
+          delete iter;
+          scans++;
+        } else {
+          if (db_->Get(read_options, key, &value).ok()) found++;
+          s = db_->Put(write_options, key, gen.Generate(FLAGS_value_size));
+          rmws++;
+        }
       }
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
     }
+    thread->stats.AddCounter("reads", reads);
+    thread->stats.AddCounter("found", found);
+    thread->stats.AddCounter("updates", updates);
+    thread->stats.AddCounter("inserts", inserts);
+    thread->stats.AddCounter("scans", scans);
+    thread->stats.AddCounter("rmw", rmws);
   }
 
   // 这里的 compact 很粗糙啊
-  void Compact() {
+  void Compact(ThreadState* thread) {
     DBImpl* dbi = reinterpret_cast<DBImpl*>(db_);
     dbi->TEST_CompactMemTable();
     int max_level_with_files = 1;
@@ -360,19 +1132,19 @@ class Benchmark {
     reinterpret_cast<WritableFile*>(arg)->Append(Slice(buf, n));
   }
 
-  void HeapProfile() {
+  void HeapProfile(ThreadState* thread) {
     char fname[100];
     snprintf(fname, sizeof(fname), "/tmp/dbbench/heap-%04d", ++heap_counter_);
     WritableFile* file;
     Status s = Env::Default()->NewWritableFile(fname, &file);
     if (!s.ok()) {
-      message_ = s.ToString();
+      thread->stats.AddMessage(s.ToString());
       return;
     }
     bool ok = port::GetHeapProfile(WriteToFile, file);
     delete file;
     if (!ok) {
-      message_ = "not supported";
+      thread->stats.AddMessage("not supported");
       Env::Default()->DeleteFile(fname);
     }
   }
@@ -395,12 +1167,56 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--histogram=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_histogram = n;
+    } else if (sscanf(argv[i], "--json=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_json = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--pin_slice=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_slice = n;
+    } else if (sscanf(argv[i], "--readwritepercent=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 100) {
+      FLAGS_readwritepercent = n;
+    } else if (sscanf(argv[i], "--write_threads=%d%c", &n, &junk) == 1) {
+      FLAGS_write_threads = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c",
+                      &n, &junk) == 1 && (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--ycsb_ops=%d%c", &n, &junk) == 1) {
+      FLAGS_ycsb_ops = n;
+    } else if (leveldb::Slice(argv[i]).starts_with("--ycsb_distribution=")) {
+      leveldb::KeyDistribution dist;
+      FLAGS_ycsb_distribution = argv[i] + strlen("--ycsb_distribution=");
+      if (!leveldb::ParseDistribution(FLAGS_ycsb_distribution, &dist)) {
+        fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+        exit(1);
+      }
+    } else if (sscanf(argv[i], "--zipfian_constant=%lf%c", &d, &junk) == 1 &&
+               d > 0 && d < 1) {
+      FLAGS_zipfian_constant = d;
+    } else if (sscanf(argv[i], "--hotspot_set_fraction=%lf%c",
+                      &d, &junk) == 1 && d > 0 && d <= 1) {
+      FLAGS_hotspot_set_fraction = d;
+    } else if (sscanf(argv[i], "--hotspot_op_fraction=%lf%c",
+                      &d, &junk) == 1 && d >= 0 && d <= 1) {
+      FLAGS_hotspot_op_fraction = d;
+    } else if (sscanf(argv[i], "--ycsb_max_scan_length=%d%c",
+                      &n, &junk) == 1 && n > 0) {
+      FLAGS_ycsb_max_scan_length = n;
     }  else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
@@ -17,10 +17,12 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "include/db.h"
+#include "include/write_batch.h"
 #include "include/env.h"
 #include "include/status.h"
 #include "include/table.h"
@@ -32,9 +34,32 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
+#include "util/statistics_imp.h"
+#include "util/thread_pool.h"
 
 namespace leveldb {
 
+// Information kept for every waiting writer
+struct DBImpl::Writer {
+  Status status;
+  WriteBatch* batch;  // NULL requests a memtable compaction
+  bool sync;
+  bool done;
+  SequenceNumber sequence;  // Last sequence number assigned to batch
+  port::CondVar cv;
+
+  // Set by the group leader under allow_concurrent_memtable_write once
+  // the group is logged: this writer inserts its own batch into it.
+  MemTable* insert_into;
+
+  // Leader only: followers that have not finished their insert yet
+  int pending_inserts;
+
+  explicit Writer(port::Mutex* mu)
+      : cv(mu), insert_into(NULL), pending_inserts(0) { }
+};
+
 struct DBImpl::CompactionState {
   Compaction* const compaction;
 
@@ -51,6 +76,7 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_tombstones;
   };
   std::vector<Output> outputs;
 
@@ -62,14 +88,118 @@ struct DBImpl::CompactionState {
   // 我觉得这里是指本次 compact 输出的总字节数.
   uint64_t total_bytes;
 
+  // Large value references written to the outputs.  They are added to
+  // the compaction's edit once all subcompactions are done.
+  struct LargeRef {
+    LargeValueRef large_ref;
+    uint64_t number;
+    std::string internal_key;
+  };
+  std::vector<LargeRef> large_refs;
+
+  // Range of user keys handled by this state, (start, end], where a
+  // missing bound means unbounded.  Only subcompactions have bounds.
+  bool has_start;
+  std::string start;
+  bool has_end;
+  std::string end;
+
+  // Scan state for Compaction::IsBaseLevelForKey() over this range
+  int level_ptrs[config::kNumLevels];
+
+  // Range tombstones of the inputs.  range_del holds those every
+  // snapshot sees and drops the entries they delete; it is NULL if the
+  // inputs have no tombstones.  range_tombstones are the ones still
+  // needed, sorted by start key; each output file gets their pieces
+  // from tombstone_lower up to the first user key of the next file.
+  RangeDelAggregator* range_del;
+  std::vector<RangeTombstone> range_tombstones;
+  bool has_tombstone_lower;
+  std::string tombstone_lower;
+
   Output* current_output() { return &outputs[outputs.size()-1]; }  // 不知道 back() 么?
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
         outfile(NULL),
         builder(NULL),
-        total_bytes(0) {
+        total_bytes(0),
+        has_start(false),
+        has_end(false),
+        range_del(NULL),
+        has_tombstone_lower(false) {
+    for (int i = 0; i < config::kNumLevels; i++) {
+      level_ptrs[i] = 0;
+    }
+  }
+
+  ~CompactionState() {
+    delete range_del;
   }
+
+  // Store in *result the pieces of range_tombstones in
+  // [tombstone_lower, *upper), sorted in internal key order.
+  void ClipRangeTombstones(const Comparator* ucmp, const Slice* upper,
+                           std::vector<RangeTombstone>* result) const;
+};
+
+namespace {
+struct TombstoneLess {
+  const Comparator* ucmp;
+  explicit TombstoneLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const RangeTombstone& a, const RangeTombstone& b) const {
+    const int r = ucmp->Compare(a.start, b.start);
+    return r < 0 || (r == 0 && a.sequence > b.sequence);
+  }
+};
+}
+
+void DBImpl::CompactionState::ClipRangeTombstones(
+    const Comparator* ucmp,
+    const Slice* upper,
+    std::vector<RangeTombstone>* result) const {
+  result->clear();
+  for (size_t i = 0; i < range_tombstones.size(); i++) {
+    RangeTombstone t = range_tombstones[i];
+    if (has_tombstone_lower && ucmp->Compare(t.start, tombstone_lower) < 0) {
+      t.start = tombstone_lower;
+    }
+    if (upper != NULL && ucmp->Compare(t.end, *upper) > 0) {
+      t.end = upper->ToString();
+    }
+    if (ucmp->Compare(t.start, t.end) < 0) {
+      result->push_back(t);
+    }
+  }
+  std::sort(result->begin(), result->end(), TombstoneLess(ucmp));
+
+  // Pieces of one tombstone read from different input files may now
+  // start at the same key
+  size_t kept = 0;
+  for (size_t i = 0; i < result->size(); i++) {
+    RangeTombstone& t = (*result)[i];
+    if (kept > 0 && (*result)[kept - 1].sequence == t.sequence &&
+        ucmp->Compare((*result)[kept - 1].start, t.start) == 0) {
+      if (ucmp->Compare(t.end, (*result)[kept - 1].end) > 0) {
+        (*result)[kept - 1].end = t.end;
+      }
+    } else {
+      if (kept != i) {
+        (*result)[kept] = t;
+      }
+      kept++;
+    }
+  }
+  result->resize(kept);
+}
+
+struct DBImpl::SubcompactionJob {
+  DBImpl* db;
+  CompactionState* compact;
+  Status status;
+  port::Mutex* mu;
+  port::CondVar* cv;  // Signalled when *remaining drops
+  int* remaining;
 };
 
 namespace {
@@ -91,15 +221,36 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 // 注意这里的实现细节.
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
+                        const InternalFilterPolicy* ipolicy,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
+  result.filter_policy = (src.filter_policy != NULL) ? ipolicy : NULL;
   // QA: 这些限制值有什么科学道理么?
   // A: 当我看完了 leveldb 所有实现之后, 我觉得这里就是随心而欲设置的值吧
   ClipToRange(&result.max_open_files,           20,     50000);
   ClipToRange(&result.write_buffer_size,        64<<10, 1<<30);
   ClipToRange(&result.large_value_threshold,    16<<10, 1<<30);
   ClipToRange(&result.block_size,               1<<10,  4<<20);
+  ClipToRange(&result.max_background_compactions, 1,   64);
+  ClipToRange(&result.max_subcompactions,         1,   64);
+  ClipToRange(&result.compression_threads,        0,   64);
+  // Level-0 is only compacted once it reaches kL0_CompactionTrigger
+  // files, so a lower stop trigger would stop writes for good.
+  ClipToRange(&result.level0_stop_writes_trigger,
+              config::kL0_CompactionTrigger, 1<<10);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              config::kL0_CompactionTrigger,
+              result.level0_stop_writes_trigger);
+  if (result.hard_pending_compaction_bytes_limit > 0 &&
+      result.soft_pending_compaction_bytes_limit >
+      result.hard_pending_compaction_bytes_limit) {
+    result.soft_pending_compaction_bytes_limit =
+        result.hard_pending_compaction_bytes_limit;
+  }
+  if (result.delayed_write_rate == 0) {
+    result.delayed_write_rate = 1;
+  }
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -118,26 +269,46 @@ Options SanitizeOptions(const std::string& dbname,
 DBImpl::DBImpl(const Options& options, const std::string& dbname)
     : env_(options.env),
       internal_comparator_(options.comparator),
-      options_(SanitizeOptions(dbname, &internal_comparator_, options)),
+      internal_filter_policy_(options.filter_policy),
+      options_(SanitizeOptions(dbname, &internal_comparator_,
+                               &internal_filter_policy_, options)),
       owns_info_log_(options_.info_log != options.info_log),
       dbname_(dbname),
       db_lock_(NULL),
+      super_version_(NULL),
       shutting_down_(NULL),
       bg_cv_(&mutex_),
-      compacting_cv_(&mutex_),
       last_sequence_(0),
       mem_(new MemTable(internal_comparator_)),
+      imm_(NULL),
+      imm_log_number_(0),
       logfile_(NULL),
       log_(NULL),
       log_number_(0),
-      bg_compaction_scheduled_(false),
-      compacting_(false) {
+      tmp_batch_(new WriteBatch),
+      bg_compaction_scheduled_(0),
+      bg_flush_scheduled_(false),
+      manual_compaction_(false),
+      stall_micros_(0),
+      user_bytes_written_(0),
+      stats_dump_running_(false) {
   // Reserve ten files or so for other uses and give the rest to TableCache.
   const int table_cache_size = options.max_open_files - 10;
   table_cache_ = new TableCache(dbname_, &options_, table_cache_size);
 
   versions_ = new VersionSet(dbname_, &options_, table_cache_,
                              &internal_comparator_);
+
+  // The compaction thread runs one piece itself, so n-1 threads let a
+  // single compaction run all of its pieces at once
+  subcompaction_pool_ = NULL;
+  if (options_.max_subcompactions > 1) {
+    subcompaction_pool_ = new ThreadPool(env_);
+    subcompaction_pool_->SetMinThreads(options_.max_subcompactions - 1);
+  }
+
+  // Make sure the Env can run that many compactions at once
+  env_->SetBackgroundThreads(options_.max_background_compactions, Env::LOW);
 }
 
 /* 我之前一直在想会不会出现这种一种场景, 即某个线程 A 在使用着 dbimpl 执行一些操作, 然后另外一个线程 B 在执行
@@ -156,16 +327,24 @@ DBImpl::~DBImpl() {
   // 这里由于 mutex lock 的存在, shutdown 还有必要用原子操作么? 参见 DoCompactionWork(), 会在不持有锁的情况下
   // 读取 shutting_down_.
   shutting_down_.Release_Store(this);  // Any non-NULL value is ok
+  bg_cv_.SignalAll();                  // Wake up the stats dump thread
 
   /* 参见 MaybeScheduleCompaction(), leveldb 会原子地更新 bg_compaction_scheduled_, 以及调用
    * env_->Schedule(&DBImpl::BGWork, this). 因此当这样 bg_compaction_scheduled_ 为 true 时, 表明
    * BGWork() 已经被调度了, 此时等待其完成返回. 当 bg_compaction_scheduled_ 为 false 时, 表明当前没有
    * BGWork() 被调度, 而且由于这里同时更新了 shut down, 所以也不会再有 BGWork() 被调度, 所以这里可以直接返回.
    */
-  if (bg_compaction_scheduled_) {
-    while (bg_compaction_scheduled_) {
-      bg_cv_.Wait();
-    }
+  // The same holds for the memtable compaction scheduled at Env::HIGH.
+  while (bg_compaction_scheduled_ > 0 || bg_flush_scheduled_ ||
+         stats_dump_running_) {
+    bg_cv_.Wait();
+  }
+  if (super_version_ != NULL) {
+    // No reader can be left at this point
+    assert(super_version_->refs == 1);
+    super_version_->current->Unref();
+    delete super_version_;
+    super_version_ = NULL;
   }
   mutex_.Unlock();
 
@@ -175,9 +354,12 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   delete mem_;
+  delete imm_;
+  delete tmp_batch_;
   delete log_;
   delete logfile_;
   delete table_cache_;
+  delete subcompaction_pool_;
 
   if (owns_info_log_) {
     delete options_.info_log;
@@ -252,7 +434,7 @@ void DBImpl::DeleteObsoleteFiles() {
   std::set<uint64_t> live = pending_outputs_;
   versions_->AddLiveFiles(&live);
 
-  versions_->CleanupLargeValueRefs(live, log_number_);
+  versions_->CleanupLargeValueRefs(live, log_number_, imm_log_number_);
 
   std::vector<std::string> filenames;
   env_->GetChildren(dbname_, &filenames); // Ignoring errors on purpose
@@ -264,7 +446,7 @@ void DBImpl::DeleteObsoleteFiles() {
       bool keep = true;
       switch (type) {
         case kLogFile:
-          keep = (number == log_number_);
+          keep = (number == log_number_ || number == imm_log_number_);
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -337,10 +519,28 @@ Status DBImpl::Recover(VersionEdit* edit) {
 
   s = versions_->Recover(&log_number_, &last_sequence_);
   if (s.ok()) {
-    // Recover from the log file named in the descriptor
+    // Recover from the log file named in the descriptor and from any
+    // newer log files.  A newer log file exists if we switched to a new
+    // memtable but died before the old one was compacted.
     SequenceNumber max_sequence(0);
+    std::vector<uint64_t> logs;
     if (log_number_ != 0) {  // log_number_ == 0 indicates initial empty state
-      s = RecoverLogFile(log_number_, edit, &max_sequence);
+      std::vector<std::string> filenames;
+      env_->GetChildren(dbname_, &filenames);  // Ignoring errors on purpose
+      uint64_t number;
+      LargeValueRef large_ref;
+      FileType type;
+      for (int i = 0; i < filenames.size(); i++) {
+        if (ParseFileName(filenames[i], &number, &large_ref, &type) &&
+            type == kLogFile && number > log_number_) {
+          logs.push_back(number);
+        }
+      }
+      logs.push_back(log_number_);
+      std::sort(logs.begin(), logs.end());
+    }
+    for (int i = 0; i < logs.size() && s.ok(); i++) {
+      s = RecoverLogFile(logs[i], edit, &max_sequence);
     }
     if (s.ok()) {
       last_sequence_ =
@@ -461,53 +661,62 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit) {
    */
   pending_outputs_.insert(meta.number);
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(env_, options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long) meta.number);
-  Status s = BuildTable(dbname_, env_, options_, table_cache_,
-                        iter, &meta, edit);
+
+  Options table_options = options_;
+  table_options.compression = CompressionForLevel(options_, 0);
+  const uint64_t start_micros = env_->NowMicros();
+  Status s;
+  {
+    mutex_.Unlock();
+    s = BuildTable(dbname_, env_, table_options, table_cache_, iter,
+                   range_del_iter, &meta, edit);
+    mutex_.Lock();
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  stats.bytes_written = meta.file_size;
+  stats.count = 1;
+  stats_[0].Add(stats);
+  RecordTick(options_.statistics, kFlushBytesWritten, meta.file_size);
+
   Log(env_, options_.info_log, "Level-0 table #%llu: %lld bytes %s",
       (unsigned long long) meta.number,
       (unsigned long long) meta.file_size,
       s.ToString().c_str());
   delete iter;
+  delete range_del_iter;
   pending_outputs_.erase(meta.number);
   return s;
 }
 
 Status DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
+  assert(imm_ != NULL);
 
-  WritableFile* lfile = NULL;
-  uint64_t new_log_number = versions_->NewFileNumber();
-
+  // Save the contents of the memtable as a new Table
   VersionEdit edit;
+  Status s = WriteLevel0Table(imm_, &edit);
 
-  // Save the contents of the memtable as a new Table
-  Status s = WriteLevel0Table(mem_, &edit);
-  if (s.ok()) {
-    s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+  if (s.ok() && shutting_down_.Acquire_Load()) {
+    s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Save a new descriptor with the new table and log number.
+  // Replace immutable memtable with the generated Table.  The log file
+  // of imm_ is no longer needed once the descriptor names log_number_.
   if (s.ok()) {
-    s = Install(&edit, new_log_number, mem_);
+    s = Install(&edit, log_number_, imm_);
   }
 
   if (s.ok()) {
     // Commit to the new state
-    mem_ = new MemTable(internal_comparator_);
-    delete log_;
-    delete logfile_;
-    logfile_ = lfile;
-    log_ = new log::Writer(lfile);
-    log_number_ = new_log_number;
-    // 我觉得 DeleteObsoleteFiles() 这么重的操作不必要放在 CompactMemTable() 中, 放到一个后台线程慢慢跑就行了
-    // 么
+    imm_ = NULL;
+    imm_log_number_ = 0;
+    InstallSuperVersion();
     DeleteObsoleteFiles();
-    MaybeScheduleCompaction();
-  } else {
-    delete lfile;
-    env_->DeleteFile(LogFileName(dbname_, new_log_number));
   }
   return s;
 }
@@ -520,9 +729,12 @@ void DBImpl::TEST_CompactRange(
     const std::string& begin,
     const std::string& end) {
   MutexLock l(&mutex_);
-  while (compacting_) {
-    compacting_cv_.Wait();
+  // Do not run concurrently with background level compactions.  A
+  // background memtable compaction may still run alongside.
+  while (manual_compaction_ || bg_compaction_scheduled_ > 0) {
+    bg_cv_.Wait();
   }
+  manual_compaction_ = true;
   Compaction* c = versions_->CompactRange(
       level,
       InternalKey(begin, kMaxSequenceNumber, kValueTypeForSeek),
@@ -532,31 +744,80 @@ void DBImpl::TEST_CompactRange(
     CompactionState* compact = new CompactionState(c);
     DoCompactionWork(compact);  // Ignore error in test compaction, 这样真的好么?
     CleanupCompaction(compact);
+    delete c;
   }
+  manual_compaction_ = false;
+  bg_cv_.SignalAll();
 
   // Start any background compaction that may have been delayed by this thread
   MaybeScheduleCompaction();
 }
 
 Status DBImpl::TEST_CompactMemTable() {
-  MutexLock l(&mutex_);
-  return CompactMemTable();
+  // NULL batch means just wait for earlier writes to be done
+  Status s = Write(WriteOptions(), NULL);
+  if (s.ok()) {
+    // Wait until the compaction completes
+    MutexLock l(&mutex_);
+    while (imm_ != NULL && bg_error_.ok()) {
+      bg_cv_.Wait();
+    }
+    if (imm_ != NULL) {
+      s = bg_error_;
+    }
+  }
+  return s;
 }
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (bg_compaction_scheduled_) {
+  if (imm_ != NULL && !bg_flush_scheduled_ &&
+      !shutting_down_.Acquire_Load()) {
+    bg_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGWorkFlush, this, Env::HIGH);
+  }
+
+  if (bg_compaction_scheduled_ >= options_.max_background_compactions) {
     // Already scheduled
-  } else if (compacting_) {  // 参见 compacting_ 的注释, 我觉得这里没有必要判断 compacting.
+  } else if (manual_compaction_) {
     // Some other thread is running a compaction.  Do not conflict with it.
   } else if (shutting_down_.Acquire_Load()) {
     // DB is being deleted; no more background compactions
   } else if (!versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    bg_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    // Only add one compaction per call: whether another one can run
+    // next to the running ones is only known once they have picked
+    // their inputs.
+    bg_compaction_scheduled_++;
+    env_->Schedule(&DBImpl::BGWork, this, Env::LOW);
+  }
+}
+
+void DBImpl::BGWorkFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(bg_flush_scheduled_);
+  if (!shutting_down_.Acquire_Load() && imm_ != NULL) {
+    // This is the only caller of CompactMemTable() once the DB is open,
+    // so at most one memtable compaction runs at a time.
+    Status s = CompactMemTable();
+    if (!s.ok() && !shutting_down_.Acquire_Load()) {
+      Log(env_, options_.info_log,
+          "Memtable compaction error: %s", s.ToString().c_str());
+      if (options_.paranoid_checks && bg_error_.ok()) {
+        bg_error_ = s;
+      }
+    }
   }
+  bg_flush_scheduled_ = false;
+  bg_cv_.SignalAll();  // Wakeup MakeRoomForWrite() if necessary
+
+  // The new level-0 file may call for a compaction.
+  MaybeScheduleCompaction();
 }
 
 void DBImpl::BGWork(void* db) {
@@ -565,22 +826,21 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(bg_compaction_scheduled_);
-  if (!shutting_down_.Acquire_Load() &&
-      /* 由于此时 bg_compaction_scheduled_ 为 true, 所以 compacting_ 一定为 false. 按我理解如果
-       * compacting_ 为 true, 表明 BGWork() 已经在某个线程上运行着了, 所以触发本次 BackgroundCall()
-       * 的 MaybeScheduleCompaction() 不应该执行 env->Schedule() 的, 即本次 BackgroundCall() 不应该运行,
-       * 所以既然此时 BackgroundCall() 已经在运行了, 所以表明 compacting_ 为 false.
-       */
-      !compacting_) {
-    BackgroundCompaction();
+  assert(bg_compaction_scheduled_ > 0);
+  bool picked = false;
+  if (!shutting_down_.Acquire_Load() && !manual_compaction_) {
+    picked = BackgroundCompaction();
   }
-  bg_compaction_scheduled_ = false;
+  bg_compaction_scheduled_--;
   bg_cv_.SignalAll();
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  If nothing could be
+  // picked because of the compactions still running, the last of them
+  // to finish reschedules instead, which avoids spinning.
+  if (picked || bg_compaction_scheduled_ == 0) {
+    MaybeScheduleCompaction();
+  }
 }
 
 /* BackgroundCompaction() 大致分为三个阶段:
@@ -588,22 +848,28 @@ void DBImpl::BackgroundCall() {
  * 2. 执行 compact 操作;
  * 3. 执行一些收尾操作.
  */
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
+  Status status;
   Compaction* c = versions_->PickCompaction();
   if (c == NULL) {
     // Nothing to do
-    return;
+    return false;
   }
 
-  Status status;
+  // Another compaction may be able to run next to this one
+  MaybeScheduleCompaction();
+
   if (c->num_input_files(0) == 1 && c->num_input_files(1) == 0) {
     // Move file to next level. 真机智.
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size,
-                       f->smallest, f->largest);
-    status = Install(c->edit(), log_number_, NULL);
+                       f->smallest, f->largest, f->has_range_tombstones);
+    status = Install(c->edit(), LiveLogNumber(), NULL);
+    if (status.ok()) {
+      InstallSuperVersion();
+    }
     Log(env_, options_.info_log, "Moved #%lld to level-%d %lld bytes %s\n",
         static_cast<unsigned long long>(f->number),
         c->level() + 1,
@@ -628,6 +894,7 @@ void DBImpl::BackgroundCompaction() {
       bg_error_ = status;
     }
   }
+  return true;
 }
 
 /* 按我理解, 该函数应该由 DoCompactionWork() 内部调用, 不应该外界直接调用的.
@@ -666,6 +933,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_tombstones = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -674,14 +942,44 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    compact->builder = new TableBuilder(options_, compact->outfile);
+    Options table_options = options_;
+    table_options.compression = CompressionForLevel(
+        options_, compact->compaction->level() + 1);
+    compact->builder = new TableBuilder(table_options, compact->outfile);
   }
   return s;
 }
 
+void DBImpl::AddOutputRangeTombstones(CompactionState* compact,
+                                      const Slice* upper) {
+  std::vector<RangeTombstone> pieces;
+  compact->ClipRangeTombstones(user_comparator(), upper, &pieces);
+  CompactionState::Output* out = compact->current_output();
+  bool has_bounds = (compact->builder->NumEntries() > 0);
+  for (size_t i = 0; i < pieces.size(); i++) {
+    const RangeTombstone& t = pieces[i];
+    InternalKey start(t.start, t.sequence, kTypeRangeDeletion);
+    InternalKey end(t.end, kMaxSequenceNumber, kTypeRangeDeletion);
+    compact->builder->AddRangeTombstone(start.Encode(), t.end);
+    out->has_range_tombstones = true;
+    if (!has_bounds || internal_comparator_.Compare(start, out->smallest) < 0) {
+      out->smallest = start;
+    }
+    if (!has_bounds || internal_comparator_.Compare(end, out->largest) > 0) {
+      out->largest = end;
+    }
+    has_bounds = true;
+  }
+  if (upper != NULL) {
+    compact->has_tombstone_lower = true;
+    compact->tombstone_lower = upper->ToString();
+  }
+}
+
 // FinishCompactionOutputFile 依次更新 compact 每一个域, 可以参考 CompactionState 的定义一起看一下.
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* upper) {
   assert(compact != NULL);
   assert(compact->outfile != NULL);
   assert(compact->builder != NULL);
@@ -689,6 +987,10 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   const uint64_t output_number = compact->current_output()->number;
   assert(output_number != 0);
 
+  if (!compact->range_tombstones.empty()) {
+    AddOutputRangeTombstones(compact, upper);
+  }
+
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
@@ -747,13 +1049,15 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     const CompactionState::Output& out = compact->outputs[i];
     compact->compaction->edit()->AddFile(
         level + 1,
-        out.number, out.file_size, out.smallest, out.largest);
+        out.number, out.file_size, out.smallest, out.largest,
+        out.has_range_tombstones);
     pending_outputs_.erase(out.number);
   }
   compact->outputs.clear();
 
-  Status s = Install(compact->compaction->edit(), log_number_, NULL);
+  Status s = Install(compact->compaction->edit(), LiveLogNumber(), NULL);
   if (s.ok()) {
+    InstallSuperVersion();
     compact->compaction->ReleaseInputs();
     DeleteObsoleteFiles();
   } else {
@@ -773,6 +1077,7 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
  * 3. 执行收尾操作.
  */
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
+  const uint64_t start_micros = env_->NowMicros();
   Log(env_, options_.info_log,  "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0),
       compact->compaction->level(),
@@ -788,14 +1093,346 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
 
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+
   // Release mutex while we're actually doing the compaction work
-  compacting_ = true;
   mutex_.Unlock();
 
+  Status status = CollectRangeTombstones(compact);
+  if (!status.ok()) {
+    // Nothing to compact
+  } else if (boundaries.empty() || compact->range_del != NULL) {
+    // Range tombstones may span the subcompaction boundaries, so inputs
+    // holding them are compacted in one piece.
+    status = DoSubcompactionWork(compact);
+  } else {
+    status = RunSubcompactions(compact, boundaries);
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  Compaction* c = compact->compaction;
+  for (int i = 0; i < c->num_input_files(0); i++) {
+    stats.bytes_read_nonoutput += c->input(0, i)->file_size;
+  }
+  for (int i = 0; i < c->num_input_files(1); i++) {
+    stats.bytes_read_output += c->input(1, i)->file_size;
+  }
+  stats.bytes_written = compact->total_bytes;
+  stats.count = 1;
+  RecordTick(options_.statistics, kCompactionBytesRead,
+             stats.bytes_read_nonoutput + stats.bytes_read_output);
+  RecordTick(options_.statistics, kCompactionBytesWritten,
+             stats.bytes_written);
+
+  mutex_.Lock();
+  stats_[c->level() + 1].Add(stats);
+
+  for (int i = 0; i < compact->large_refs.size(); i++) {
+    const CompactionState::LargeRef& r = compact->large_refs[i];
+    compact->compaction->edit()->AddLargeValueRef(r.large_ref, r.number,
+                                                  r.internal_key);
+  }
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  return status;
+}
+
+Status DBImpl::CollectRangeTombstones(CompactionState* compact) {
+  Compaction* c = compact->compaction;
+  std::vector<RangeTombstone> tombstones;
+  Status s;
+  for (int which = 0; which < 2 && s.ok(); which++) {
+    for (int i = 0; i < c->num_input_files(which) && s.ok(); i++) {
+      Iterator* iter = table_cache_->NewRangeTombstoneIterator(
+          ReadOptions(), c->input(which, i)->number);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        RangeTombstone t;
+        if (!ParseRangeTombstone(iter->key(), iter->value(), &t)) {
+          s = Status::Corruption("corrupted range tombstone");
+          break;
+        }
+        tombstones.push_back(t);
+      }
+      if (s.ok()) {
+        s = iter->status();
+      }
+      delete iter;
+    }
+  }
+  if (!s.ok() || tombstones.empty()) {
+    return s;
+  }
+
+  compact->range_del = new RangeDelAggregator(user_comparator(),
+                                              compact->smallest_snapshot);
+  for (size_t i = 0; i < tombstones.size(); i++) {
+    const RangeTombstone& t = tombstones[i];
+    compact->range_del->AddTombstone(t);
+    // Once every snapshot sees it, a tombstone deletes nothing beyond
+    // this compaction if no deeper level overlaps it.
+    if (t.sequence > compact->smallest_snapshot ||
+        !c->IsBaseLevelForRange(t.start, t.end)) {
+      compact->range_tombstones.push_back(t);
+    }
+  }
+  std::sort(compact->range_tombstones.begin(),
+            compact->range_tombstones.end(),
+            TombstoneLess(user_comparator()));
+  return s;
+}
+
+void DBImpl::SubcompactionThread(void* arg) {
+  SubcompactionJob* job = reinterpret_cast<SubcompactionJob*>(arg);
+  job->status = job->db->DoSubcompactionWork(job->compact);
+  MutexLock l(job->mu);
+  (*job->remaining)--;
+  job->cv->Signal();
+}
+
+Status DBImpl::RunSubcompactions(CompactionState* compact,
+                                 const std::vector<std::string>& boundaries) {
+  const int n = boundaries.size() + 1;
+  std::vector<CompactionState*> pieces(n);
+  for (int i = 0; i < n; i++) {
+    CompactionState* piece = new CompactionState(compact->compaction);
+    piece->smallest_snapshot = compact->smallest_snapshot;
+    if (i > 0) {
+      piece->has_start = true;
+      piece->start = boundaries[i - 1];
+    }
+    if (i < n - 1) {
+      piece->has_end = true;
+      piece->end = boundaries[i];
+    }
+    pieces[i] = piece;
+  }
+
+  // Run the first piece in this thread and the others on
+  // subcompaction_pool_.  They are not scheduled on the Env's thread
+  // pools, which may be fully taken by compactions waiting for their
+  // pieces.  The pieces never wait on anything, so concurrent compactions
+  // sharing the bounded pool only queue behind each other.
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int remaining = n - 1;
+  std::vector<SubcompactionJob> jobs(n);
+  for (int i = 1; i < n; i++) {
+    jobs[i].db = this;
+    jobs[i].compact = pieces[i];
+    jobs[i].mu = &mu;
+    jobs[i].cv = &cv;
+    jobs[i].remaining = &remaining;
+    subcompaction_pool_->Schedule(&DBImpl::SubcompactionThread, &jobs[i]);
+  }
+  Status status = DoSubcompactionWork(pieces[0]);
+  mu.Lock();
+  while (remaining > 0) {
+    cv.Wait();
+  }
+  mu.Unlock();
+
+  // Collect the results in key order.  Outputs of failed pieces are
+  // kept too so that CleanupCompaction() forgets them.
+  for (int i = 0; i < n; i++) {
+    CompactionState* piece = pieces[i];
+    if (status.ok() && i > 0) {
+      status = jobs[i].status;
+    }
+    compact->outputs.insert(compact->outputs.end(),
+                            piece->outputs.begin(), piece->outputs.end());
+    compact->large_refs.insert(compact->large_refs.end(),
+                               piece->large_refs.begin(),
+                               piece->large_refs.end());
+    compact->total_bytes += piece->total_bytes;
+    if (piece->builder != NULL) {
+      piece->builder->Abandon();
+      delete piece->builder;
+    }
+    delete piece->outfile;
+    delete piece;
+  }
+  Log(env_, options_.info_log, "Compaction ran as %d subcompactions", n);
+  return status;
+}
+
+Status DBImpl::AddCompactionOutput(CompactionState* compact, Iterator* input,
+                                   const Slice& key, const Slice& value) {
+  Status status;
+  // Close the output file if it is big enough.  This waits for the next
+  // key so that range tombstones can be cut at it.  A user key is not
+  // split across files holding tombstones: a piece cut at that key
+  // would miss the older entries in the next file.
+  if (compact->builder != NULL &&
+      compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    ParsedInternalKey next;
+    if (!ParseInternalKey(key, &next)) {
+      status = FinishCompactionOutputFile(compact, input, NULL);
+    } else if (compact->range_tombstones.empty() ||
+               user_comparator()->Compare(
+                   next.user_key,
+                   compact->current_output()->largest.user_key()) != 0) {
+      status = FinishCompactionOutputFile(compact, input, &next.user_key);
+    }
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  // Open output file if necessary
+  if (compact->builder == NULL) {
+    status = OpenCompactionOutputFile(compact);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+  // 将未被丢弃的 key/value 写入 builder 中, 同时更新 output.
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+
+  // 无法解析的 key 原样写入.
+  ParsedInternalKey ikey;
+  if (ParseInternalKey(key, &ikey) && ikey.type == kTypeLargeValueRef) {
+    if (value.size() != LargeValueRef::ByteSize()) {  // 确实需要检查一下哈
+      if (options_.paranoid_checks) {
+        return Status::Corruption("invalid large value ref");
+      } else {  // 忽略本次 key/value.
+        Log(env_, options_.info_log,
+            "compaction found invalid large value ref");
+      }
+    } else {
+      CompactionState::LargeRef r;
+      r.large_ref = LargeValueRef::FromRef(value);
+      r.number = compact->current_output()->number;
+      r.internal_key = key.ToString();
+      compact->large_refs.push_back(r);
+      compact->builder->Add(key, value);
+    }
+  } else {
+    compact->builder->Add(key, value);
+  }
+  return status;
+}
+
+Status DBImpl::CompactMergeOperands(CompactionState* compact,
+                                    Iterator* input,
+                                    const Slice& user_key,
+                                    SequenceNumber* last_sequence_for_key) {
+  // Buffer the run, newest first, up to the value or deletion ending it
+  std::vector<std::string> operands;
+  std::vector<SequenceNumber> sequences;
+  std::string terminal_key, terminal_value;
+  bool has_terminal = false;
+  bool drop_terminal = false;
+  ValueType terminal_type = kTypeValue;
+  while (input->Valid()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(input->key(), &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (compact->range_del != NULL && compact->range_del->ShouldDelete(ikey)) {
+      // Deleted by a range tombstone, like everything older: acts as a
+      // deletion that is not written out
+      has_terminal = true;
+      terminal_type = kTypeDeletion;
+      drop_terminal = true;
+      *last_sequence_for_key = ikey.sequence;
+      input->Next();
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(input->value().ToString());
+      sequences.push_back(ikey.sequence);
+      input->Next();
+      continue;
+    }
+    has_terminal = true;
+    terminal_type = ikey.type;
+    terminal_key = input->key().ToString();
+    terminal_value = input->value().ToString();
+    *last_sequence_for_key = ikey.sequence;
+    input->Next();
+    break;
+  }
+  assert(!operands.empty());
+
+  const MergeOperator* merge_operator = options_.merge_operator;
+  if (merge_operator != NULL) {
+    // Large values are left alone rather than read back in here
+    const bool full_merge =
+        has_terminal ? (terminal_type != kTypeLargeValueRef)
+                     : compact->compaction->IsBaseLevelForKey(
+                           user_key, compact->level_ptrs);
+    std::string merged;
+    Slice existing(terminal_value);
+    if (full_merge &&
+        ApplyMergeOperands(merge_operator, user_key,
+                           (has_terminal && terminal_type == kTypeValue)
+                               ? &existing : NULL,
+                           operands, &merged).ok()) {
+      // The merged value hides everything older for this key
+      *last_sequence_for_key = sequences[0];
+      InternalKey ikey(user_key, sequences[0], kTypeValue);
+      return AddCompactionOutput(compact, input, ikey.Encode(), merged);
+    }
+
+    // Combine adjacent operands, oldest first; each result takes the
+    // sequence of the newer operand.
+    std::vector<std::string> combined;
+    std::vector<SequenceNumber> combined_sequences;
+    for (size_t i = operands.size(); i > 0; i--) {
+      std::string tmp;
+      if (!combined.empty() &&
+          merge_operator->PartialMerge(user_key, combined.back(),
+                                       operands[i - 1], &tmp)) {
+        combined.back().swap(tmp);
+        combined_sequences.back() = sequences[i - 1];
+      } else {
+        combined.push_back(operands[i - 1]);
+        combined_sequences.push_back(sequences[i - 1]);
+      }
+    }
+    std::reverse(combined.begin(), combined.end());
+    std::reverse(combined_sequences.begin(), combined_sequences.end());
+    operands.swap(combined);
+    sequences.swap(combined_sequences);
+  }
+
+  // Failed merges keep their operands so reads report the error
+  Status status;
+  for (size_t i = 0; i < operands.size() && status.ok(); i++) {
+    InternalKey ikey(user_key, sequences[i], kTypeMerge);
+    status = AddCompactionOutput(compact, input, ikey.Encode(), operands[i]);
+  }
+  if (status.ok() && has_terminal && !drop_terminal) {
+    status = AddCompactionOutput(compact, input, terminal_key, terminal_value);
+  }
+  return status;
+}
+
+Status DBImpl::DoSubcompactionWork(CompactionState* compact) {
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
-  input->SeekToFirst();
   Status status;
   ParsedInternalKey ikey;
+  if (compact->has_start) {
+    // Entries for the start key itself belong to the previous range
+    input->Seek(
+        InternalKey(compact->start, kMaxSequenceNumber, kValueTypeForSeek)
+        .Encode());
+    while (input->Valid() && ParseInternalKey(input->key(), &ikey) &&
+           user_comparator()->Compare(ikey.user_key, compact->start) == 0) {
+      input->Next();
+    }
+  } else {
+    input->SeekToFirst();
+  }
 
   /* 在了解这几个变量语义之前, 首先了解一下 input 值的模型, 对 input 进行遍历将产生如下序列:
    * (ukey0, seqN), (ukey0, seqN-1), ..., (ukey0, seq0), (ukey1, seqM), (ukey2, seqQ), ...
@@ -810,6 +1447,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
    * 所以这里将 last_sequence_for_key 置为了一个比 current internal key sequence 要大的值, 比如:
    * kMaxSequenceNumber.
    */
+  //
+  // Merge operands do not hide older entries, so last_sequence_for_key
+  // only tracks values and deletions.
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
@@ -817,7 +1457,13 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     // 1. 计算当前 input->key() 是否需要丢弃, 以及更新一些状态.
     // Handle key/value, add to state, etc.
     Slice key = input->key();
+    if (compact->has_end && ParseInternalKey(key, &ikey) &&
+        user_comparator()->Compare(ikey.user_key, compact->end) > 0) {
+      // Past the end of this subcompaction's range
+      break;
+    }
     bool drop = false;
+    bool merge_run = false;
     if (!ParseInternalKey(key, &ikey)) {
       /* 此时表明 key 的格式不被 leveldb 理解, 我本来是以为这个会被丢弃的, 没想到 leveldb 是将 key 原样写入到
        * compact output 中.
@@ -839,9 +1485,14 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;    // (A)
+      } else if (compact->range_del != NULL &&
+                 compact->range_del->ShouldDelete(ikey)) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        compact->level_ptrs)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -888,7 +1539,12 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;
       } */
 
-      last_sequence_for_key = ikey.sequence;
+      if (ikey.type != kTypeMerge) {
+        last_sequence_for_key = ikey.sequence;
+      } else if (ikey.sequence <= compact->smallest_snapshot) {
+        // No snapshot sees this key between here and its older entries
+        merge_run = true;
+      }
     }
 #if 0
     Log(env_, options_.info_log,
@@ -896,55 +1552,26 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeLargeValueRef, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               compact->level_ptrs),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
     // 2. 若 drop 为 true, 则丢弃, 调用 input Next() 方法处理下一个 key/value. 若 drop 为 false, 则写入
     // 新文件中.
-    if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == NULL) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      // 将未被丢弃的 key/value 写入 builder 中, 同时更新 output.
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-
-      // 这里当 ParseInternalKey() 出错时, ikey 未被正确地初始化. 实验表明此时 ikey.type = 0(kTypeDeletion)
-      // 所以此时很幸运地走向了 else 分支.
-      if (ikey.type == kTypeLargeValueRef) {
-        if (input->value().size() != LargeValueRef::ByteSize()) {  // 确实需要检查一下哈
-          if (options_.paranoid_checks) {
-            status = Status::Corruption("invalid large value ref");
-            break;
-          } else {  // 忽略本次 key/value.
-            Log(env_, options_.info_log,
-                "compaction found invalid large value ref");
-          }
-        } else {
-          compact->compaction->edit()->AddLargeValueRef(
-              LargeValueRef::FromRef(input->value()),
-              compact->current_output()->number,
-              input->key());
-          compact->builder->Add(key, input->value());
-        }
-      } else {
-        compact->builder->Add(key, input->value());
+    if (!drop && merge_run) {
+      // Consumes the operands and the entry they apply to
+      status = CompactMergeOperands(compact, input, current_user_key,
+                                    &last_sequence_for_key);
+      if (!status.ok()) {
+        break;
       }
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      continue;
+    }
+    if (!drop) {
+      status = AddCompactionOutput(compact, input, key, input->value());
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -954,83 +1581,480 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.Acquire_Load()) {
     status = Status::IOError("Deleting DB during compaction");  // 此时会丢弃本次 compaction 结果.
   }
+  if (status.ok() && compact->builder == NULL &&
+      !compact->range_tombstones.empty()) {
+    // The tombstones past the last key need a file of their own
+    std::vector<RangeTombstone> pieces;
+    compact->ClipRangeTombstones(user_comparator(), NULL, &pieces);
+    if (!pieces.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != NULL) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, NULL);
   }
   if (status.ok()) {  // 这一步是不是可以提前一点, 毕竟可以省了一次 FinishCompactionOutputFile() 操作了.
     status = input->status();
   }
   delete input;
   input = NULL;
-
-  mutex_.Lock();
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  compacting_ = false;
-  compacting_cv_.SignalAll();
   return status;
 }
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot) {
-  mutex_.Lock();
-  *latest_snapshot = last_sequence_;
+                                      SequenceNumber* latest_snapshot,
+                                      RangeDelAggregator** range_del) {
+  SuperVersion* sv = AcquireSuperVersion(latest_snapshot);
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
-  list.push_back(mem_->NewIterator());
-  versions_->current()->AddIterators(options, &list);
+  list.push_back(sv->mem->NewIterator());
+  if (sv->imm != NULL) {
+    list.push_back(sv->imm->NewIterator());
+  }
+  sv->current->AddIterators(options, &list);
+
+  if (range_del != NULL) {
+    // Gather the range tombstones visible at the iterator's snapshot
+    SequenceNumber snapshot =
+        (options.snapshot ? options.snapshot->number_ : *latest_snapshot);
+    *range_del = new RangeDelAggregator(user_comparator(), snapshot);
+    Iterator* iter = sv->mem->NewRangeTombstoneIterator();
+    Status s = (*range_del)->AddTombstones(iter);
+    delete iter;
+    if (s.ok() && sv->imm != NULL) {
+      iter = sv->imm->NewRangeTombstoneIterator();
+      s = (*range_del)->AddTombstones(iter);
+      delete iter;
+    }
+    if (s.ok()) {
+      s = sv->current->AddRangeTombstones(options, *range_del);
+    }
+    if (!s.ok()) {
+      // Ignoring the tombstones would expose deleted data
+      list.push_back(NewErrorIterator(s));
+    }
+    if ((*range_del)->empty()) {
+      delete *range_del;
+      *range_del = NULL;
+    }
+  }
+
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();  // 哦哦忘了 ref==
-  internal_iter->RegisterCleanup(&DBImpl::Unref, this, versions_->current());
-  // 如果我们这里 delete internal_iter; 那么就会死锁啊!
-  mutex_.Unlock();
+  internal_iter->RegisterCleanup(&DBImpl::CleanupSuperVersion, this, sv);
   return internal_iter;
 }
 
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
-  return NewInternalIterator(ReadOptions(), &ignored);
+  return NewInternalIterator(ReadOptions(), &ignored, NULL);
 }
 
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
-  // TODO(opt): faster implementation
-  Iterator* iter = NewIterator(options);
-  iter->Seek(key);
-  bool found = false;
-  if (iter->Valid() && user_comparator()->Compare(key, iter->key()) == 0) {
-    Slice v = iter->value();
-    value->assign(v.data(), v.size());
-    found = true;
-  }
-  // Non-OK iterator status trumps everything else
-  Status result = iter->status();
-  if (result.ok() && !found) {
-    result = Status::NotFound(Slice());  // Use an empty error message for speed
+  return GetImpl(options, key, value, NULL);
+}
+
+Status DBImpl::Get(const ReadOptions& options,
+                   const Slice& key,
+                   PinnableSlice* value) {
+  value->Reset();
+  Status s = GetImpl(options, key, value->GetSelf(), value);
+  if (s.ok() && !value->IsPinned()) {
+    value->PinSelf();
   }
-  delete iter;
-  return result;
+  return s;
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options,
+                       const Slice& key,
+                       std::string* value,
+                       PinnableSlice* pinned) {
+  StopWatch sw(env_, options_.statistics, kGetMicros);
+  Status s;
+  SequenceNumber latest_snapshot;
+  SuperVersion* sv = AcquireSuperVersion(&latest_snapshot);
+  SequenceNumber snapshot =
+      (options.snapshot ? options.snapshot->number_ : latest_snapshot);
+
+  LookupKey lkey(key, snapshot);
+  ValueType type;
+  std::vector<std::string> merge_operands;  // Newest first
+  SequenceNumber max_covering_tombstone = 0;
+  if (sv->mem->Get(lkey, &type, value, &merge_operands,
+                   &max_covering_tombstone)) {
+    PERF_COUNTER_ADD(get_from_memtable_count, 1);
+  } else if (sv->imm != NULL &&
+             sv->imm->Get(lkey, &type, value, &merge_operands,
+                          &max_covering_tombstone)) {
+    PERF_COUNTER_ADD(get_from_memtable_count, 1);
+  } else {
+    s = sv->current->Get(options, lkey, &type, value, &merge_operands,
+                         &max_covering_tombstone, pinned);
+    if (s.ok()) {
+      PERF_COUNTER_ADD(get_from_table_count, 1);
+    }
+  }
+  if (s.ok()) {
+    switch (type) {
+      case kTypeValue:
+        break;
+      case kTypeDeletion:
+        s = Status::NotFound(Slice());
+        break;
+      case kTypeLargeValueRef: {
+        std::string ref;
+        ref.swap(*value);
+        s = ReadLargeValue(env_, dbname_, ref, value);
+        break;
+      }
+      case kTypeMerge:
+      case kTypeRangeDeletion:
+        assert(false);  // Lookups step over merge operands and tombstones
+        break;
+    }
+  }
+  if (!merge_operands.empty()) {
+    // Fold the operands into the value they were written on top of
+    if (s.ok()) {
+      Slice existing(*value);
+      s = ApplyMergeOperands(options_.merge_operator, key, &existing,
+                             merge_operands, value);
+    } else if (s.IsNotFound()) {
+      s = ApplyMergeOperands(options_.merge_operator, key, NULL,
+                             merge_operands, value);
+    }
+  }
+
+  ReleaseSuperVersion(sv);
+  if (s.ok()) {
+    RecordTick(options_.statistics, kBytesRead,
+               (pinned != NULL && pinned->IsPinned()) ? pinned->size()
+                                                      : value->size());
+  }
+  return s;
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
-  Iterator* internal_iter = NewInternalIterator(options, &latest_snapshot);
+  RangeDelAggregator* range_del;
+  Iterator* internal_iter = NewInternalIterator(options, &latest_snapshot,
+                                                &range_del);
   SequenceNumber sequence =
       (options.snapshot ? options.snapshot->number_ : latest_snapshot);
-  return NewDBIterator(&dbname_, env_,
-                       user_comparator(), internal_iter, sequence);
+  return NewDBIterator(&dbname_, env_, user_comparator(),
+                       options_.merge_operator, options_.statistics,
+                       range_del, internal_iter, sequence);
+}
+
+void DBImpl::InstallSuperVersion() {
+  mutex_.AssertHeld();
+  SuperVersion* sv = new SuperVersion;
+  sv->mem = mem_;
+  sv->imm = imm_;
+  sv->current = versions_->current();
+  sv->current->Ref();
+  sv->refs = 1;  // Held by super_version_
+
+  SuperVersion* old;
+  {
+    MutexLock l(&sv_mutex_);
+    old = super_version_;
+    super_version_ = sv;
+    if (old != NULL && --old->refs > 0) {
+      // Still in use by readers; the last of them deletes it
+      old = NULL;
+    }
+  }
+  if (old != NULL) {
+    old->current->Unref();
+    delete old;
+  }
 }
 
-void DBImpl::Unref(void* arg1, void* arg2) {
+DBImpl::SuperVersion* DBImpl::AcquireSuperVersion(
+    SequenceNumber* latest_snapshot) {
+  PERF_TIMER_GUARD(db_mutex_lock_micros, env_);
+  MutexLock l(&sv_mutex_);
+  PERF_TIMER_STOP(db_mutex_lock_micros);
+  SuperVersion* sv = super_version_;
+  sv->refs++;
+  *latest_snapshot = last_sequence_;
+  return sv;
+}
+
+void DBImpl::ReleaseSuperVersion(SuperVersion* sv) {
+  {
+    MutexLock l(&sv_mutex_);
+    if (--sv->refs > 0) {
+      return;
+    }
+  }
+  // sv has been replaced, so nobody else can reach it any more
+  MutexLock l(&mutex_);
+  sv->current->Unref();
+  delete sv;
+}
+
+void DBImpl::CleanupSuperVersion(void* arg1, void* arg2) {
   DBImpl* impl = reinterpret_cast<DBImpl*>(arg1);
-  Version* v = reinterpret_cast<Version*>(arg2);
-  MutexLock l(&impl->mutex_);
-  v->Unref();
+  impl->ReleaseSuperVersion(reinterpret_cast<SuperVersion*>(arg2));
+}
+
+namespace {
+
+// Presents the entries of a table written with user keys as internal
+// keys that all carry sequence number "seq".  Iterating forward also
+// checks that the user keys are strictly increasing.
+class IngestIterator : public Iterator {
+ public:
+  IngestIterator(Iterator* iter, const Comparator* ucmp, SequenceNumber seq)
+      : iter_(iter), ucmp_(ucmp), seq_(seq) { }
+  virtual ~IngestIterator() {
+    delete iter_;
+  }
+
+  virtual bool Valid() const { return status_.ok() && iter_->Valid(); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); Update(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); Update(); }
+  virtual void Seek(const Slice& target) {
+    iter_->Seek(ExtractUserKey(target));
+    Update();
+  }
+  virtual void Next() {
+    assert(Valid());
+    prev_.assign(iter_->key().data(), iter_->key().size());
+    iter_->Next();
+    if (iter_->Valid() && ucmp_->Compare(prev_, iter_->key()) >= 0) {
+      status_ = Status::Corruption("keys out of order after",
+                                   EscapeString(prev_));
+    }
+    Update();
+  }
+  virtual void Prev() { iter_->Prev(); Update(); }
+  virtual Slice key() const { return key_; }
+  virtual Slice value() const { return iter_->value(); }
+  virtual Status status() const {
+    return status_.ok() ? iter_->status() : status_;
+  }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      key_.clear();
+      AppendInternalKey(&key_,
+                        ParsedInternalKey(iter_->key(), seq_, kTypeValue));
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const ucmp_;
+  const SequenceNumber seq_;
+  std::string key_;
+  std::string prev_;
+  Status status_;
+};
+
+// Returns true iff "mem" holds an entry for a user key in
+// [smallest,largest] whose sequence number is at least "min_seq".
+bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                      const Slice& smallest, const Slice& largest,
+                      SequenceNumber min_seq = 0) {
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+  bool result = false;
+  for (iter->Seek(start.Encode());
+       !result && iter->Valid() &&
+           ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+       iter->Next()) {
+    ParsedInternalKey ikey;
+    result = !ParseInternalKey(iter->key(), &ikey) ||
+             ikey.sequence >= min_seq;
+  }
+  delete iter;
+  return result;
+}
+
+}
+
+Status DBImpl::CopyIngestedTable(Table* table, SequenceNumber seq,
+                                 FileMetaData* meta) {
+  Iterator* iter = new IngestIterator(table->NewIterator(ReadOptions()),
+                                      user_comparator(), seq);
+  VersionEdit unused;  // BuildTable() adds the file at level-0
+  Status s = BuildTable(dbname_, env_, options_, table_cache_, iter, NULL,
+                        meta, &unused);
+  delete iter;
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const std::string& path) {
+  // The file is only scanned, so leave filters and the block cache out
+  Options table_options = options_;
+  table_options.comparator = user_comparator();
+  table_options.filter_policy = NULL;
+  table_options.block_cache = NULL;
+
+  RandomAccessFile* file = NULL;
+  Table* table = NULL;
+  Status s = env_->NewRandomAccessFile(path, &file);
+  if (s.ok()) {
+    s = Table::Open(table_options, file, &table);
+  }
+
+  std::string smallest, largest;
+  if (s.ok()) {
+    Iterator* iter = table->NewIterator(ReadOptions());
+    iter->SeekToLast();
+    if (iter->Valid()) {
+      largest = iter->key().ToString();
+      iter->SeekToFirst();
+      smallest = iter->key().ToString();
+    } else if (iter->status().ok()) {
+      s = Status::InvalidArgument(path, "no entries to ingest");
+    } else {
+      s = iter->status();
+    }
+    delete iter;
+  }
+
+  if (s.ok()) {
+    // Copy the file while other writes go on, giving its entries the
+    // sequence number the next write would get.  Holding the write
+    // queue is only needed to check that no write or snapshot taken
+    // meanwhile is ordered differently against it, and to install it.
+    FileMetaData meta;
+    SequenceNumber seq;
+    {
+      MutexLock l(&mutex_);
+      seq = last_sequence_ + 1;
+      meta.number = versions_->NewFileNumber();
+      pending_outputs_.insert(meta.number);
+    }
+    s = CopyIngestedTable(table, seq, &meta);
+
+    MutexLock l(&mutex_);
+    if (s.ok()) {
+      // A NULL batch keeps leaders from adding us to their group
+      Writer w(&mutex_);
+      w.batch = NULL;
+      w.sync = false;
+      w.done = false;
+      writers_.push_back(&w);
+      while (&w != writers_.front()) {
+        w.cv.Wait();
+      }
+
+      // Entries with sequence numbers from "seq" on that overlap the
+      // file were written while it was copied and would be read before
+      // it.  So would the file be by snapshots taken meanwhile.
+      const bool recopy =
+          (!snapshots_.empty() && snapshots_.newest()->number_ >= seq) ||
+          MemTableOverlaps(mem_, user_comparator(), smallest, largest, seq) ||
+          (imm_ != NULL &&
+           MemTableOverlaps(imm_, user_comparator(), smallest, largest,
+                            seq)) ||
+          versions_->OverlapsFilesAfter(meta.number, smallest, largest);
+
+      // Memtable entries for keys in the file are older than the file but
+      // would be read first, so move them to level-0.
+      if (MemTableOverlaps(mem_, user_comparator(), smallest, largest)) {
+        s = MakeRoomForWrite(true);
+      }
+      while (s.ok() && imm_ != NULL &&
+             MemTableOverlaps(imm_, user_comparator(), smallest, largest)) {
+        if (!bg_error_.ok()) {
+          s = bg_error_;
+        } else {
+          bg_cv_.Wait();
+        }
+      }
+
+      if (s.ok()) {
+        // Level-0 files are read newest number first, so the file needs
+        // a number above the ones flushed while it was copied.
+        const uint64_t old_number = meta.number;
+        meta.number = versions_->NewFileNumber();
+        pending_outputs_.insert(meta.number);
+        if (recopy) {
+          env_->DeleteFile(TableFileName(dbname_, old_number));
+          seq = last_sequence_ + 1;
+          mutex_.Unlock();
+          s = CopyIngestedTable(table, seq, &meta);
+          mutex_.Lock();
+        } else {
+          s = env_->RenameFile(TableFileName(dbname_, old_number),
+                               TableFileName(dbname_, meta.number));
+        }
+        table_cache_->Evict(old_number);
+        pending_outputs_.erase(old_number);
+      }
+
+      int level = 0;
+      if (s.ok()) {
+        level = versions_->PickLevelForIngestedFile(meta.smallest.user_key(),
+                                                    meta.largest.user_key());
+        const SequenceNumber last = std::max(last_sequence_, seq);
+        VersionEdit edit;
+        edit.AddFile(level, meta.number, meta.file_size,
+                     meta.smallest, meta.largest, false);
+        edit.SetLogNumber(LiveLogNumber());
+        edit.SetLastSequence(last);
+        s = versions_->LogAndApply(&edit, NULL);
+        if (s.ok()) {
+          InstallSuperVersion();
+          MutexLock sl(&sv_mutex_);
+          last_sequence_ = last;
+        }
+      }
+      Log(env_, options_.info_log,
+          "Ingested %s as #%llu@%d%s: %lld bytes %s",
+          path.c_str(),
+          static_cast<unsigned long long>(meta.number),
+          level,
+          recopy ? " (copied twice)" : "",
+          static_cast<long long>(meta.file_size),
+          s.ToString().c_str());
+      if (s.ok()) {
+        MaybeScheduleCompaction();
+      }
+
+      writers_.pop_front();
+      if (!writers_.empty()) {
+        writers_.front()->cv.Signal();
+      }
+    }
+    if (!s.ok()) {
+      env_->DeleteFile(TableFileName(dbname_, meta.number));
+    }
+    pending_outputs_.erase(meta.number);
+  }
+
+  delete table;
+  delete file;
+  return s;
+}
+
+Status DBImpl::DeleteFilesInRange(const Slice& begin, const Slice& end) {
+  MutexLock l(&mutex_);
+  VersionEdit edit;
+  const int deleted = versions_->AddFileDeletionsInRange(begin, end, &edit);
+  if (deleted == 0) {
+    return Status::OK();
+  }
+  Status s = Install(&edit, LiveLogNumber(), NULL);
+  if (s.ok()) {
+    InstallSuperVersion();
+    DeleteObsoleteFiles();
+  }
+  Log(env_, options_.info_log, "Deleted %d files in range '%s' .. '%s': %s",
+      deleted,
+      EscapeString(begin).c_str(),
+      EscapeString(end).c_str(),
+      s.ToString().c_str());
+  return s;
 }
 
 const Snapshot* DBImpl::GetSnapshot() {
@@ -1052,46 +2076,344 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
-Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
-  Status status;
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  return DB::DeleteRange(options, begin, end);
+}
 
-  WriteBatch* final = NULL;
-  {
-    MutexLock l(&mutex_);
-    if (!bg_error_.ok()) {
-      status = bg_error_;
-    } else if (mem_->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      status = CompactMemTable();
+Status DBImpl::Merge(const WriteOptions& o, const Slice& key,
+                     const Slice& val) {
+  if (options_.merge_operator == NULL) {
+    return Status::InvalidArgument("no merge operator configured");
+  }
+  return DB::Merge(o, key, val);
+}
+
+Status DBImpl::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  StopWatch sw(env_, options_.statistics, kWriteMicros);
+  Writer w(&mutex_);
+  w.batch = my_batch;
+  w.sync = options.sync;
+  w.done = false;
+
+  PERF_TIMER_GUARD(db_mutex_lock_micros, env_);
+  MutexLock l(&mutex_);
+  PERF_TIMER_STOP(db_mutex_lock_micros);
+  writers_.push_back(&w);
+  while (!w.done && &w != writers_.front()) {
+    w.cv.Wait();
+    if (w.insert_into != NULL) {
+      // The leader of our group has logged our batch; apply it next to
+      // the other members of the group.
+      MemTable* mem = w.insert_into;
+      w.insert_into = NULL;
+      mutex_.Unlock();
+      Status s;
+      {
+        PERF_TIMER_GUARD(write_memtable_micros, env_);
+        s = WriteBatchInternal::InsertInto(w.batch, mem, true);
+      }
+      mutex_.Lock();
+      if (!s.ok()) {
+        w.status = s;
+      }
+      Writer* leader = writers_.front();
+      if (--leader->pending_inserts == 0) {
+        leader->cv.Signal();
+      }
     }
-    if (status.ok()) {
-      status = HandleLargeValues(last_sequence_ + 1, updates, &final);
+  }
+  if (w.done) {
+    // Our batch was written by the leader of an earlier group.
+    if (options.post_write_snapshot != NULL) {
+      *options.post_write_snapshot =
+          w.status.ok() ? snapshots_.New(w.sequence) : NULL;
     }
-    if (status.ok()) {
-      WriteBatchInternal::SetSequence(final, last_sequence_ + 1);
-      last_sequence_ += WriteBatchInternal::Count(final);
+    return w.status;
+  }
 
-      // Add to log and apply to memtable
-      status = log_->AddRecord(WriteBatchInternal::Contents(final));
+  // We are the leader now.
+  Status status = MakeRoomForWrite(my_batch == NULL);
+  const SequenceNumber group_start = last_sequence_;
+  SequenceNumber last_sequence = last_sequence_;
+  Writer* last_writer = &w;
+  if (status.ok() && my_batch != NULL) {
+    // Batches with large values are written on their own since
+    // HandleLargeValues() has to register the large value refs under
+    // the sequence numbers they are finally assigned.
+    WriteBatch* updates = NULL;
+    if (HasLargeValues(*my_batch)) {
+      status = HandleLargeValues(last_sequence + 1, my_batch, &updates);
+    } else {
+      updates = BuildBatchGroup(&last_writer);
+    }
+    // Only a merged group has several batches to insert in parallel
+    const bool parallel =
+        options_.allow_concurrent_memtable_write && updates == tmp_batch_;
+    if (status.ok()) {
+      // Delay for the bytes of the whole group, not just our own batch
+      const size_t bytes = WriteBatchInternal::ByteSize(updates);
+      DelayWrite(bytes);
+      WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+      last_sequence += WriteBatchInternal::Count(updates);
+      user_bytes_written_ += bytes;
+      RecordTick(options_.statistics, kBytesWritten, bytes);
+
+      // Add to log and apply to memtable.  We can release the lock
+      // during this phase since &w is currently responsible for logging
+      // and protects against concurrent loggers and concurrent writes
+      // into mem_.
+      mutex_.Unlock();
+      {
+        PERF_TIMER_GUARD(write_wal_micros, env_);
+        status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      }
       if (status.ok() && options.sync) {
+        PERF_TIMER_GUARD(wal_sync_micros, env_);
+        StopWatch sync_sw(env_, options_.statistics, kSyncMicros);
         status = logfile_->Sync();
       }
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(final, mem_);
+      if (status.ok() && !parallel) {
+        PERF_TIMER_GUARD(write_memtable_micros, env_);
+        status = WriteBatchInternal::InsertInto(updates, mem_);
       }
+      mutex_.Lock();
+      if (status.ok() && parallel) {
+        // Give every writer of the group its sequence numbers and let
+        // the followers insert their batches while we insert ours.
+        SequenceNumber seq = group_start + 1;
+        for (std::deque<Writer*>::iterator iter = writers_.begin(); ;
+             ++iter) {
+          Writer* member = *iter;
+          WriteBatchInternal::SetSequence(member->batch, seq);
+          seq += WriteBatchInternal::Count(member->batch);
+          if (member != &w) {
+            member->insert_into = mem_;
+            w.pending_inserts++;
+            member->cv.Signal();
+          }
+          if (member == last_writer) break;
+        }
+        MemTable* mem = mem_;
+        mutex_.Unlock();
+        {
+          PERF_TIMER_GUARD(write_memtable_micros, env_);
+          status = WriteBatchInternal::InsertInto(my_batch, mem, true);
+        }
+        mutex_.Lock();
+        while (w.pending_inserts > 0) {
+          w.cv.Wait();
+        }
+      }
+      {
+        // Publish the group to readers
+        MutexLock l(&sv_mutex_);
+        last_sequence_ = last_sequence;
+      }
+    }
+    if (updates == tmp_batch_) {
+      tmp_batch_->Clear();
+    } else if (updates != my_batch) {
+      delete updates;
     }
+  }
 
-    if (options.post_write_snapshot != NULL) {
-      *options.post_write_snapshot =
-          status.ok() ? snapshots_.New(last_sequence_) : NULL;
+  // Hand out the results to every writer of the group.
+  SequenceNumber seq = group_start;
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready->batch != NULL) {
+      seq += WriteBatchInternal::Count(ready->batch);
+    }
+    ready->sequence = seq;
+    if (ready != &w) {
+      if (ready->status.ok()) {
+        // Else its own parallel insert failed
+        ready->status = status;
+      }
+      ready->done = true;
+      ready->cv.Signal();
     }
+    if (ready == last_writer) break;
   }
-  if (final != updates) {
-    delete final;
+
+  // Notify new head of write queue
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
   }
 
+  if (options.post_write_snapshot != NULL) {
+    *options.post_write_snapshot =
+        status.ok() ? snapshots_.New(w.sequence) : NULL;
+  }
   return status;
 }
 
+// REQUIRES: Writer list must be non-empty
+// REQUIRES: First writer must have a non-NULL batch without large values
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+  mutex_.AssertHeld();
+  assert(!writers_.empty());
+  Writer* first = writers_.front();
+  WriteBatch* result = first->batch;
+  assert(result != NULL);
+
+  size_t size = WriteBatchInternal::ByteSize(first->batch);
+
+  // Allow the group to grow up to a maximum size, but if the
+  // original write is small, limit the growth so we do not slow
+  // down the small write too much.
+  size_t max_size = 1 << 20;
+  if (size <= (128<<10)) {
+    max_size = size + (128<<10);
+  }
+
+  *last_writer = first;
+  std::deque<Writer*>::iterator iter = writers_.begin();
+  ++iter;  // Advance past "first"
+  for (; iter != writers_.end(); ++iter) {
+    Writer* w = *iter;
+    if (w->sync && !first->sync) {
+      // Do not include a sync write into a batch handled by a non-sync write.
+      break;
+    }
+
+    if (w->batch == NULL || HasLargeValues(*w->batch)) {
+      // Memtable compactions and large values are handled by their own
+      // writer once it reaches the front of the queue.
+      break;
+    }
+
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = tmp_batch_;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
+    }
+    WriteBatchInternal::Append(result, w->batch);
+    *last_writer = w;
+  }
+  return result;
+}
+
+uint64_t DBImpl::WriteDelayMicros(size_t bytes) {
+  mutex_.AssertHeld();
+  const int level0_files = versions_->NumLevelFiles(0);
+  const uint64_t pending = versions_->EstimatedPendingCompactionBytes();
+  const int slowdown = options_.level0_slowdown_writes_trigger;
+  const int stop = options_.level0_stop_writes_trigger;
+  const uint64_t soft = options_.soft_pending_compaction_bytes_limit;
+  const uint64_t hard = options_.hard_pending_compaction_bytes_limit;
+
+  // How far we have got from a slowdown trigger towards a stop trigger,
+  // from 0 to 1.  Negative if no slowdown trigger has been reached.
+  double pressure = -1;
+  if (level0_files >= slowdown) {
+    pressure = (stop > slowdown)
+        ? static_cast<double>(level0_files - slowdown) / (stop - slowdown)
+        : 1.0;
+  }
+  if (soft > 0 && pending >= soft) {
+    const double p = (hard > soft)
+        ? static_cast<double>(pending - soft) / (hard - soft)
+        : 1.0;
+    if (p > pressure) pressure = p;
+  }
+  if (pressure < 0) {
+    return 0;
+  }
+
+  // Slow down linearly, but keep letting a trickle of writes through so
+  // that a single write is never held back for too long.
+  double factor = 1.0 - pressure;
+  if (factor < 1.0 / 16) factor = 1.0 / 16;
+  const double rate = options_.delayed_write_rate * factor;
+  return static_cast<uint64_t>(bytes * 1e6 / rate);
+}
+
+void DBImpl::DelayWrite(size_t bytes) {
+  mutex_.AssertHeld();
+  const uint64_t delay = WriteDelayMicros(bytes);
+  if (delay > 0) {
+    // Compactions are falling behind.  Rather than stopping writes once
+    // a stop trigger is hit, delay each write by an amount that grows
+    // as we get closer to it.
+    mutex_.Unlock();
+    env_->SleepForMicroseconds(delay);
+    mutex_.Lock();
+    stall_micros_ += delay;
+    RecordTick(options_.statistics, kStallMicros, delay);
+  }
+}
+
+Status DBImpl::MakeRoomForWrite(bool force) {
+  mutex_.AssertHeld();
+  assert(!writers_.empty());
+  const uint64_t stall_start = stall_micros_;
+  Status s;
+  while (true) {
+    if (!bg_error_.ok()) {
+      // Yield previous error
+      s = bg_error_;
+      break;
+    } else if (!force &&
+               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
+      // There is room in current memtable
+      break;
+    } else if (imm_ != NULL) {
+      // We have filled up the current memtable, but the previous
+      // one is still being compacted, so we wait.
+      const uint64_t start = env_->NowMicros();
+      bg_cv_.Wait();
+      stall_micros_ += env_->NowMicros() - start;
+    } else if (versions_->NumLevelFiles(0) >=
+               options_.level0_stop_writes_trigger ||
+               (options_.hard_pending_compaction_bytes_limit > 0 &&
+                versions_->EstimatedPendingCompactionBytes() >=
+                options_.hard_pending_compaction_bytes_limit)) {
+      // Too much compaction work is pending; wait for it to get done.
+      Log(env_, options_.info_log, "Stopping writes: %d level-0 files, "
+          "%llu pending compaction bytes\n",
+          versions_->NumLevelFiles(0),
+          static_cast<unsigned long long>(
+              versions_->EstimatedPendingCompactionBytes()));
+      const uint64_t start = env_->NowMicros();
+      bg_cv_.Wait();
+      stall_micros_ += env_->NowMicros() - start;
+    } else {
+      // Attempt to switch to a new memtable and trigger compaction of old
+      assert(imm_log_number_ == 0);
+      uint64_t new_log_number = versions_->NewFileNumber();
+      WritableFile* lfile = NULL;
+      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      if (!s.ok()) {
+        break;
+      }
+      delete log_;
+      delete logfile_;
+      logfile_ = lfile;
+      log_ = new log::Writer(lfile);
+      imm_log_number_ = log_number_;
+      log_number_ = new_log_number;
+      imm_ = mem_;
+      mem_ = new MemTable(internal_comparator_);
+      InstallSuperVersion();
+      force = false;   // Do not force another compaction if have room
+      MaybeScheduleCompaction();
+    }
+  }
+  RecordTick(options_.statistics, kStallMicros, stall_micros_ - stall_start);
+  return s;
+}
+
 bool DBImpl::HasLargeValues(const WriteBatch& batch) const {
   if (WriteBatchInternal::ByteSize(&batch) >= options_.large_value_threshold) {
   // 这个 if 判断很精彩啊.
@@ -1221,6 +2543,13 @@ Status DBImpl::HandleLargeValues(SequenceNumber assigned_seq,
         case kTypeDeletion:
           (*final)->Delete(it.key());
           break;
+        case kTypeMerge:
+          // Merge operands are always stored inline
+          (*final)->Merge(it.key(), it.value());
+          break;
+        case kTypeRangeDeletion:
+          (*final)->DeleteRange(it.key(), it.value());
+          break;
       }
       seq = seq + 1;
     }
@@ -1245,10 +2574,104 @@ bool DBImpl::GetProperty(const Slice& property, uint64_t* value) {
       *value = versions_->NumLevelFiles(level);
       return true;
     }
+  } else if (in == "num-running-compactions") {
+    *value = versions_->NumRunningCompactions();
+    return true;
+  } else if (in == "stall-micros") {
+    *value = stall_micros_;
+    return true;
+  } else if (in == "estimated-pending-compaction-bytes") {
+    *value = versions_->EstimatedPendingCompactionBytes();
+    return true;
   }
   return false;
 }
 
+bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+  value->clear();
+  MutexLock l(&mutex_);
+  if (property == "leveldb.stats") {
+    AppendStats(value);
+    return true;
+  }
+  return false;
+}
+
+void DBImpl::AppendStats(std::string* value) {
+  mutex_.AssertHeld();
+  // R-Amp is the bytes a compaction into a level read per byte taken
+  // from the level above it, W-Amp the bytes it wrote.  For level-0
+  // W-Amp compares the flushed bytes with the user data written.
+  char buf[200];
+  value->append(
+      "                               Compactions\n"
+      "Level  Files Size(MB) Time(sec) Read(MB) Write(MB) R-Amp W-Amp\n"
+      "---------------------------------------------------------------\n");
+  int64_t total_written = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const CompactionStats& s = stats_[level];
+    const int files = versions_->NumLevelFiles(level);
+    if (files == 0 && s.count == 0) {
+      continue;
+    }
+    const int64_t bytes_read = s.bytes_read_nonoutput + s.bytes_read_output;
+    double read_amp = 0;
+    double write_amp = 0;
+    if (level == 0) {
+      if (user_bytes_written_ > 0) {
+        write_amp = s.bytes_written / static_cast<double>(user_bytes_written_);
+      }
+    } else if (s.bytes_read_nonoutput > 0) {
+      read_amp = bytes_read / static_cast<double>(s.bytes_read_nonoutput);
+      write_amp = s.bytes_written / static_cast<double>(s.bytes_read_nonoutput);
+    }
+    snprintf(buf, sizeof(buf),
+             "%3d %8d %8.1f %9.1f %8.1f %9.1f %5.1f %5.1f\n",
+             level, files, versions_->NumLevelBytes(level) / 1048576.0,
+             s.micros / 1e6, bytes_read / 1048576.0,
+             s.bytes_written / 1048576.0, read_amp, write_amp);
+    value->append(buf);
+    total_written += s.bytes_written;
+  }
+  snprintf(buf, sizeof(buf),
+           "User writes: %.1f MB; table writes: %.1f MB; "
+           "write amplification: %.1f\n"
+           "Stalls: %.3f sec\n",
+           user_bytes_written_ / 1048576.0, total_written / 1048576.0,
+           (user_bytes_written_ > 0
+            ? total_written / static_cast<double>(user_bytes_written_) : 0.0),
+           stall_micros_ / 1e6);
+  value->append(buf);
+  if (options_.statistics != NULL) {
+    value->append(options_.statistics->ToString());
+  }
+}
+
+void DBImpl::StatsDumpWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->StatsDumpLoop();
+}
+
+void DBImpl::StatsDumpLoop() {
+  const uint64_t period =
+      static_cast<uint64_t>(options_.stats_dump_period_sec) * 1000000;
+  MutexLock l(&mutex_);
+  uint64_t next_dump = env_->NowMicros() + period;
+  while (!shutting_down_.Acquire_Load()) {
+    const uint64_t now = env_->NowMicros();
+    if (now < next_dump) {
+      bg_cv_.TimedWait(next_dump - now);
+      continue;
+    }
+    std::string stats;
+    AppendStats(&stats);
+    Log(env_, options_.info_log, "------- DUMPING STATS -------\n%s",
+        stats.c_str());
+    next_dump = now + period;
+  }
+  stats_dump_running_ = false;
+  bg_cv_.SignalAll();
+}
+
 void DBImpl::GetApproximateSizes(
     const Range* range, int n,
     uint64_t* sizes) {
@@ -1289,6 +2712,30 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+              PinnableSlice* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  if (s.ok()) {
+    value->PinSelf();
+  }
+  return s;
+}
+
 DB::~DB() { }
 
 
@@ -1316,9 +2763,14 @@ Status DB::Open(const Options& options, const std::string& dbname,
       s = impl->Install(&edit, impl->log_number_, NULL);
     }
     if (s.ok()) {
+      impl->InstallSuperVersion();
       impl->DeleteObsoleteFiles();
     }
   }
+  if (s.ok() && impl->options_.stats_dump_period_sec > 0) {
+    impl->stats_dump_running_ = true;
+    options.env->StartThread(&DBImpl::StatsDumpWork, impl);
+  }
   impl->mutex_.Unlock();
   if (s.ok()) {
     *dbptr = impl;
@@ -5,10 +5,12 @@
 #ifndef STORAGE_LEVELDB_DB_DB_IMPL_H_
 #define STORAGE_LEVELDB_DB_DB_IMPL_H_
 
+#include <deque>
 #include <set>
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/version_set.h"
 #include "include/db.h"
 #include "include/env.h"
 #include "port/port.h"
@@ -16,7 +18,10 @@
 namespace leveldb {
 
 class MemTable;
+class RangeDelAggregator;
+class Table;
 class TableCache;
+class ThreadPool;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -30,15 +35,25 @@ class DBImpl : public DB {
   // Implementations of the DB interface
   virtual Status Put(const WriteOptions&, const Slice& key, const Slice& value);
   virtual Status Delete(const WriteOptions&, const Slice& key);
+  virtual Status DeleteRange(const WriteOptions&, const Slice& begin,
+                             const Slice& end);
+  virtual Status Merge(const WriteOptions&, const Slice& key,
+                       const Slice& value);
   virtual Status Write(const WriteOptions& options, WriteBatch* updates);
   virtual Status Get(const ReadOptions& options,
                      const Slice& key,
                      std::string* value);
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key,
+                     PinnableSlice* value);
   virtual Iterator* NewIterator(const ReadOptions&);
   virtual const Snapshot* GetSnapshot();
   virtual void ReleaseSnapshot(const Snapshot* snapshot);
+  virtual Status IngestExternalFile(const std::string& path);
+  virtual Status DeleteFilesInRange(const Slice& begin, const Slice& end);
   // 这么粗暴的接口? 为啥不提供个成员函数呢?
   virtual bool GetProperty(const Slice& property, uint64_t* value);
+  virtual bool GetProperty(const Slice& property, std::string* value);
   // 我觉得这个函数没啥意义吧?
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
 
@@ -61,8 +76,12 @@ class DBImpl : public DB {
  private:
   friend class DB;
 
+  // If "range_del" is non-NULL, also store in *range_del the range
+  // tombstones visible to the read, or NULL if there are none.  The
+  // caller owns the result.
   Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot);
+                                SequenceNumber* latest_snapshot,
+                                RangeDelAggregator** range_del);
 
   // 会创建并初始化 dbname 指定的数据库, dbname 原数据会全部丢失.
   Status NewDB();
@@ -95,19 +114,65 @@ class DBImpl : public DB {
 
   void MaybeIgnoreError(Status* s) const;
 
+  // Append the "leveldb.stats" report to *value.
+  // REQUIRES: mutex_ held
+  void AppendStats(std::string* value);
+
+  // Write the "leveldb.stats" report to the info log every
+  // options_.stats_dump_period_sec seconds until shutdown.
+  static void StatsDumpWork(void* db);
+  void StatsDumpLoop();
+
+  // Return the oldest log file whose contents have not been compacted
+  // yet: the log of imm_ if there is one, else the current log.
+  uint64_t LiveLogNumber() const {
+    return (imm_ != NULL) ? imm_log_number_ : log_number_;
+  }
+
   // Delete any unneeded files and stale in-memory entries.
   // 这里 stale in-memory entries 是指 table cache 中已经被持久化设备删除但是仍然存在于 table cache 中的项.
   void DeleteObsoleteFiles();
 
-  // Called when an iterator over a particular version of the
-  // descriptor goes away.
-  // Unref 会对 dbimpl mutex_ 加锁啊!
-  static void Unref(void* arg1, void* arg2);
-
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
-  // 严格地说, 这里并没有 write a new descriptor; 而是更新一个已经存在的 descriptor.
+  // The memtables and Version that make up the state a read sees.  A
+  // new SuperVersion is installed whenever mem_, imm_ or the current
+  // Version changes, so readers can pin all three at once without
+  // holding mutex_.  The ref on "current" also keeps "mem" and "imm"
+  // alive: a memtable is only deleted with a Version newer than the
+  // one it was read with, and versions are deleted in order.
+  struct SuperVersion {
+    MemTable* mem;
+    MemTable* imm;
+    Version* current;
+    int refs;         // Protected by sv_mutex_
+  };
+
+  // Replace super_version_ with one built from mem_, imm_ and the
+  // current Version.
+  // REQUIRES: mutex_ is held
+  void InstallSuperVersion();
+
+  // Return a referenced super_version_ and store the latest sequence
+  // number in *latest_snapshot.  Only takes sv_mutex_.
+  SuperVersion* AcquireSuperVersion(SequenceNumber* latest_snapshot);
+
+  // Drop a reference returned by AcquireSuperVersion().  Takes mutex_
+  // only if this was the last reference.
+  // REQUIRES: mutex_ is not held
+  void ReleaseSuperVersion(SuperVersion* sv);
+
+  // Shared by both Get()s.  The value goes to *value unless "pinned" is
+  // non-NULL and the value can be pinned there; see Version::Get().
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 std::string* value, PinnableSlice* pinned);
+
+  // Called when an iterator over a particular super version goes away.
+  static void CleanupSuperVersion(void* arg1, void* arg2);
+
+  // Compact the immutable memtable imm_ to a level-0 table and write
+  // a new descriptor that no longer refers to imm_'s log file iff
+  // successful.
   // CompactMemTable() 具体的操作流程可以参见实现.
+  // REQUIRES: mutex_ is held and imm_ != NULL
   Status CompactMemTable();
 
   // log file 中的 record 是 WriteBatch 序列化后的内容.
@@ -117,6 +182,7 @@ class DBImpl : public DB {
                         SequenceNumber* max_sequence);
 
   // 将 mem 写入 disk 中, 同时将对 server state 的更新记录在 edit 中.
+  // mutex_ is released while the table is being built.
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit);
 
   bool HasLargeValues(const WriteBatch& batch) const;
@@ -144,23 +210,110 @@ class DBImpl : public DB {
       std::string* scratch,
       LargeValueRef* ref);
 
+  // A Write() call waiting in writers_.  See DBImpl::Write().
+  struct Writer;
+
+  // Make sure there is room in mem_ for the front writer.  A full mem_
+  // becomes imm_ and is compacted in the background while writes go to
+  // a fresh memtable and log file.  Waits if the previous imm_ has not
+  // been compacted yet.  If "force" is true, mem_ is switched out even
+  // if it is not full.
+  // REQUIRES: mutex_ is held and this thread is at the front of writers_
+  Status MakeRoomForWrite(bool force);
+
+  // Return how long a write of "bytes" bytes should be delayed because
+  // level-0 or the pending compaction bytes passed a slowdown trigger,
+  // or 0 if it need not be delayed.
+  // REQUIRES: mutex_ is held
+  uint64_t WriteDelayMicros(size_t bytes);
+
+  // Copy the entries of the user-key table "table" into table file
+  // meta->number, giving each of them sequence number "seq".  Fills in
+  // the rest of *meta.
+  // REQUIRES: mutex_ is not held and meta->number is in pending_outputs_
+  Status CopyIngestedTable(Table* table, SequenceNumber seq,
+                           FileMetaData* meta);
+
+  // Sleep for WriteDelayMicros(bytes), releasing mutex_ meanwhile.
+  // Called by the leader of a write group with the size of everything
+  // the group commits, so that followers are charged for their batches.
+  // REQUIRES: mutex_ is held and this thread is at the front of writers_
+  void DelayWrite(size_t bytes);
+
+  // Merge the batches of writers_.front() and the writers queued behind
+  // it into a single batch.  *last_writer is set to the last writer whose
+  // batch was included.  The result is either the front writer's batch
+  // or tmp_batch_.
+  // REQUIRES: mutex_ is held and writers_ is not empty
+  WriteBatch* BuildBatchGroup(Writer** last_writer);
+
   struct CompactionState;
 
+  // Schedule a memtable compaction at Env::HIGH if imm_ is waiting, and
+  // a level compaction at Env::LOW if one is needed, so that a flush
+  // never queues behind a long running level compaction.
   void MaybeScheduleCompaction();
   static void BGWork(void* db);
   void BackgroundCall();
+  static void BGWorkFlush(void* db);
+  void BackgroundFlushCall();
   // 执行 compact 操作, background 表明 compact 是后台运行着的.
-  void BackgroundCompaction();
+  // Returns false if no compaction could be picked, e.g. because all
+  // candidates conflict with compactions that are already running.
+  bool BackgroundCompaction();
   void CleanupCompaction(CompactionState* compact);
   Status DoCompactionWork(CompactionState* compact);
 
+  // Merge the inputs of compact->compaction that fall in compact's key
+  // range and write them to new output files.  Runs with mutex_
+  // released; calls for disjoint key ranges may run concurrently.
+  Status DoSubcompactionWork(CompactionState* compact);
+
+  // Split "compact" at "boundaries" and run the pieces in parallel,
+  // collecting their outputs into "compact" in key order.
+  // REQUIRES: mutex_ is not held
+  Status RunSubcompactions(CompactionState* compact,
+                           const std::vector<std::string>& boundaries);
+  struct SubcompactionJob;
+  static void SubcompactionThread(void* arg);
+
+  // Replace the merge operands for "user_key" starting at the current
+  // entry of "input" with as few entries as possible: a single value
+  // when the value they apply to is known, else operands combined by
+  // MergeOperator::PartialMerge().  Leaves "input" past the run and the
+  // value or deletion ending it, whose sequence is stored in
+  // *last_sequence_for_key.
+  // REQUIRES: the current entry is a merge operand no snapshot can
+  // tell apart from older entries (sequence <= smallest_snapshot).
+  Status CompactMergeOperands(CompactionState* compact, Iterator* input,
+                              const Slice& user_key,
+                              SequenceNumber* last_sequence_for_key);
+
+  // Read the range tombstones of the compaction inputs into "compact".
+  // REQUIRES: mutex_ is not held
+  Status CollectRangeTombstones(CompactionState* compact);
+
+  // Add to the current output the pieces of the compaction's range
+  // tombstones below the user key "*upper", or all remaining pieces if
+  // "upper" is NULL, and widen the output's key range to cover them.
+  void AddOutputRangeTombstones(CompactionState* compact, const Slice* upper);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // "upper" is the user key the next output file starts at, or NULL
+  // if this is the last output.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* upper);
+
+  // Append "key"/"value" to the current output of "compact", finishing
+  // the output file first if it is full and opening a new one as needed.
+  Status AddCompactionOutput(CompactionState* compact, Iterator* input,
+                             const Slice& key, const Slice& value);
   Status InstallCompactionResults(CompactionState* compact);
 
   // Constant after construction
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
+  const InternalFilterPolicy internal_filter_policy_;
   const Options options_;  // options_.comparator == &internal_comparator_
   bool owns_info_log_;
   const std::string dbname_;
@@ -168,17 +321,31 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* table_cache_;
 
+  // Runs the pieces of split compactions, NULL unless max_subcompactions
+  // is above 1.  Provides its own synchronization.
+  ThreadPool* subcompaction_pool_;
+
   // Lock over the persistent DB state.  Non-NULL iff successfully acquired.
   FileLock* db_lock_;
 
+  // Guards super_version_, the refs of every SuperVersion and updates
+  // of last_sequence_.  Held only for a few instructions at a time so
+  // that readers do not queue behind writers and compactions on mutex_.
+  // Lock order: mutex_ before sv_mutex_.
+  port::Mutex sv_mutex_;
+  SuperVersion* super_version_;
+
   // State below is protected by mutex_
   port::Mutex mutex_;
   port::AtomicPointer shutting_down_;
-  port::CondVar bg_cv_;         // Signalled when !bg_compaction_scheduled_
-  port::CondVar compacting_cv_;  // Signalled when !compacting_
+  port::CondVar bg_cv_;         // Signalled when background work finishes
   // 本来我觉得这里的 last_sequence_ 是用来作为 sst table file name 的数字后缀呢, 后来发现不太可能是==
+  // Once the DB is open it is only modified with both mutex_ and
+  // sv_mutex_ held, so either one is enough to read it.
   SequenceNumber last_sequence_;
   MemTable* mem_;
+  MemTable* imm_;                // Memtable being compacted
+  uint64_t imm_log_number_;      // Log file holding imm_, 0 if imm_ == NULL
   // log_ 与 mem_ 对应, 任何一个 write batch 在应用到 mem 之前都会写入 log 中.
   WritableFile* logfile_;
   log::Writer* log_;
@@ -187,37 +354,26 @@ class DBImpl : public DB {
   uint64_t log_number_;
   SnapshotList snapshots_;
 
+  // Queue of writers.  The writer at the front is the only one allowed
+  // to append to log_ and insert into mem_, which it does with mutex_
+  // released on behalf of all the writers it has grouped together.
+  std::deque<Writer*> writers_;
+  WriteBatch* tmp_batch_;
+
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions. 其中存放的是 file number, 我本来以为是 file fd 呢==
   std::set<uint64_t> pending_outputs_;
 
-  /*
-   * 按我理解 leveldb 在 schedule bg compaction 之后将 bg_compaction_scheduled_ 置为 True.
-   * bg compaction 的实现可能如下:
-   *    func bg_compaction() {
-   *        mutex_.lock()
-   *        compacting_ = True;
-   *        mutex_.unlock()
-   *        do_compaction(); // 这个期间可能不会持有着锁.
-   *        mutex_.lock()
-   *        compacting_ = False;
-   *        mutex_.unlock()
-   *        bg_compaction_scheduled_ = False;
-   *    }
-   */
-  // Has a background compaction been scheduled or is running?
-  bool bg_compaction_scheduled_;
-
-  // Is there a compaction running?
-  /* 按我理解存在 bg_compaction_scheduled_ 为 false, 同时 compacting_ 为 true 的情况, 也即 compact 可能会
-   * 被自发地运行. 但是结合了对 DBImpl::~DBImpl 的注释理解之后, 我觉得 compacting_ 的更新总是按照如下的流程:
-   *    bg_compaction_scheduled_ = true;
-   *    compacting_ = true;
-   *    compacting_ = false;
-   *    bg_compaction_scheduled_ = false;
-   * 目测这个变量就是为了测试引入的, 因为我 grep 了一下正统代码里面没有使用过 compacting_.
-   */
-  bool compacting_;
+  // Number of background compactions scheduled or running.  At most
+  // options_.max_background_compactions.
+  int bg_compaction_scheduled_;
+
+  // Has a background memtable compaction been scheduled or is running?
+  bool bg_flush_scheduled_;
+
+  // Is a TEST_CompactRange() running?  No background compactions are
+  // scheduled meanwhile.
+  bool manual_compaction_;
 
   /* 任何时刻只要对 mutex_ 加锁成功, 那么当前 versions_->current() + mem_ 就存放着当前 leveldb 数据库的全部
    * 数据.
@@ -227,6 +383,40 @@ class DBImpl : public DB {
   // Have we encountered a background error in paranoid mode?
   Status bg_error_;
 
+  // Total time writes have spent delayed or waiting for compactions
+  uint64_t stall_micros_;
+
+  // Compaction traffic into each level.  Level-0 counts memtable
+  // compactions, whose input is not a table file.
+  struct CompactionStats {
+    int64_t micros;
+    int64_t bytes_read_nonoutput;   // From the level above
+    int64_t bytes_read_output;      // From the level itself
+    int64_t bytes_written;
+    int count;
+
+    CompactionStats()
+        : micros(0),
+          bytes_read_nonoutput(0),
+          bytes_read_output(0),
+          bytes_written(0),
+          count(0) {
+    }
+
+    void Add(const CompactionStats& c) {
+      micros += c.micros;
+      bytes_read_nonoutput += c.bytes_read_nonoutput;
+      bytes_read_output += c.bytes_read_output;
+      bytes_written += c.bytes_written;
+      count += c.count;
+    }
+  };
+  CompactionStats stats_[config::kNumLevels];
+  uint64_t user_bytes_written_;   // Size of all batches written
+
+  // Is the thread writing "leveldb.stats" to the info log running?
+  bool stats_dump_running_;
+
   // No copying allowed
   DBImpl(const DBImpl&);
   void operator=(const DBImpl&);
@@ -240,6 +430,7 @@ class DBImpl : public DB {
 // it is not equal to src.info_log.
 extern Options SanitizeOptions(const std::string& db,
                                const InternalKeyComparator* icmp,
+                               const InternalFilterPolicy* ipolicy,
                                const Options& src);
 
 }
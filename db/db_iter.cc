@@ -6,11 +6,14 @@
 
 #include "db/filename.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "include/env.h"
 #include "include/iterator.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/perf_context_imp.h"
+#include "util/statistics_imp.h"
 
 namespace leveldb {
 
@@ -40,10 +43,15 @@ namespace {
 class DBIter: public Iterator {
  public:
   DBIter(const std::string* dbname, Env* env,
-         const Comparator* cmp, Iterator* iter, SequenceNumber s)
+         const Comparator* cmp, const MergeOperator* merge_operator,
+         Statistics* statistics, RangeDelAggregator* range_del,
+         Iterator* iter, SequenceNumber s)
       : dbname_(dbname),
         env_(env),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
+        statistics_(statistics),
+        range_del_(range_del),
         iter_(iter),
         sequence_(s),
         large_(NULL),
@@ -52,6 +60,7 @@ class DBIter: public Iterator {
   virtual ~DBIter() {
     delete iter_;
     delete large_;
+    delete range_del_;
   }
   virtual bool Valid() const { return valid_; }
   virtual Slice key() const {
@@ -86,6 +95,7 @@ class DBIter: public Iterator {
   }
 
   virtual void Seek(const Slice& target) {
+    StopWatch sw(env_, statistics_, kSeekMicros);
     ParsedInternalKey ikey(target, sequence_, kValueTypeForSeek);
     std::string tmp;
     AppendInternalKey(&tmp, ikey);
@@ -121,8 +131,12 @@ class DBIter: public Iterator {
     value_.assign(v.data(), v.size());
   }
   bool ParseKey(ParsedInternalKey* key);
+  bool IsCovered(const ParsedInternalKey& key) {
+    return range_del_ != NULL && range_del_->ShouldDelete(key);
+  }
   void SkipPast(const Slice& k);
   void ScanUntilBeforeCurrentKey(bool* found_live);
+  bool MergeValuesForward();
 
   void ReadIndirectValue() const;
 
@@ -150,6 +164,9 @@ class DBIter: public Iterator {
   Env* const env_;
 
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
+  Statistics* const statistics_;
+  RangeDelAggregator* const range_del_;   // NULL if there are no tombstones
 
   // 不变量00: iter_ is positioned just past current entry for DBIter if valid_
   // 由 dbimpl NewInternalIterator() 分配.
@@ -203,12 +220,24 @@ void DBIter::FindNextUserEntry() {
     }
     if (ikey.sequence > sequence_) {
       // Ignore entries newer than the snapshot
+      PERF_COUNTER_ADD(internal_key_skipped_count, 1);
+      iter_->Next();
+      continue;
+    }
+
+    if (IsCovered(ikey)) {
+      // Deleted by a range tombstone, and so are the older entries
+      PERF_COUNTER_ADD(internal_delete_skipped_count, 1);
+      SaveKey(ikey.user_key);
       iter_->Next();
+      SkipPast(key_);
       continue;
     }
 
     switch (ikey.type) {
       case kTypeDeletion:
+      case kTypeRangeDeletion:
+        PERF_COUNTER_ADD(internal_delete_skipped_count, 1);
         SaveKey(ikey.user_key);  // Make local copy for use by SkipPast()
         iter_->Next();
         SkipPast(key_);
@@ -236,6 +265,18 @@ void DBIter::FindNextUserEntry() {
         // Yield the value we just found.
         valid_ = true;
         return;
+
+      case kTypeMerge:
+        SaveKey(ikey.user_key);
+        if (!MergeValuesForward()) {
+          // status_ holds the error; stop iterating
+          valid_ = false;
+          key_.clear();
+          value_.clear();
+          return;
+        }
+        valid_ = true;
+        return;
     }
   }
   valid_ = false;
@@ -258,6 +299,7 @@ void DBIter::SkipPast(const Slice& k) {
     if (ParseKey(&ikey) && user_comparator_->Compare(ikey.user_key, k) != 0) {
       break;
     }
+    PERF_COUNTER_ADD(internal_key_skipped_count, 1);
     iter_->Next();
   }
 }
@@ -378,12 +420,14 @@ void DBIter::ScanUntilBeforeCurrentKey(bool* found_live) {
     } else if (cmp == 0) {
       switch (current.type) {
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           *found_live = false;
           break;
 
         case kTypeValue:
         case kTypeLargeValueRef:
-          *found_live = true;
+        case kTypeMerge:
+          *found_live = !IsCovered(current);
           break;
       }
     } else {  // cmp > 0
@@ -395,32 +439,111 @@ void DBIter::ScanUntilBeforeCurrentKey(bool* found_live) {
   }
 }
 
+// iter_ is positioned at a merge operand for key_.  Collect it and the
+// older entries for key_ up to the first value or deletion, combine
+// them into value_ and leave iter_ past key_.  Returns false and sets
+// status_ if the operands cannot be combined.
+bool DBIter::MergeValuesForward() {
+  std::vector<std::string> operands;  // Newest first
+  operands.push_back(iter_->value().ToString());
+  iter_->Next();
+  std::string existing;
+  bool has_existing = false;
+  Status s;
+  while (iter_->Valid()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      iter_->Next();
+      continue;
+    }
+    if (user_comparator_->Compare(ikey.user_key, key_) != 0) {
+      break;
+    }
+    if (IsCovered(ikey)) {
+      break;  // Deleted by a range tombstone, as is everything older
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(iter_->value().ToString());
+      iter_->Next();
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      existing = iter_->value().ToString();
+      has_existing = true;
+    } else if (ikey.type == kTypeLargeValueRef) {
+      s = ReadLargeValue(env_, *dbname_, iter_->value(), &existing);
+      has_existing = true;
+    }
+    iter_->Next();
+    break;
+  }
+  SkipPast(key_);
+
+  if (s.ok()) {
+    Slice existing_slice(existing);
+    s = ApplyMergeOperands(merge_operator_, key_,
+                           has_existing ? &existing_slice : NULL,
+                           operands, &value_);
+  }
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  return true;
+}
+
 void DBIter::ReadIndirectValue() const {
   assert(!large_->produced);
   large_->produced = true;
+  Status s = ReadLargeValue(env_, *dbname_, value_, &large_->value);
+  if (!s.ok()) {
+    large_->value.clear();
+    large_->status = s;
+  }
+}
+
+}  // anonymous namespace
+
+Iterator* NewDBIterator(
+    const std::string* dbname,
+    Env* env,
+    const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
+    Statistics* statistics,
+    RangeDelAggregator* range_del,
+    Iterator* internal_iter,
+    const SequenceNumber& sequence) {
+  return new DBIter(dbname, env, user_key_comparator, merge_operator,
+                    statistics, range_del, internal_iter, sequence);
+}
+
+Status ReadLargeValue(Env* env,
+                      const std::string& dbname,
+                      const Slice& ref,
+                      std::string* value) {
   LargeValueRef large_ref;
-  if (value_.size() != LargeValueRef::ByteSize()) {
-    large_->status = Status::Corruption("malformed large value reference");
-    return;
+  if (ref.size() != LargeValueRef::ByteSize()) {
+    return Status::Corruption("malformed large value reference");
   }
-  memcpy(large_ref.data, value_.data(), LargeValueRef::ByteSize());
-  std::string fname = LargeValueFileName(*dbname_, large_ref);
+  memcpy(large_ref.data, ref.data(), LargeValueRef::ByteSize());
+  std::string fname = LargeValueFileName(dbname, large_ref);
   // 为啥不使用 ReadFileToString() 来读取呢?
   RandomAccessFile* file;
-  Status s = env_->NewRandomAccessFile(fname, &file);
+  Status s = env->NewRandomAccessFile(fname, &file);
   if (s.ok()) {
     uint64_t file_size = file->Size();
     uint64_t value_size = large_ref.ValueSize();
-    large_->value.resize(value_size);
+    std::string contents;
+    contents.resize(value_size);
     Slice result;
     s = file->Read(0, file_size, &result,
-                   const_cast<char*>(large_->value.data()));
+                   const_cast<char*>(contents.data()));
     if (s.ok()) {
       if (result.size() == file_size) {
         switch (large_ref.compression_type()) {
           case kNoCompression: {
-            if (result.data() != large_->value.data()) {
-              large_->value.assign(result.data(), result.size());
+            if (result.data() != contents.data()) {
+              contents.assign(result.data(), result.size());
             }
             break;
           }
@@ -429,7 +552,7 @@ void DBIter::ReadIndirectValue() const {
             if (port::Lightweight_Uncompress(result.data(), result.size(),
                                        &uncompressed) &&
                 uncompressed.size() == large_ref.ValueSize()) {
-              swap(uncompressed, large_->value);
+              swap(uncompressed, contents);
             } else {
               s = Status::Corruption(
                   "Unable to read entire compressed large value file");
@@ -442,22 +565,11 @@ void DBIter::ReadIndirectValue() const {
       }
     }
     delete file;        // Ignore errors on closing
+    if (s.ok()) {
+      swap(contents, *value);
+    }
   }
-  if (!s.ok()) {
-    large_->value.clear();
-    large_->status = s;
-  }
-}
-
-}  // anonymous namespace
-
-Iterator* NewDBIterator(
-    const std::string* dbname,
-    Env* env,
-    const Comparator* user_key_comparator,
-    Iterator* internal_iter,
-    const SequenceNumber& sequence) {
-  return new DBIter(dbname, env, user_key_comparator, internal_iter, sequence);
+  return s;
 }
 
 }
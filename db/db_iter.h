@@ -11,16 +11,33 @@
 
 namespace leveldb {
 
+class RangeDelAggregator;
+class Statistics;
+
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are combined with
+// "merge_operator" (which may be NULL if the DB holds none).  Entries
+// deleted by a tombstone of "range_del" are skipped; the iterator takes
+// ownership of "range_del", which may be NULL.  Seek() latencies are
+// recorded in "statistics" unless it is NULL.
 extern Iterator* NewDBIterator(
     const std::string* dbname,
     Env* env,
     const Comparator* user_key_comparator,
+    const MergeOperator* merge_operator,
+    Statistics* statistics,
+    RangeDelAggregator* range_del,
     Iterator* internal_iter,
     const SequenceNumber& sequence);
 
+// Read the contents of the large value file referenced by "ref" in
+// database "dbname" into *value.
+extern Status ReadLargeValue(Env* env,
+                             const std::string& dbname,
+                             const Slice& ref,
+                             std::string* value);
+
 }
 
 #endif  // STORAGE_LEVELDB_DB_DB_ITER_H_
@@ -4,13 +4,21 @@
 
 #include "include/db.h"
 
+#include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "include/cache.h"
 #include "include/env.h"
+#include "include/filter_policy.h"
+#include "include/merge_operator.h"
+#include "include/perf_context.h"
+#include "include/statistics.h"
 #include "include/table.h"
+#include "include/table_builder.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
 
@@ -129,6 +137,12 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
           }
         }
         iter->Next();
@@ -142,6 +156,42 @@ class DBTest {
     return result;
   }
 
+  // Return "k=v" for every live key, in order.  Walks the keys backward
+  // too and reports a mismatch.
+  std::string Contents(const Snapshot* snapshot = NULL) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    Iterator* iter = db_->NewIterator(options);
+    std::vector<std::string> forward;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      forward.push_back(iter->key().ToString() + "=" +
+                        iter->value().ToString());
+    }
+    size_t matched = 0;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      const std::string s = iter->key().ToString() + "=" +
+                            iter->value().ToString();
+      if (matched >= forward.size() ||
+          s != forward[forward.size() - 1 - matched]) {
+        break;
+      }
+      matched++;
+    }
+    std::string result;
+    if (!iter->status().ok()) {
+      result = iter->status().ToString();
+    } else if (matched != forward.size() || iter->Valid()) {
+      result = "BACKWARD_MISMATCH";
+    } else {
+      for (size_t i = 0; i < forward.size(); i++) {
+        if (i > 0) result += ",";
+        result += forward[i];
+      }
+    }
+    delete iter;
+    return result;
+  }
+
   int NumTableFilesAtLevel(int level) {
     uint64_t val;
     ASSERT_TRUE(
@@ -201,6 +251,55 @@ TEST(DBTest, PutDeleteGet) {
   ASSERT_EQ("NOT_FOUND", Get("foo"));
 }
 
+TEST(DBTest, GetFromVersions) {
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("v1", Get("foo"));
+}
+
+TEST(DBTest, GetLevel0Ordering) {
+  // Check that we process level-0 files in correct order.  The code
+  // below generates two level-0 files where the earlier one comes
+  // before the later one in the level-0 file list since the earlier
+  // one has a smaller "smallest" key.
+  ASSERT_OK(Put("bar", "b"));
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(0), 2);
+  ASSERT_EQ("v2", Get("foo"));
+}
+
+TEST(DBTest, GetOrderedByLevels) {
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "a", "z");
+  ASSERT_GT(NumTableFilesAtLevel(1), 0);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_OK(db_->Delete(WriteOptions(), "foo"));
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("NOT_FOUND", Get("zzz"));
+}
+
+TEST(DBTest, GetSnapshotFromFiles) {
+  ASSERT_OK(Put("foo", "v1"));
+  const Snapshot* s1 = db_->GetSnapshot();
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "a", "z");
+  ASSERT_EQ("v1", Get("foo", s1));
+  ASSERT_EQ("v2", Get("foo"));
+  db_->ReleaseSnapshot(s1);
+}
+
 TEST(DBTest, Recover) {
   ASSERT_OK(Put("foo", "v1"));
   ASSERT_OK(Put("baz", "v5"));
@@ -231,6 +330,71 @@ TEST(DBTest, RecoveryWithEmptyLog) {
   ASSERT_EQ("v3", Get("foo"));
 }
 
+// Env whose table file syncs can be made slow, so that a memtable
+// compaction is still in progress when the DB is closed.
+class SlowTableSyncEnv : public EnvWrapper {
+ public:
+  port::AtomicPointer delay_sstable_sync_;
+
+  explicit SlowTableSyncEnv(Env* base) : EnvWrapper(base) {
+    delay_sstable_sync_.Release_Store(NULL);
+  }
+
+  Status NewWritableFile(const std::string& f, WritableFile** r) {
+    class SSTableFile : public WritableFile {
+     private:
+      SlowTableSyncEnv* env_;
+      WritableFile* base_;
+
+     public:
+      SSTableFile(SlowTableSyncEnv* env, WritableFile* base)
+          : env_(env), base_(base) { }
+      ~SSTableFile() { delete base_; }
+      Status Append(const Slice& data) { return base_->Append(data); }
+      Status Close() { return base_->Close(); }
+      Status Flush() { return base_->Flush(); }
+      Status Sync() {
+        if (env_->delay_sstable_sync_.Acquire_Load() != NULL) {
+          env_->SleepForMicroseconds(1000000);
+        }
+        return base_->Sync();
+      }
+    };
+
+    Status s = target()->NewWritableFile(f, r);
+    if (s.ok() && strstr(f.c_str(), ".sst") != NULL) {
+      *r = new SSTableFile(this, *r);
+    }
+    return s;
+  }
+};
+
+TEST(DBTest, RecoverDuringMemtableCompaction) {
+  SlowTableSyncEnv env(Env::Default());
+  Options options;
+  options.env = &env;
+  options.write_buffer_size = 1000000;
+  options.large_value_threshold = 1 << 30;
+  Reopen(&options);
+
+  // Trigger a long memtable compaction and reopen the database during it
+  ASSERT_OK(Put("foo", "v1"));                          // Goes to 1st log file
+  ASSERT_OK(Put("big1", std::string(2000000, 'x')));    // Fills memtable
+  env.delay_sstable_sync_.Release_Store(&env);
+  ASSERT_OK(Put("big2", std::string(1000, 'y')));       // Triggers compaction
+  ASSERT_OK(Put("bar", "v2"));                          // Goes to new log file
+
+  Reopen(&options);
+  env.delay_sstable_sync_.Release_Store(NULL);
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ(std::string(2000000, 'x'), Get("big1"));
+  ASSERT_EQ(std::string(1000, 'y'), Get("big2"));
+
+  // Close before "env" goes away.
+  DestroyAndReopen();
+}
+
 static std::string Key(int i) {
   char buf[100];
   snprintf(buf, sizeof(buf), "key%06d", i);
@@ -535,6 +699,401 @@ TEST(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
+// Treats values as decimal counters that merge operands are added to.
+// The operand "bad" cannot be applied.
+class AddOperator : public MergeOperator {
+ public:
+  virtual const char* Name() const { return "leveldb.test.AddOperator"; }
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const {
+    uint64_t sum = 0;
+    if (existing_value != NULL) {
+      sum = Parse(*existing_value);
+    }
+    for (size_t i = 0; i < operands.size(); i++) {
+      if (operands[i] == "bad") return false;
+      sum += Parse(operands[i]);
+    }
+    *new_value = NumberToString(sum);
+    return true;
+  }
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value) const {
+    if (left_operand == "bad" || right_operand == "bad") return false;
+    *new_value = NumberToString(Parse(left_operand) + Parse(right_operand));
+    return true;
+  }
+
+ private:
+  static uint64_t Parse(const Slice& s) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+      v = v * 10 + (s[i] - '0');
+    }
+    return v;
+  }
+};
+
+TEST(DBTest, MergeRequiresOperator) {
+  Status s = db_->Merge(WriteOptions(), "foo", "1");
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("Invalid argument") != std::string::npos);
+}
+
+TEST(DBTest, MergeGet) {
+  AddOperator add;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  // Operands without a base value
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_EQ("3", Get("a"));
+
+  // Operands on top of a value and a deletion
+  ASSERT_OK(Put("b", "10"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "5"));
+  ASSERT_EQ("15", Get("b"));
+  ASSERT_OK(Delete("b"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "7"));
+  ASSERT_EQ("7", Get("b"));
+
+  // Operands spread over the memtable and several files
+  ASSERT_OK(Put("c", "100"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "10"));
+  ASSERT_EQ("113", Get("c"));
+  ASSERT_EQ("103", Get("c", snapshot));
+  ASSERT_EQ("7", Get("b"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Survives recovery from the log
+  Reopen(&options);
+  ASSERT_EQ("3", Get("a"));
+  ASSERT_EQ("113", Get("c"));
+
+  // A rejected operand surfaces as a read error
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "bad"));
+  ASSERT_TRUE(Get("a").find("Corruption") != std::string::npos);
+}
+
+TEST(DBTest, MergeIterator) {
+  AddOperator add;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "3"));
+  ASSERT_OK(Put("c", "4"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "5"));
+  ASSERT_OK(Delete("d"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "6"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  std::string forward;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+  }
+  ASSERT_EQ("a=1 b=5 c=9 d=6 ", forward);
+  std::string backward;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    backward += iter->key().ToString() + "=" + iter->value().ToString() + " ";
+  }
+  ASSERT_EQ("d=6 c=9 b=5 a=1 ", backward);
+  iter->Seek("bb");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("c", iter->key().ToString());
+  ASSERT_EQ("9", iter->value().ToString());
+  iter->Prev();
+  ASSERT_EQ("b", iter->key().ToString());
+  ASSERT_EQ("5", iter->value().ToString());
+  ASSERT_OK(iter->status());
+  delete iter;
+}
+
+TEST(DBTest, MergeCompaction) {
+  AddOperator add;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "", "z");
+  dbfull()->TEST_CompactRange(1, "", "z");
+  ASSERT_EQ(NumTableFilesAtLevel(2), 1);   // foo => 1 is now in level 2 file
+
+  ASSERT_OK(db_->Merge(WriteOptions(), "foo", "2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "foo", "3"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "foo", "4"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(4), MERGE(3), MERGE(2), 1 ]");
+
+  // Operands older than the snapshot are combined, but the value they
+  // apply to is in a level not being compacted.
+  dbfull()->TEST_CompactRange(0, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE(4), MERGE(5), 1 ]");
+  ASSERT_EQ("6", Get("foo", snapshot));
+  ASSERT_EQ("10", Get("foo"));
+
+  // Once the snapshot is gone everything collapses into one value
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(1, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ 10 ]");
+  ASSERT_EQ("10", Get("foo"));
+
+  // Operands on top of a deletion at the base level need no value
+  ASSERT_OK(Delete("foo"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "foo", "7"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ 7, 10 ]");
+  dbfull()->TEST_CompactRange(1, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ 7 ]");
+  ASSERT_EQ("7", Get("foo"));
+}
+
+TEST(DBTest, DeleteFilesInRange) {
+  // Three level-0 files with disjoint key ranges
+  ASSERT_OK(Put("a1", "va1"));
+  ASSERT_OK(Put("a2", "va2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("b1", "vb1"));
+  ASSERT_OK(Put("b2", "vb2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("c1", "vc1"));
+  ASSERT_OK(Put("c2", "vc2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("b3", "vb3"));  // Stays in the memtable
+  ASSERT_EQ(3, NumTableFilesAtLevel(0));
+
+  // The "c" file straddles the end of the range
+  ASSERT_OK(db_->DeleteFilesInRange("b", "c1"));
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+  ASSERT_EQ("va1", Get("a1"));
+  ASSERT_EQ("NOT_FOUND", Get("b1"));
+  ASSERT_EQ("NOT_FOUND", Get("b2"));
+  ASSERT_EQ("vb3", Get("b3"));
+  ASSERT_EQ("vc1", Get("c1"));
+
+  // Nothing to do
+  ASSERT_OK(db_->DeleteFilesInRange("b", "b9"));
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+
+  // Files pushed to other levels are dropped too, and stay dropped
+  dbfull()->TEST_CompactRange(0, "", "z");
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_OK(db_->DeleteFilesInRange("a", "z"));
+  ASSERT_EQ(0, NumTableFilesAtLevel(1));
+  Reopen();
+  ASSERT_EQ("NOT_FOUND", Get("a1"));
+  ASSERT_EQ("NOT_FOUND", Get("c2"));
+  ASSERT_EQ("vb3", Get("b3"));
+}
+
+TEST(DBTest, DeleteRange) {
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(Put("d", "vd"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+  ASSERT_OK(Put("c", "vc2"));   // Newer than the tombstone
+
+  // Same answers from the memtable, the log, level-0 and deeper levels
+  for (int i = 0; i < 4; i++) {
+    if (i == 1) {
+      Reopen();
+    } else if (i == 2) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      ASSERT_EQ(NumTableFilesAtLevel(0), 1);
+    } else if (i == 3) {
+      dbfull()->TEST_CompactRange(0, "", "z");
+      ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+    }
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("a=va,c=vc2,d=vd", Contents());
+    if (i == 0) {
+      // Reopen() drops the snapshot
+      ASSERT_EQ("vb", Get("b", snapshot));
+      ASSERT_EQ("a=va,b=vb,c=vc,d=vd", Contents(snapshot));
+      db_->ReleaseSnapshot(snapshot);
+    }
+  }
+
+  // A memtable holding nothing but a tombstone still makes a table
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "c", "z"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(NumTableFilesAtLevel(0), 1);
+  ASSERT_EQ("NOT_FOUND", Get("c"));
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+  ASSERT_EQ("a=va", Contents());
+
+  // Empty and reversed ranges delete nothing
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "a"));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "a"));
+  ASSERT_EQ("a=va", Contents());
+}
+
+TEST(DBTest, DeleteRangeOverlappingAtSnapshots) {
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("c", "v1"));
+  ASSERT_OK(Put("d", "v1"));
+  ASSERT_OK(Put("e", "v1"));
+  const Snapshot* s1 = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "e"));
+  ASSERT_OK(Put("c", "v2"));
+  const Snapshot* s2 = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "d"));
+
+  // Same answers from the memtable and from a table
+  for (int i = 0; i < 2; i++) {
+    if (i == 1) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+    ASSERT_EQ("v1", Get("c", s1));
+    ASSERT_EQ("v2", Get("c", s2));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("v1", Get("d", s1));
+    ASSERT_EQ("NOT_FOUND", Get("d", s2));
+    ASSERT_EQ("v1", Get("a", s2));
+    ASSERT_EQ("NOT_FOUND", Get("a"));
+    ASSERT_EQ("v1", Get("e"));
+  }
+  db_->ReleaseSnapshot(s1);
+  db_->ReleaseSnapshot(s2);
+}
+
+TEST(DBTest, DeleteRangeWithMerge) {
+  AddOperator add;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &add;
+  Reopen(&options);
+
+  ASSERT_OK(Put("foo", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "foo", "2"));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "f", "g"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "foo", "4"));
+  // The operand after the tombstone applies to no value
+  ASSERT_EQ("4", Get("foo"));
+  ASSERT_EQ("foo=4", Contents());
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("4", Get("foo"));
+  dbfull()->TEST_CompactRange(0, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ 4 ]");
+  ASSERT_EQ("4", Get("foo"));
+}
+
+TEST(DBTest, DeleteRangeCompaction) {
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "", "z");
+  dbfull()->TEST_CompactRange(1, "", "z");
+  dbfull()->TEST_CompactRange(2, "", "z");
+  ASSERT_EQ(NumTableFilesAtLevel(3), 1);   // foo => v1 is now in level 3 file
+
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_OK(Put("foo", "v3"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "a", "g"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v3, v1 ]");
+
+  // The snapshot still needs the deleted entries
+  dbfull()->TEST_CompactRange(0, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v3, v1 ]");
+  ASSERT_EQ("v3", Get("foo", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("bar"));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Covered entries of the inputs are dropped, but level-3 still has v1
+  // so the tombstone is kept.
+  dbfull()->TEST_CompactRange(1, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v1 ]");
+  ASSERT_EQ(AllEntriesFor("bar"), "[ ]");
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("", Contents());
+
+  // Merging L2 w/ L3 drops v1 and then the tombstone
+  dbfull()->TEST_CompactRange(2, "", "z");
+  ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("", Contents());
+  ASSERT_OK(Put("foo", "v4"));
+  ASSERT_EQ("v4", Get("foo"));
+}
+
+TEST(DBTest, DeleteRangeAcrossOutputFiles) {
+  Options options;
+  options.create_if_missing = true;
+  options.write_buffer_size = 100000000;        // Large write buffer
+  options.large_value_threshold = 1048576;
+  DestroyAndReopen(&options);
+
+  // A level-1 file for the level-0 file to be merged with, rather than
+  // just moved down
+  ASSERT_OK(Put(Key(0), "old"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "", Key(100000));
+  ASSERT_EQ(NumTableFilesAtLevel(1), 1);
+
+  // Write 8MB (80 values, each 100K) and delete most of it while a
+  // snapshot keeps the deleted values in the compaction outputs.
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 80; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(10), Key(70)));
+  ASSERT_OK(Put(Key(40), "new"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Every output file gets the piece of the tombstone it needs
+  dbfull()->TEST_CompactRange(0, "", Key(100000));
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_GT(NumTableFilesAtLevel(1), 1);
+  for (int i = 0; i < 80; i++) {
+    std::string expected = (i >= 10 && i < 70) ? "NOT_FOUND" : values[i];
+    if (i == 40) expected = "new";
+    ASSERT_EQ(expected, Get(Key(i)));
+    ASSERT_EQ(values[i], Get(Key(i), snapshot));
+  }
+
+  // Without the snapshot, the deleted values and the tombstone go away
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(1, "", Key(100000));
+  ASSERT_EQ(NumTableFilesAtLevel(1), 0);
+  for (int i = 0; i < 80; i++) {
+    std::string expected = (i >= 10 && i < 70) ? "NOT_FOUND" : values[i];
+    if (i == 40) expected = "new";
+    ASSERT_EQ(expected, Get(Key(i)));
+  }
+  ASSERT_TRUE(Between(Size("", Key(100000)), 2000000, 2200000));
+}
+
 TEST(DBTest, ComparatorCheck) {
   class NewComparator : public Comparator {
    public:
@@ -693,6 +1252,552 @@ TEST(DBTest, LargeValues3) {
 }
 
 
+// Multi-threaded test:
+static const int kNumThreads = 4;
+static const int kNumWritesPerThread = 500;
+
+struct MTState {
+  DBTest* test;
+  port::AtomicPointer thread_done[kNumThreads];
+};
+
+struct MTThread {
+  MTState* state;
+  int id;
+};
+
+static void MTThreadBody(void* arg) {
+  MTThread* t = reinterpret_cast<MTThread*>(arg);
+  DB* db = t->state->test->db_;
+  char key[100], valbuf[100];
+  for (int i = 0; i < kNumWritesPerThread; i++) {
+    snprintf(key, sizeof(key), "%d.%d", t->id, i);
+    snprintf(valbuf, sizeof(valbuf), "%d.%d.%s", t->id, i,
+             std::string(i % 50, 'x').c_str());
+    WriteBatch batch;
+    batch.Put(key, valbuf);
+    batch.Put("last." + NumberToString(t->id), NumberToString(i));
+    WriteOptions options;
+    options.sync = (i % 10 == 0);
+    const Snapshot* snapshot = NULL;
+    options.post_write_snapshot = &snapshot;
+    ASSERT_OK(db->Write(options, &batch));
+
+    // The post-write snapshot must see this thread's own write.
+    ASSERT_TRUE(snapshot != NULL);
+    ReadOptions ropts;
+    ropts.snapshot = snapshot;
+    std::string value;
+    ASSERT_OK(db->Get(ropts, key, &value));
+    ASSERT_EQ(valbuf, value);
+    db->ReleaseSnapshot(snapshot);
+  }
+  t->state->thread_done[t->id].Release_Store(t);
+}
+
+static void RunConcurrentWriters(DBTest* test) {
+  // Initialize state
+  MTState mt;
+  mt.test = test;
+  for (int id = 0; id < kNumThreads; id++) {
+    mt.thread_done[id].Release_Store(NULL);
+  }
+
+  // Start threads
+  MTThread thread[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    thread[id].state = &mt;
+    thread[id].id = id;
+    test->env_->StartThread(MTThreadBody, &thread[id]);
+  }
+
+  // Wait for threads to finish
+  for (int id = 0; id < kNumThreads; id++) {
+    while (mt.thread_done[id].Acquire_Load() == NULL) {
+      test->env_->SleepForMicroseconds(100000);
+    }
+  }
+
+  // Every write of every thread must be visible, in order.
+  char key[100], valbuf[100];
+  for (int id = 0; id < kNumThreads; id++) {
+    ASSERT_EQ(NumberToString(kNumWritesPerThread - 1),
+              test->Get("last." + NumberToString(id)));
+    for (int i = 0; i < kNumWritesPerThread; i++) {
+      snprintf(key, sizeof(key), "%d.%d", id, i);
+      snprintf(valbuf, sizeof(valbuf), "%d.%d.%s", id, i,
+               std::string(i % 50, 'x').c_str());
+      ASSERT_EQ(valbuf, test->Get(key));
+    }
+  }
+
+  // And survive a reopen.
+  test->Reopen(&test->last_options_);
+  ASSERT_EQ(NumberToString(kNumWritesPerThread - 1),
+            test->Get("last." + NumberToString(kNumThreads - 1)));
+}
+
+TEST(DBTest, ConcurrentWriters) {
+  RunConcurrentWriters(this);
+}
+
+TEST(DBTest, ConcurrentMemtableWriters) {
+  Options options;
+  options.write_buffer_size = 100000;  // Switch memtables along the way
+  options.allow_concurrent_memtable_write = true;
+  Reopen(&options);
+  RunConcurrentWriters(this);
+}
+
+// Occupies a background thread until the pointed-to AtomicPointer
+// becomes non-NULL.
+static void BlockBackgroundThread(void* arg) {
+  port::AtomicPointer* release = reinterpret_cast<port::AtomicPointer*>(arg);
+  while (release->Acquire_Load() == NULL) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+}
+
+static const int kSlowWriters = 4;
+
+struct SlowWriterState {
+  DB* db;
+  const std::string* value;
+  port::Mutex mu;
+  int remaining;
+  Status status;
+};
+
+static void SlowWriterBody(void* arg) {
+  SlowWriterState* state = reinterpret_cast<SlowWriterState*>(arg);
+  Status s;
+  for (int i = 0; i < 5 && s.ok(); i++) {
+    s = state->db->Put(WriteOptions(), "w" + NumberToString(i), *state->value);
+  }
+  MutexLock l(&state->mu);
+  if (!s.ok()) state->status = s;
+  state->remaining--;
+}
+
+TEST(DBTest, WriteSlowdown) {
+  Options options;
+  options.create_if_missing = true;
+  options.level0_slowdown_writes_trigger = 4;
+  options.level0_stop_writes_trigger = 8;
+  options.delayed_write_rate = 1 << 20;  // 1MB/s
+  DestroyAndReopen(&options);
+
+  // Keep level compactions, which run in the LOW pool, from draining
+  // level-0 during the test.  Memtable compactions run in the HIGH pool.
+  port::AtomicPointer release(NULL);
+  env_->Schedule(&BlockBackgroundThread, &release, Env::LOW);
+
+  const std::string big(10000, 'x');
+  uint64_t stall;
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(Put(Key(i), big));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(4, NumTableFilesAtLevel(0));
+  ASSERT_TRUE(db_->GetProperty("leveldb.stall-micros", &stall));
+  ASSERT_EQ(0, stall);
+
+  // Four level-0 files reach the slowdown trigger, so every write is
+  // now delayed.
+  const uint64_t start = env_->NowMicros();
+  ASSERT_OK(Put("c", big));
+  const uint64_t elapsed = env_->NowMicros() - start;
+  ASSERT_TRUE(db_->GetProperty("leveldb.stall-micros", &stall));
+  ASSERT_GE(stall, 9000);    // ~10KB at 1MB/s
+  ASSERT_GE(elapsed, stall);
+  ASSERT_EQ(big, Get("c"));
+
+  // Writes merged into another writer's group are charged for too.
+  SlowWriterState writers;
+  writers.db = db_;
+  writers.value = &big;
+  writers.remaining = kSlowWriters;
+  const uint64_t stall_before = stall;
+  for (int i = 0; i < kSlowWriters; i++) {
+    env_->StartThread(&SlowWriterBody, &writers);
+  }
+  while (true) {
+    MutexLock l(&writers.mu);
+    if (writers.remaining == 0) break;
+    writers.mu.Unlock();
+    env_->SleepForMicroseconds(10000);
+    writers.mu.Lock();
+  }
+  ASSERT_TRUE(writers.status.ok());
+  ASSERT_TRUE(db_->GetProperty("leveldb.stall-micros", &stall));
+  // kSlowWriters * 5 writes of ~10KB each at 1MB/s
+  ASSERT_GE(stall - stall_before, kSlowWriters * 5 * 9000);
+  release.Release_Store(&release);
+}
+
+TEST(DBTest, LowStopTriggerDoesNotHang) {
+  // A stop trigger below the level-0 compaction trigger is raised to it;
+  // otherwise the writes below would wait forever.
+  Options options;
+  options.create_if_missing = true;
+  options.write_buffer_size = 100000;
+  options.level0_slowdown_writes_trigger = 1;
+  options.level0_stop_writes_trigger = 1;
+  DestroyAndReopen(&options);
+
+  Random rnd(301);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_OK(Put(Key(i % 50), RandomString(&rnd, 10000)));
+  }
+}
+
+// Write a table holding "key<i>" => "<prefix><i>" for every i in
+// [first,last] with a TableBuilder, the way a bulk loader would.
+static void BuildExternalTable(Env* env, const std::string& fname,
+                               const Options& options,
+                               int first, int last, const std::string& prefix) {
+  WritableFile* file;
+  ASSERT_OK(env->NewWritableFile(fname, &file));
+  TableBuilder builder(options, file);
+  for (int i = first; i <= last; i++) {
+    builder.Add(Key(i), prefix + NumberToString(i));
+  }
+  ASSERT_OK(builder.Finish());
+  ASSERT_OK(file->Close());
+  delete file;
+}
+
+TEST(DBTest, IngestExternalFile) {
+  const std::string fname = dbname_ + "_external.sst";
+  ASSERT_OK(Put(Key(5), "old"));
+  ASSERT_OK(Put(Key(500), "outside"));
+  const Snapshot* before = db_->GetSnapshot();
+
+  BuildExternalTable(env_, fname, Options(), 0, 99, "ext");
+  ASSERT_OK(db_->IngestExternalFile(fname));
+  ASSERT_TRUE(env_->FileExists(fname));
+
+  // The file shadows older data, even from the memtable, but not for
+  // snapshots taken before it was ingested.
+  ASSERT_EQ("ext5", Get(Key(5)));
+  ASSERT_EQ("ext99", Get(Key(99)));
+  ASSERT_EQ("outside", Get(Key(500)));
+  ASSERT_EQ("old", Get(Key(5), before));
+  ASSERT_EQ("NOT_FOUND", Get(Key(6), before));
+  db_->ReleaseSnapshot(before);
+
+  // Later writes shadow the file
+  ASSERT_OK(Put(Key(7), "new"));
+  ASSERT_EQ("new", Get(Key(7)));
+
+  // A range nothing overlaps goes to the last level
+  BuildExternalTable(env_, fname, Options(), 1000, 1099, "far");
+  ASSERT_OK(db_->IngestExternalFile(fname));
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+
+  Reopen();
+  ASSERT_EQ("ext5", Get(Key(5)));
+  ASSERT_EQ("new", Get(Key(7)));
+  ASSERT_EQ("far1050", Get(Key(1050)));
+  ASSERT_OK(Put(Key(8), "after-reopen"));
+  ASSERT_EQ("after-reopen", Get(Key(8)));
+  env_->DeleteFile(fname);
+}
+
+TEST(DBTest, IngestExternalFileRejectsBadInput) {
+  const std::string fname = dbname_ + "_external.sst";
+
+  // No entries
+  BuildExternalTable(env_, fname, Options(), 1, 0, "");
+  Status s = db_->IngestExternalFile(fname);
+  ASSERT_TRUE(!s.ok());
+
+  // Sorted by some other comparator
+  class ReverseComparator : public Comparator {
+   public:
+    virtual const char* Name() const { return "leveldb.ReverseComparator"; }
+    virtual int Compare(const Slice& a, const Slice& b) const {
+      return -BytewiseComparator()->Compare(a, b);
+    }
+    virtual void FindShortestSeparator(std::string* s, const Slice& l) const {
+    }
+    virtual void FindShortSuccessor(std::string* key) const { }
+  };
+  ReverseComparator cmp;
+  Options options;
+  options.comparator = &cmp;
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(fname, &file));
+  TableBuilder builder(options, file);
+  builder.Add("b", "2");
+  builder.Add("a", "1");
+  ASSERT_OK(builder.Finish());
+  ASSERT_OK(file->Close());
+  delete file;
+  s = db_->IngestExternalFile(fname);
+  ASSERT_TRUE(s.ToString().find("Corruption") != std::string::npos)
+      << s.ToString();
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  ASSERT_TRUE(!db_->IngestExternalFile(dbname_ + "_missing.sst").ok());
+  env_->DeleteFile(fname);
+}
+
+// Reader side of the ConcurrentReaders test.
+struct ReaderState {
+  DB* db;
+  port::AtomicPointer stop;
+  port::AtomicPointer done;
+  int reads;
+};
+
+static const int kNumReaderKeys = 10;
+
+static void ReaderThreadBody(void* arg) {
+  ReaderState* state = reinterpret_cast<ReaderState*>(arg);
+  int last[kNumReaderKeys];
+  for (int k = 0; k < kNumReaderKeys; k++) {
+    last[k] = -1;
+  }
+  state->reads = 0;
+  while (state->stop.Acquire_Load() == NULL) {
+    const int k = state->reads % kNumReaderKeys;
+    std::string value;
+    Status s = state->db->Get(ReadOptions(), Key(k), &value);
+    if (s.ok()) {
+      // Counters only grow, whichever memtable or file holds them
+      const int v = atoi(value.c_str());
+      ASSERT_TRUE(v >= last[k]);
+      last[k] = v;
+    } else {
+      ASSERT_TRUE(s.IsNotFound());
+      ASSERT_EQ(-1, last[k]);
+    }
+    state->reads++;
+  }
+  state->done.Release_Store(state);
+}
+
+TEST(DBTest, ConcurrentReaders) {
+  Options options;
+  options.write_buffer_size = 10000;  // Switch memtables frequently
+  Reopen(&options);
+
+  ReaderState state;
+  state.db = db_;
+  state.stop.Release_Store(NULL);
+  state.done.Release_Store(NULL);
+  env_->StartThread(ReaderThreadBody, &state);
+
+  // Bump the counters while memtables are switched out and compacted
+  // under the reader.
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_OK(Put(Key(i % kNumReaderKeys), NumberToString(i)));
+    ASSERT_OK(Put(Key(1000 + i), std::string(100, 'x')));
+  }
+  state.stop.Release_Store(&state);
+  while (state.done.Acquire_Load() == NULL) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_GT(state.reads, 0);
+
+  for (int k = 0; k < kNumReaderKeys; k++) {
+    ASSERT_EQ(NumberToString(2000 - kNumReaderKeys + k), Get(Key(k)));
+  }
+}
+
+// Env that counts the reads issued against table files.
+class CountingReadEnv : public EnvWrapper {
+ public:
+  port::AtomicPointer random_read_counter_;  // Holds an int, not a pointer
+
+  explicit CountingReadEnv(Env* base) : EnvWrapper(base) {
+    random_read_counter_.Release_Store(NULL);
+  }
+
+  int random_reads() const {
+    return reinterpret_cast<intptr_t>(random_read_counter_.Acquire_Load());
+  }
+  void reset_random_reads() { random_read_counter_.Release_Store(NULL); }
+
+  Status NewRandomAccessFile(const std::string& f, RandomAccessFile** r) {
+    class CountingFile : public RandomAccessFile {
+     private:
+      RandomAccessFile* target_;
+      port::AtomicPointer* counter_;
+     public:
+      CountingFile(RandomAccessFile* target, port::AtomicPointer* counter)
+          : target_(target), counter_(counter) { }
+      virtual ~CountingFile() { delete target_; }
+      virtual uint64_t Size() const { return target_->Size(); }
+      virtual Status Read(uint64_t offset, size_t n, Slice* result,
+                          char* scratch) const {
+        intptr_t v = reinterpret_cast<intptr_t>(counter_->Acquire_Load());
+        counter_->Release_Store(reinterpret_cast<void*>(v + 1));
+        return target_->Read(offset, n, result, scratch);
+      }
+    };
+
+    Status s = target()->NewRandomAccessFile(f, r);
+    if (s.ok()) {
+      *r = new CountingFile(*r, &random_read_counter_);
+    }
+    return s;
+  }
+};
+
+TEST(DBTest, BloomFilter) {
+  CountingReadEnv env(Env::Default());
+  Options options;
+  options.env = &env;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Populate multiple layers
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, "a", "z");
+  ASSERT_GT(NumTableFilesAtLevel(1), 0);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  // Open every table once so that only block reads are counted below
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  // Lookup present keys.  Should rarely read from more than one file.
+  env.reset_random_reads();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env.random_reads();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2*N/100);
+
+  // Lookup missing keys.  Should rarely read from any file.
+  env.reset_random_reads();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env.random_reads();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3*N/100);
+
+  // Close before "env" and the policy go away.
+  DestroyAndReopen();
+  delete options.filter_policy;
+}
+
+TEST(DBTest, ParallelCompactions) {
+  Options options;
+  options.write_buffer_size = 100000;
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Write enough data in a scattered key order to push level-1 over its
+  // size limit while level-0 compactions keep arriving.
+  Random rnd(301);
+  const int N = 16000;
+  std::vector<std::string> values(N);
+  uint64_t max_running = 0;
+  for (int i = 0; i < N; i++) {
+    const int k = (i * 7919) % N;
+    values[k] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(k), values[k]));
+    uint64_t running;
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-running-compactions", &running));
+    if (running > max_running) {
+      max_running = running;
+    }
+  }
+  fprintf(stderr, "max running compactions: %d\n", int(max_running));
+  ASSERT_LE(max_running, 4);
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(N, count);
+
+  Reopen(&options);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST(DBTest, Subcompactions) {
+  Options options;
+  options.write_buffer_size = 100 << 20;  // Only compact memtables on demand
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Lay out several level-1 files so that compacting level-0 into them
+  // is split on their boundaries.
+  Random rnd(301);
+  const int N = 8000;
+  std::vector<std::string> values(N);
+  for (int i = 0; i < N; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_OK(Put(Key(i), values[i]));
+    if ((i + 1) % (N / 4) == 0) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      dbfull()->TEST_CompactRange(0, Key(0), Key(N));
+    }
+  }
+  ASSERT_GE(NumTableFilesAtLevel(1), 4);
+
+  // Overwrite and delete keys in every level-1 file
+  for (int i = 0; i < N; i += 7) {
+    if (i % 2 == 0) {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_OK(Put(Key(i), values[i]));
+    } else {
+      values[i] = "NOT_FOUND";
+      ASSERT_OK(Delete(Key(i)));
+    }
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, Key(0), Key(N));
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(values[i], Get(Key(i)));
+    }
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      while (values[i] == "NOT_FOUND") {
+        i++;
+      }
+      ASSERT_EQ(Key(i), iter->key().ToString());
+      ASSERT_EQ(values[i], iter->value().ToString());
+      i++;
+    }
+    delete iter;
+    while (i < N && values[i] == "NOT_FOUND") {
+      i++;
+    }
+    ASSERT_EQ(N, i);
+
+    Reopen(&options);
+  }
+}
+
 TEST(DBTest, DBOpen_Options) {
   std::string dbname = test::TmpDir() + "/db_options_test";
   DestroyDB(dbname, Options());
@@ -742,6 +1847,13 @@ class ModelDB: public DB {
   virtual Status Delete(const WriteOptions& o, const Slice& key) {
     return DB::Delete(o, key);
   }
+  virtual Status DeleteRange(const WriteOptions& o, const Slice& begin,
+                             const Slice& end) {
+    return DB::DeleteRange(o, begin, end);
+  }
+  virtual Status Merge(const WriteOptions& o, const Slice& k, const Slice& v) {
+    return DB::Merge(o, k, v);
+  }
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) {
     assert(false);      // Not implemented
@@ -770,6 +1882,14 @@ class ModelDB: public DB {
     delete saved;
     snapshots_.Delete(snapshot);
   }
+  virtual Status IngestExternalFile(const std::string& path) {
+    assert(false);      // Not implemented
+    return Status::NotSupported(path);
+  }
+  virtual Status DeleteFilesInRange(const Slice& begin, const Slice& end) {
+    assert(false);      // Not implemented
+    return Status::NotSupported(begin);
+  }
   virtual Status Write(const WriteOptions& options, WriteBatch* batch) {
     assert(options.post_write_snapshot == NULL);   // Not supported
     for (WriteBatchInternal::Iterator it(*batch); !it.Done(); it.Next()) {
@@ -783,6 +1903,27 @@ class ModelDB: public DB {
         case kTypeDeletion:
           map_.erase(it.key().ToString());
           break;
+        case kTypeRangeDeletion:
+          if (it.key().compare(it.value()) < 0) {
+            map_.erase(map_.lower_bound(it.key().ToString()),
+                       map_.lower_bound(it.value().ToString()));
+          }
+          break;
+        case kTypeMerge: {
+          const std::string key = it.key().ToString();
+          std::vector<std::string> operands(1, it.value().ToString());
+          KVMap::iterator existing = map_.find(key);
+          Slice existing_value;
+          if (existing != map_.end()) existing_value = existing->second;
+          std::string merged;
+          Status s = ApplyMergeOperands(
+              options_.merge_operator, key,
+              existing != map_.end() ? &existing_value : NULL,
+              operands, &merged);
+          if (!s.ok()) return s;
+          map_[key] = merged;
+          break;
+        }
       }
     }
     return Status::OK();
@@ -791,6 +1932,9 @@ class ModelDB: public DB {
   virtual bool GetProperty(const Slice& property, uint64_t* value) {
     return false;
   }
+  virtual bool GetProperty(const Slice& property, std::string* value) {
+    return false;
+  }
   virtual void GetApproximateSizes(const Range* r, int n, uint64_t* sizes) {
     for (int i = 0; i < n; i++) {
       sizes[i] = 0;
@@ -956,6 +2100,324 @@ TEST(DBTest, Randomized) {
   if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
 }
 
+TEST(DBTest, MergeRandomized) {
+  AddOperator add;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &add;
+  options.write_buffer_size = 10000;  // Flush and compact often
+  DestroyAndReopen(&options);
+
+  Random rnd(test::RandomSeed());
+  ModelDB model(last_options_);
+  const int N = 5000;
+  const Snapshot* model_snap = NULL;
+  const Snapshot* db_snap = NULL;
+  std::string k, v;
+  for (int step = 0; step < N; step++) {
+    k = RandomKey(&rnd);
+    v = NumberToString(rnd.Uniform(100));
+    int p = rnd.Uniform(100);
+    if (p < 20) {                               // Put
+      ASSERT_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 30) {                        // Delete
+      ASSERT_OK(model.Delete(WriteOptions(), k));
+      ASSERT_OK(db_->Delete(WriteOptions(), k));
+    } else {                                    // Merge
+      ASSERT_OK(model.Merge(WriteOptions(), k, v));
+      ASSERT_OK(db_->Merge(WriteOptions(), k, v));
+    }
+
+    if ((step % 500) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+
+      // Point lookups agree with the iterator
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ASSERT_EQ(iter->value().ToString(), Get(iter->key().ToString()));
+      }
+      delete iter;
+
+      if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+      if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+
+      Reopen(&options);
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+  if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+}
+
+TEST(DBTest, DeleteRangeRandomized) {
+  AddOperator add;
+  Options options;
+  options.create_if_missing = true;
+  options.merge_operator = &add;
+  options.write_buffer_size = 10000;  // Flush and compact often
+  DestroyAndReopen(&options);
+
+  Random rnd(test::RandomSeed());
+  ModelDB model(last_options_);
+  const int N = 5000;
+  const Snapshot* model_snap = NULL;
+  const Snapshot* db_snap = NULL;
+  std::string k, k2, v;
+  for (int step = 0; step < N; step++) {
+    k = RandomKey(&rnd);
+    v = NumberToString(rnd.Uniform(100));
+    int p = rnd.Uniform(100);
+    if (p < 50) {                               // Put
+      ASSERT_OK(model.Put(WriteOptions(), k, v));
+      ASSERT_OK(db_->Put(WriteOptions(), k, v));
+    } else if (p < 60) {                        // Delete
+      ASSERT_OK(model.Delete(WriteOptions(), k));
+      ASSERT_OK(db_->Delete(WriteOptions(), k));
+    } else if (p < 65) {                        // DeleteRange
+      k2 = RandomKey(&rnd);
+      if (k2 < k) k.swap(k2);
+      ASSERT_OK(model.DeleteRange(WriteOptions(), k, k2));
+      ASSERT_OK(db_->DeleteRange(WriteOptions(), k, k2));
+    } else {                                    // Merge
+      ASSERT_OK(model.Merge(WriteOptions(), k, v));
+      ASSERT_OK(db_->Merge(WriteOptions(), k, v));
+    }
+
+    if ((step % 500) == 0) {
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+      ASSERT_TRUE(CompareIterators(step, &model, db_, model_snap, db_snap));
+
+      // Point lookups agree with the model, for deleted keys too
+      Iterator* miter = model.NewIterator(ReadOptions());
+      for (int i = 0; i < 100; i++) {
+        k = RandomKey(&rnd);
+        miter->Seek(k);
+        const bool live = miter->Valid() && miter->key() == k;
+        ASSERT_EQ(live ? miter->value().ToString() : "NOT_FOUND", Get(k));
+      }
+      delete miter;
+
+      if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+      if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+
+      Reopen(&options);
+      ASSERT_TRUE(CompareIterators(step, &model, db_, NULL, NULL));
+
+      model_snap = model.GetSnapshot();
+      db_snap = db_->GetSnapshot();
+    }
+  }
+  if (model_snap != NULL) model.ReleaseSnapshot(model_snap);
+  if (db_snap != NULL) db_->ReleaseSnapshot(db_snap);
+}
+
+TEST(DBTest, CompressionPerLevel) {
+  Options options;
+  ASSERT_EQ(options.compression, CompressionForLevel(options, 0));
+  ASSERT_EQ(options.compression, CompressionForLevel(options, 6));
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(kNoCompression);
+  options.compression_per_level.push_back(kLightweightCompression);
+  ASSERT_EQ(kNoCompression, CompressionForLevel(options, 0));
+  ASSERT_EQ(kNoCompression, CompressionForLevel(options, 1));
+  ASSERT_EQ(kLightweightCompression, CompressionForLevel(options, 2));
+  ASSERT_EQ(kLightweightCompression, CompressionForLevel(options, 6));
+
+  // Tables written with and without compression threads read back
+  options.create_if_missing = true;
+  options.write_buffer_size = 100000;
+  options.compression_threads = 2;
+  DestroyAndReopen(&options);
+  Random rnd(301);
+  std::vector<std::string> values;
+  for (int i = 0; i < 200; i++) {
+    values.push_back(RandomString(&rnd, 1000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, Key(0), Key(199));
+  dbfull()->TEST_CompactRange(1, Key(0), Key(199));
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+  Reopen(&options);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+
+TEST(DBTest, PerfContext) {
+  Cache* cache = NewLRUCache(1 << 20);
+  Options options;
+  options.create_if_missing = true;
+  options.block_cache = cache;
+  DestroyAndReopen(&options);
+  PerfContext* ctx = GetPerfContext();
+
+  // Nothing is collected by default
+  ctx->Reset();
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ(0, ctx->get_from_memtable_count);
+  ASSERT_EQ(0, ctx->user_key_comparison_count);
+  ASSERT_EQ("", ctx->ToString());
+
+  SetPerfLevel(kEnableTime);
+  ctx->Reset();
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ(1, ctx->get_from_memtable_count);
+  ASSERT_EQ(0, ctx->get_from_table_count);
+  ASSERT_GT(ctx->user_key_comparison_count, 0);
+
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(Delete("b"));
+  dbfull()->TEST_CompactMemTable();
+
+  // The first read of the table's data block misses the cache
+  ctx->Reset();
+  ASSERT_EQ("vc", Get("c"));
+  ASSERT_EQ(0, ctx->get_from_memtable_count);
+  ASSERT_EQ(1, ctx->get_from_table_count);
+  ASSERT_EQ(1, ctx->block_read_count);
+  ASSERT_GT(ctx->block_read_byte, 0);
+  ASSERT_EQ(0, ctx->block_cache_hit_count);
+  ctx->Reset();
+  ASSERT_EQ("vc", Get("c"));
+  ASSERT_EQ(0, ctx->block_read_count);
+  ASSERT_EQ(1, ctx->block_cache_hit_count);
+
+  // Overwritten and deleted entries are stepped over
+  ASSERT_OK(Put("a", "va2"));
+  ctx->Reset();
+  ASSERT_EQ("a=va2,c=vc", Contents());
+  ASSERT_GT(ctx->internal_key_skipped_count, 0);
+  ASSERT_GT(ctx->internal_delete_skipped_count, 0);
+  ASSERT_TRUE(ctx->ToString().find("internal_delete_skipped_count") !=
+              std::string::npos);
+
+  SetPerfLevel(kDisablePerf);
+  delete db_;
+  db_ = NULL;
+  delete cache;
+}
+
+
+TEST(DBTest, GetPinnable) {
+  AddOperator add;
+  Cache* cache = NewLRUCache(1 << 20);
+  Options options;
+  options.create_if_missing = true;
+  options.block_cache = cache;
+  options.merge_operator = &add;
+  DestroyAndReopen(&options);
+
+  // Memtable values are copied
+  PinnableSlice value;
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(db_->Get(ReadOptions(), "a", &value));
+  ASSERT_EQ("va", value.ToString());
+  ASSERT_TRUE(!value.IsPinned());
+
+  // Table values point into the cached block
+  std::string big(10000, 'x');
+  ASSERT_OK(Put("b", big));
+  ASSERT_OK(Put("c", "10"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(db_->Get(ReadOptions(), "b", &value));
+  ASSERT_EQ(big, value.ToString());
+  ASSERT_TRUE(value.IsPinned());
+
+  // The pinned block outlives the table it was read from
+  ASSERT_OK(Put("b", "new"));
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, "a", "c");
+  ASSERT_EQ(big, value.ToString());
+  ASSERT_EQ("new", Get("b"));
+
+  // Merged values are copied
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "5"));
+  ASSERT_OK(db_->Get(ReadOptions(), "c", &value));
+  ASSERT_EQ("15", value.ToString());
+  ASSERT_TRUE(!value.IsPinned());
+
+  ASSERT_OK(Delete("a"));
+  ASSERT_TRUE(db_->Get(ReadOptions(), "a", &value).IsNotFound());
+  ASSERT_EQ("", value.ToString());
+
+  // Without a block cache the block is owned by the pinned value
+  value.Reset();
+  options.block_cache = NULL;
+  Reopen(&options);
+  ASSERT_OK(db_->Get(ReadOptions(), "b", &value));
+  ASSERT_EQ("new", value.ToString());
+  ASSERT_TRUE(value.IsPinned());
+  value.Reset();
+  delete db_;
+  db_ = NULL;
+  delete cache;
+}
+
+TEST(DBTest, Statistics) {
+  Statistics* stats = NewStatistics();
+  Cache* cache = NewLRUCache(1 << 20);
+  Options options;
+  options.create_if_missing = true;
+  options.statistics = stats;
+  options.block_cache = cache;
+  options.stats_dump_period_sec = 1;
+  DestroyAndReopen(&options);
+
+  std::string big(10000, 'x');
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Put(Key(i), big));
+  }
+  ASSERT_GE(stats->GetTickerCount(kBytesWritten), 10 * big.size());
+  ASSERT_EQ(10, stats->GetHistogramCount(kWriteMicros));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_GT(stats->GetTickerCount(kFlushBytesWritten), 0);
+
+  ASSERT_EQ(big, Get(Key(0)));
+  ASSERT_EQ(big, Get(Key(0)));   // From the block cache
+  ASSERT_EQ(big.size() * 2, stats->GetTickerCount(kBytesRead));
+  ASSERT_EQ(2, stats->GetHistogramCount(kGetMicros));
+  ASSERT_GT(stats->GetTickerCount(kBlockCacheMiss), 0);
+  ASSERT_GT(stats->GetTickerCount(kBlockCacheHit), 0);
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(Key(5));
+  ASSERT_TRUE(iter->Valid());
+  delete iter;
+  ASSERT_EQ(1, stats->GetHistogramCount(kSeekMicros));
+
+  dbfull()->TEST_CompactRange(0, Key(0), Key(9));
+  ASSERT_GT(stats->GetTickerCount(kCompactionBytesRead), 0);
+
+  std::string report;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.no-such-property", &report));
+  ASSERT_TRUE(db_->GetProperty("leveldb.stats", &report));
+  ASSERT_TRUE(report.find("W-Amp") != std::string::npos) << report;
+  ASSERT_TRUE(report.find("leveldb.block.cache.hit") != std::string::npos);
+
+  // The report is written to the info log periodically
+  env_->SleepForMicroseconds(1500000);
+  delete db_;
+  db_ = NULL;
+  std::string log;
+  ASSERT_OK(ReadFileToString(env_, InfoLogFileName(dbname_), &log));
+  ASSERT_TRUE(log.find("DUMPING STATS") != std::string::npos);
+
+  delete cache;
+  delete stats;
+}
+
 }
 
 int main(int argc, char** argv) {
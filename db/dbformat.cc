@@ -6,6 +6,7 @@
 #include "db/dbformat.h"
 #include "port/port.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
 
 namespace leveldb {
 
@@ -40,6 +41,7 @@ int InternalKeyComparator::Compare(const Slice& akey, const Slice& bkey) const {
   //    increasing user key (according to user-supplied comparator)
   //    decreasing sequence number
   //    decreasing type (though sequence# should be enough to disambiguate)
+  PERF_COUNTER_ADD(user_key_comparison_count, 1);
   int r = user_comparator_->Compare(ExtractUserKey(akey), ExtractUserKey(bkey));
   if (r == 0) {
     const uint64_t anum = DecodeFixed64(akey.data() + akey.size() - 8);
@@ -159,4 +161,64 @@ bool FilenameStringToLargeValueRef(const Slice& s, LargeValueRef* h) {
   }
 }
 
+const char* InternalFilterPolicy::Name() const {
+  return user_policy_->Name();
+}
+
+void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
+                                        std::string* dst) const {
+  // We rely on the fact that FilterBlockBuilder does not mind us
+  // adjusting keys[].
+  Slice* mkey = const_cast<Slice*>(keys);
+  for (int i = 0; i < n; i++) {
+    mkey[i] = ExtractUserKey(keys[i]);
+  }
+  user_policy_->CreateFilter(keys, n, dst);
+}
+
+bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
+  return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
+}
+
+Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& user_key,
+                          const Slice* existing_value,
+                          const std::vector<std::string>& operands,
+                          std::string* result) {
+  if (merge_operator == NULL) {
+    return Status::InvalidArgument("merge operands found for ", user_key);
+  }
+  std::vector<Slice> oldest_first;
+  oldest_first.reserve(operands.size());
+  for (size_t i = operands.size(); i > 0; i--) {
+    oldest_first.push_back(operands[i - 1]);
+  }
+  std::string merged;
+  if (!merge_operator->FullMerge(user_key, existing_value, oldest_first,
+                                 &merged)) {
+    return Status::Corruption("merge failed for ", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
+  size_t usize = user_key.size();
+  size_t needed = usize + 13;  // A conservative estimate
+  char* dst;
+  if (needed <= sizeof(space_)) {
+    dst = space_;
+  } else {
+    dst = new char[needed];
+  }
+  start_ = dst;
+  dst = EncodeVarint32(dst, usize + 8);
+  kstart_ = dst;
+  memcpy(dst, user_key.data(), usize);
+  dst += usize;
+  EncodeFixed64(dst, PackSequenceAndType(s, kValueTypeForSeek));
+  dst += 8;
+  end_ = dst;
+}
+
 }
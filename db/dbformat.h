@@ -6,8 +6,11 @@
 #define STORAGE_LEVELDB_DB_FORMAT_H_
 
 #include <stdio.h>
+#include <vector>
 #include "include/comparator.h"
 #include "include/db.h"
+#include "include/filter_policy.h"
+#include "include/merge_operator.h"
 #include "include/slice.h"
 #include "include/table_builder.h"
 #include "util/coding.h"
@@ -24,6 +27,8 @@ enum ValueType {
   kTypeDeletion = 0x0,
   kTypeValue = 0x1,
   kTypeLargeValueRef = 0x2,
+  kTypeMerge = 0x3,
+  kTypeRangeDeletion = 0x4,   // See db/range_del.h
 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
@@ -31,7 +36,7 @@ enum ValueType {
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeLargeValueRef;
+static const ValueType kValueTypeForSeek = kTypeRangeDeletion;
 
 // kValueTypeForSeek 的语义大概了解了, 可以从 iterator.Seek() 操作的大概实现, InternalKey 的 total
 // order 来理解当使用 kTypeDeletion, kTypeValue 作为 kValueTypeForSeek 时会导致哪些 bug, 从而只能使用
@@ -116,6 +121,17 @@ class InternalKeyComparator : public Comparator {
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
+// Filter policy wrapper that converts from internal keys to user keys
+class InternalFilterPolicy : public FilterPolicy {
+ private:
+  const FilterPolicy* const user_policy_;
+ public:
+  explicit InternalFilterPolicy(const FilterPolicy* p) : user_policy_(p) { }
+  virtual const char* Name() const;
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const;
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const;
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -149,6 +165,49 @@ inline int InternalKeyComparator::Compare(
   return Compare(a.Encode(), b.Encode());
 }
 
+// A helper class useful for DBImpl::Get()
+class LookupKey {
+ public:
+  // Initialize *this for looking up user_key at a snapshot with
+  // the specified sequence number.
+  LookupKey(const Slice& user_key, SequenceNumber sequence);
+
+  ~LookupKey();
+
+  // Return a key suitable for lookup in a MemTable.
+  Slice memtable_key() const { return Slice(start_, end_ - start_); }
+
+  // Return an internal key (suitable for passing to an internal iterator)
+  Slice internal_key() const { return Slice(kstart_, end_ - kstart_); }
+
+  // Return the user key
+  Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
+
+  // Return the snapshot sequence number of the lookup
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
+ private:
+  // We construct a char array of the form:
+  //    klength  varint32               <-- start_
+  //    userkey  char[klength]          <-- kstart_
+  //    tag      uint64
+  //                                    <-- end_
+  // The array is a suitable MemTable key.
+  // The suffix starting with "userkey" can be used as an InternalKey.
+  const char* start_;
+  const char* kstart_;
+  const char* end_;
+  char space_[200];      // Avoid allocation for short keys
+
+  // No copying allowed
+  LookupKey(const LookupKey&);
+  void operator=(const LookupKey&);
+};
+
+inline LookupKey::~LookupKey() {
+  if (start_ != space_) delete[] start_;
+}
+
 // LargeValueRef is a 160-bit hash value (20 bytes), plus an 8 byte
 // uncompressed size, and a 1 byte CompressionType code.  An
 // encoded form of it is embedded in the filenames of large value
@@ -205,6 +264,17 @@ extern std::string LargeValueRefToFilenameString(const LargeValueRef& h);
 // 应该作为类的 static 成员函数.
 extern bool FilenameStringToLargeValueRef(const Slice& in, LargeValueRef* ref);
 
+// Apply merge operands for "user_key", given newest first as lookups
+// collect them, to "*existing_value" (NULL if the key has no value)
+// and store the result in *result.  "existing_value" may point into
+// *result.  Returns InvalidArgument if "merge_operator" is NULL and
+// Corruption if the operator rejects the operands.
+extern Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                                 const Slice& user_key,
+                                 const Slice* existing_value,
+                                 const std::vector<std::string>& operands,
+                                 std::string* result);
+
 inline bool ParseInternalKey(const Slice& internal_key,
                              ParsedInternalKey* result) {
   const size_t n = internal_key.size();
@@ -215,7 +285,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
   // 这里应该使用类似 IsValidValueType() 来判断的.
-  return (c <= static_cast<unsigned char>(kTypeLargeValueRef));
+  return (c <= static_cast<unsigned char>(kTypeRangeDeletion));
 }
 
 }
@@ -4,10 +4,12 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/range_del.h"
 #include "include/comparator.h"
 #include "include/env.h"
 #include "include/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 // 这里真是大量使用了与 dbformat, coding 中的重复代码啊.
 
@@ -22,10 +24,17 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 
 MemTable::MemTable(const InternalKeyComparator& cmp)
     : comparator_(cmp),
-      table_(comparator_, &arena_) {
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      num_range_dels_(NULL),
+      range_del_list_(NULL) {
 }
 
 MemTable::~MemTable() {
+  for (size_t i = 0; i < range_del_lists_.size(); i++) {
+    delete range_del_lists_[i]->list;
+    delete range_del_lists_[i];
+  }
 }
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
@@ -82,9 +91,14 @@ Iterator* MemTable::NewIterator() {
   return new MemTableIterator(&table_);
 }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type,
                    const Slice& key,
-                   const Slice& value) {
+                   const Slice& value,
+                   bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -96,7 +110,8 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   const size_t encoded_len =
       VarintLength(internal_key_size) + internal_key_size +
       VarintLength(val_size) + val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   memcpy(p, key.data(), key_size);
   p += key_size;
@@ -105,7 +120,108 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert((p + val_size) - buf == encoded_len);
-  table_.Insert(buf);
+  Table* table = (type == kTypeRangeDeletion) ? &range_del_table_ : &table_;
+  if (concurrent) {
+    table->InsertConcurrently(buf);
+  } else {
+    table->Insert(buf);
+  }
+  if (type == kTypeRangeDeletion) {
+    // Counted after the insert, so a lookup that sees the count also
+    // sees the tombstone
+    MutexLock l(&range_del_mutex_);
+    const intptr_t n =
+        reinterpret_cast<intptr_t>(num_range_dels_.NoBarrier_Load());
+    num_range_dels_.Release_Store(reinterpret_cast<void*>(n + 1));
+  }
+}
+
+MemTable::RangeDelList* MemTable::UpdateRangeDelList() {
+  MutexLock l(&range_del_mutex_);
+  RangeDelList* listed =
+      reinterpret_cast<RangeDelList*>(range_del_list_.NoBarrier_Load());
+  const intptr_t counted =
+      reinterpret_cast<intptr_t>(num_range_dels_.NoBarrier_Load());
+  if (listed != NULL && listed->count == counted) {
+    // Another lookup rebuilt it meanwhile
+    return listed;
+  }
+  MemTableIterator range_del_iter(&range_del_table_);
+  RangeTombstoneList* list;
+  if (RangeTombstoneList::Build(comparator_.comparator.user_comparator(),
+                                &range_del_iter, &list).ok()) {
+    listed = new RangeDelList;
+    listed->list = list;
+    listed->count = counted;
+    range_del_lists_.push_back(listed);
+    range_del_list_.Release_Store(listed);
+  }
+  return listed;
+}
+
+bool MemTable::Get(const LookupKey& key, ValueType* type,
+                   std::string* value,
+                   std::vector<std::string>* merge_operands,
+                   SequenceNumber* max_covering_tombstone) {
+  const intptr_t num_range_dels =
+      reinterpret_cast<intptr_t>(num_range_dels_.Acquire_Load());
+  if (num_range_dels > 0) {
+    RangeDelList* listed =
+        reinterpret_cast<RangeDelList*>(range_del_list_.Acquire_Load());
+    if (listed == NULL || listed->count < num_range_dels) {
+      listed = UpdateRangeDelList();
+    }
+    if (listed != NULL) {
+      const SequenceNumber seq =
+          listed->list->MaxCoveringSequence(key.user_key(), key.sequence());
+      if (seq > *max_covering_tombstone) {
+        *max_covering_tombstone = seq;
+      }
+    }
+  }
+
+  Slice memkey = key.memtable_key();
+  Table::Iterator iter(&table_);
+  iter.Seek(memkey.data());
+  for (; iter.Valid(); iter.Next()) {
+    // entry format is:
+    //    klength  varint32
+    //    userkey  char[klength-8]
+    //    tag      uint64
+    //    vlength  varint32
+    //    value    char[vlength]
+    // Check that it belongs to same user key.  We do not check the
+    // sequence number since the Seek() call above should have skipped
+    // all entries with overly large sequence numbers.
+    const char* entry = iter.key();
+    uint32_t key_length;
+    const char* key_ptr = GetVarint32Ptr(entry, entry+5, &key_length);
+    if (comparator_.comparator.user_comparator()->Compare(
+            Slice(key_ptr, key_length - 8),
+            key.user_key()) == 0) {
+      // Correct user key
+      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      const ValueType t = static_cast<ValueType>(tag & 0xff);
+      if ((tag >> 8) < *max_covering_tombstone) {
+        *type = kTypeDeletion;  // Deleted by a range tombstone
+        return true;
+      }
+      if (t == kTypeMerge) {
+        // Keep looking for the value the operand applies to
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        merge_operands->push_back(v.ToString());
+        continue;
+      }
+      *type = t;
+      if (*type != kTypeDeletion) {
+        Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+        value->assign(v.data(), v.size());
+      }
+      return true;
+    }
+    break;
+  }
+  return false;
 }
 
 }
@@ -6,9 +6,11 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
 #include "include/db.h"
 #include "db/dbformat.h"
 #include "db/skiplist.h"
+#include "port/port.h"
 #include "util/arena.h"
 
 namespace leveldb {
@@ -16,6 +18,7 @@ namespace leveldb {
 class InternalKeyComparator;
 class Mutex;
 class MemTableIterator;
+class RangeTombstoneList;
 
 /*
  * MemTable, 本质上就是 SkipList. 其 key 是 InternalKey 的序列化形式; 其 value 是用户添加的 value, 或者
@@ -44,12 +47,38 @@ class MemTable {
   // 这里 Iterator 仅是对 table_ 进行读操作, 而且 SkipList 读操作无需加锁, 所以这类使用 iterator 时无需加锁.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable, which
+  // NewIterator() does not yield.  Keys are the internal keys of the
+  // tombstones and values their end keys; see db/range_del.h.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
+  // If "concurrent" is true, several threads may call Add() at once, as
+  // long as all of them pass true.
   void Add(SequenceNumber seq, ValueType type,
            const Slice& key,
-           const Slice& value);
+           const Slice& value,
+           bool concurrent = false);
+
+  // If memtable contains an entry for key that is visible at the
+  // sequence number of "key", store its type in *type and return true.
+  // Unless the entry is a deletion, also store its value in *value.
+  // Else, return false.
+  //
+  // Merge operands met before that entry are appended to
+  // *merge_operands, newest first, and the search goes on past them.
+  // A false return with new operands means older sources must be
+  // searched for the value they apply to.
+  //
+  // *max_covering_tombstone is raised to the sequence number of the
+  // newest range tombstone of this memtable covering key, and entries
+  // older than it read as deletions.  Callers pass the value left by
+  // newer memtables.
+  bool Get(const LookupKey& key, ValueType* type, std::string* value,
+           std::vector<std::string>* merge_operands,
+           SequenceNumber* max_covering_tombstone);
 
  private:
   struct KeyComparator {
@@ -65,6 +94,22 @@ class MemTable {
   KeyComparator comparator_;
   Arena arena_;
   Table table_;
+  Table range_del_table_;   // Range tombstones, kept out of table_
+
+  // Point lookups search a fragmented copy of range_del_table_, rebuilt
+  // by the first lookup after tombstones were added.  Lookups load the
+  // copy without locking, so replaced copies are only freed along with
+  // the memtable.
+  struct RangeDelList {
+    RangeTombstoneList* list;
+    intptr_t count;                     // Tombstones included in "list"
+  };
+  RangeDelList* UpdateRangeDelList();
+
+  port::AtomicPointer num_range_dels_;  // Tombstones added, as an intptr_t
+  port::AtomicPointer range_del_list_;  // Latest RangeDelList, or NULL
+  port::Mutex range_del_mutex_;         // Held to count tombstones or rebuild
+  std::vector<RangeDelList*> range_del_lists_;  // Guarded by range_del_mutex_
 
   // No copying allowed
   MemTable(const MemTable&);
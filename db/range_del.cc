@@ -0,0 +1,225 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_del.h"
+
+#include <algorithm>
+#include <functional>
+#include "include/comparator.h"
+#include "include/iterator.h"
+
+namespace leveldb {
+
+bool ParseRangeTombstone(const Slice& key, const Slice& value,
+                         RangeTombstone* tombstone) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(key, &ikey) || ikey.type != kTypeRangeDeletion) {
+    return false;
+  }
+  tombstone->start.assign(ikey.user_key.data(), ikey.user_key.size());
+  tombstone->end.assign(value.data(), value.size());
+  tombstone->sequence = ikey.sequence;
+  return true;
+}
+
+RangeDelAggregator::RangeDelAggregator(const Comparator* ucmp,
+                                       SequenceNumber upper_bound)
+    : ucmp_(ucmp),
+      upper_bound_(upper_bound),
+      fragments_valid_(true) {
+}
+
+Status RangeDelAggregator::AddTombstones(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    RangeTombstone tombstone;
+    if (!ParseRangeTombstone(iter->key(), iter->value(), &tombstone)) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    AddTombstone(tombstone);
+  }
+  return iter->status();
+}
+
+void RangeDelAggregator::AddTombstone(const RangeTombstone& tombstone) {
+  if (tombstone.sequence <= upper_bound_ &&
+      ucmp_->Compare(tombstone.start, tombstone.end) < 0) {
+    tombstones_.push_back(tombstone);
+    fragments_valid_ = false;
+  }
+}
+
+namespace {
+struct StartLess {
+  const Comparator* ucmp;
+  explicit StartLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const RangeTombstone& a, const RangeTombstone& b) const {
+    return ucmp->Compare(a.start, b.start) < 0;
+  }
+};
+struct KeyLess {
+  const Comparator* ucmp;
+  explicit KeyLess(const Comparator* c) : ucmp(c) { }
+  bool operator()(const std::string& a, const std::string& b) const {
+    return ucmp->Compare(a, b) < 0;
+  }
+};
+
+typedef void (*FragmentHandler)(
+    void* arg, const std::string& start, const std::string& end,
+    const std::vector<const RangeTombstone*>& active);
+
+// Split "tombstones" into disjoint fragments at every start and end key
+// and call (*handler)(arg, start, end, active) with the tombstones
+// covering each fragment, in key order.  Uncovered fragments are
+// skipped.  Sorts "tombstones" by start key.
+void SplitTombstones(const Comparator* ucmp,
+                     std::vector<RangeTombstone>* tombstones,
+                     FragmentHandler handler, void* arg) {
+  // Every start and end key is a fragment boundary.  Sweep them in
+  // order, keeping the tombstones that cover the current fragment.
+  std::vector<std::string> points;
+  for (size_t i = 0; i < tombstones->size(); i++) {
+    points.push_back((*tombstones)[i].start);
+    points.push_back((*tombstones)[i].end);
+  }
+  std::sort(points.begin(), points.end(), KeyLess(ucmp));
+  std::sort(tombstones->begin(), tombstones->end(), StartLess(ucmp));
+
+  std::vector<const RangeTombstone*> active;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < points.size(); i++) {
+    if (ucmp->Compare(points[i], points[i + 1]) == 0) {
+      continue;
+    }
+    const Slice point = points[i];
+    size_t kept = 0;
+    for (size_t j = 0; j < active.size(); j++) {
+      if (ucmp->Compare(active[j]->end, point) > 0) {
+        active[kept++] = active[j];
+      }
+    }
+    active.resize(kept);
+    while (next < tombstones->size() &&
+           ucmp->Compare((*tombstones)[next].start, point) <= 0) {
+      active.push_back(&(*tombstones)[next++]);
+    }
+    if (!active.empty()) {
+      (*handler)(arg, points[i], points[i + 1], active);
+    }
+  }
+}
+
+// Return the index of the fragment of "fragments", sorted and disjoint,
+// that holds "user_key", or -1 if there is none.
+template <typename FragmentVector>
+int FindFragment(const Comparator* ucmp, const FragmentVector& fragments,
+                 const Slice& user_key) {
+  // Find the last fragment starting at or before user_key
+  size_t left = 0;
+  size_t right = fragments.size();
+  while (left < right) {
+    size_t mid = (left + right) / 2;
+    if (ucmp->Compare(fragments[mid].start, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  if (left == 0 || ucmp->Compare(user_key, fragments[left - 1].end) >= 0) {
+    return -1;
+  }
+  return static_cast<int>(left - 1);
+}
+
+}
+
+void RangeDelAggregator::AddFragment(
+    void* arg, const std::string& start, const std::string& end,
+    const std::vector<const RangeTombstone*>& active) {
+  RangeDelAggregator* agg = reinterpret_cast<RangeDelAggregator*>(arg);
+  SequenceNumber sequence = 0;
+  for (size_t j = 0; j < active.size(); j++) {
+    sequence = std::max(sequence, active[j]->sequence);
+  }
+  std::vector<Fragment>* fragments = &agg->fragments_;
+  if (!fragments->empty() && fragments->back().sequence == sequence &&
+      agg->ucmp_->Compare(fragments->back().end, start) == 0) {
+    fragments->back().end = end;  // Extend the previous one
+  } else {
+    Fragment f;
+    f.start = start;
+    f.end = end;
+    f.sequence = sequence;
+    fragments->push_back(f);
+  }
+}
+
+void RangeDelAggregator::BuildFragments() {
+  fragments_.clear();
+  SplitTombstones(ucmp_, &tombstones_, &RangeDelAggregator::AddFragment,
+                  this);
+  fragments_valid_ = true;
+}
+
+SequenceNumber RangeDelAggregator::MaxCoveringSequence(const Slice& user_key) {
+  if (!fragments_valid_) {
+    BuildFragments();
+  }
+  const int i = FindFragment(ucmp_, fragments_, user_key);
+  return (i < 0) ? 0 : fragments_[i].sequence;
+}
+
+Status RangeTombstoneList::Build(const Comparator* ucmp, Iterator* iter,
+                                 RangeTombstoneList** result) {
+  *result = NULL;
+  std::vector<RangeTombstone> tombstones;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    RangeTombstone tombstone;
+    if (!ParseRangeTombstone(iter->key(), iter->value(), &tombstone)) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    if (ucmp->Compare(tombstone.start, tombstone.end) < 0) {
+      tombstones.push_back(tombstone);
+    }
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+  RangeTombstoneList* list = new RangeTombstoneList(ucmp);
+  SplitTombstones(ucmp, &tombstones, &RangeTombstoneList::AddFragment, list);
+  *result = list;
+  return Status::OK();
+}
+
+void RangeTombstoneList::AddFragment(
+    void* arg, const std::string& start, const std::string& end,
+    const std::vector<const RangeTombstone*>& active) {
+  RangeTombstoneList* list = reinterpret_cast<RangeTombstoneList*>(arg);
+  list->fragments_.resize(list->fragments_.size() + 1);
+  Fragment* f = &list->fragments_.back();
+  f->start = start;
+  f->end = end;
+  for (size_t j = 0; j < active.size(); j++) {
+    f->sequences.push_back(active[j]->sequence);
+  }
+  std::sort(f->sequences.begin(), f->sequences.end(),
+            std::greater<SequenceNumber>());
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  const int i = FindFragment(ucmp_, fragments_, user_key);
+  if (i < 0) {
+    return 0;
+  }
+  const std::vector<SequenceNumber>& sequences = fragments_[i].sequences;
+  for (size_t j = 0; j < sequences.size(); j++) {
+    if (sequences[j] <= snapshot) {
+      return sequences[j];
+    }
+  }
+  return 0;
+}
+
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by WriteBatch::DeleteRange(), deletes every
+// entry for the user keys in [start,end) whose sequence number is below
+// its own.  Tombstones are not mixed with the point entries: memtables
+// keep them in a separate skiplist and tables in a "leveldb.rangedel"
+// meta block.  In both places an entry is keyed by the internal key
+// (start, sequence, kTypeRangeDeletion) and its value is the end key.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_DEL_H_
+#define STORAGE_LEVELDB_DB_RANGE_DEL_H_
+
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+
+namespace leveldb {
+
+class Comparator;
+class Iterator;
+
+struct RangeTombstone {
+  std::string start;    // Inclusive user key
+  std::string end;      // Exclusive user key
+  SequenceNumber sequence;
+};
+
+// Parse a range tombstone entry.  Returns false if "key" is not the
+// internal key of a range tombstone.
+extern bool ParseRangeTombstone(const Slice& key, const Slice& value,
+                                RangeTombstone* tombstone);
+
+// An immutable set of range tombstones split into disjoint fragments,
+// each keeping the sequence numbers of every tombstone covering it, so
+// that the tombstones covering a key at any snapshot are found with a
+// binary search.  Memtables and the table cache keep one per source to
+// answer point lookups.
+class RangeTombstoneList {
+ public:
+  // Build a list of the tombstone entries yielded by "iter" and store
+  // it in *result.  Does not take ownership of "iter".
+  static Status Build(const Comparator* ucmp, Iterator* iter,
+                      RangeTombstoneList** result);
+
+  // Return the largest sequence number not above "snapshot" of a
+  // tombstone covering "user_key", or 0 if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+ private:
+  struct Fragment {
+    std::string start;
+    std::string end;
+    std::vector<SequenceNumber> sequences;   // Newest first
+  };
+
+  explicit RangeTombstoneList(const Comparator* ucmp) : ucmp_(ucmp) { }
+
+  static void AddFragment(void* arg, const std::string& start,
+                          const std::string& end,
+                          const std::vector<const RangeTombstone*>& active);
+
+  const Comparator* const ucmp_;
+  std::vector<Fragment> fragments_;   // Sorted, disjoint
+
+  // No copying allowed
+  RangeTombstoneList(const RangeTombstoneList&);
+  void operator=(const RangeTombstoneList&);
+};
+
+// Collects the range tombstones of several memtables and tables and
+// answers whether they delete a given entry.  Overlapping tombstones
+// are split into disjoint fragments, each carrying the largest
+// sequence number covering it, so a lookup is a binary search.
+class RangeDelAggregator {
+ public:
+  // Only tombstones with a sequence number <= "upper_bound" are kept.
+  RangeDelAggregator(const Comparator* ucmp, SequenceNumber upper_bound);
+
+  // Add the tombstones yielded by "iter" and return its status.  Does
+  // not take ownership of "iter".
+  Status AddTombstones(Iterator* iter);
+  void AddTombstone(const RangeTombstone& tombstone);
+
+  bool empty() const { return tombstones_.empty(); }
+
+  // Return the largest sequence number of a kept tombstone covering
+  // "user_key", or 0 if there is none.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key);
+
+  // Return true iff a kept tombstone deletes the entry "key".
+  bool ShouldDelete(const ParsedInternalKey& key) {
+    return key.sequence < MaxCoveringSequence(key.user_key);
+  }
+
+ private:
+  struct Fragment {
+    std::string start;
+    std::string end;
+    SequenceNumber sequence;
+  };
+
+  void BuildFragments();
+  static void AddFragment(void* arg, const std::string& start,
+                          const std::string& end,
+                          const std::vector<const RangeTombstone*>& active);
+
+  const Comparator* const ucmp_;
+  const SequenceNumber upper_bound_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;   // Sorted, disjoint
+  bool fragments_valid_;
+
+  // No copying allowed
+  RangeDelAggregator(const RangeDelAggregator&);
+  void operator=(const RangeDelAggregator&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_DEL_H_
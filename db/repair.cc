@@ -42,6 +42,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -59,7 +60,8 @@ class Repairer {
       : dbname_(dbname),
         env_(options.env),
         icmp_(options.comparator),
-        options_(SanitizeOptions(dbname, &icmp_, options)),
+        ipolicy_(options.filter_policy),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         next_file_number_(1) {
     // TableCache can be small since we expect each table to be opened once.
@@ -109,6 +111,7 @@ class Repairer {
   std::string const dbname_;
   Env* const env_;
   InternalKeyComparator const icmp_;
+  InternalFilterPolicy const ipolicy_;
   Options const options_;
   bool owns_info_log_;
   TableCache* table_cache_;
@@ -234,9 +237,13 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem.NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
-                        &meta, &skipped);
+    Iterator* range_del_iter = mem.NewRangeTombstoneIterator();
+    Options table_options = options_;
+    table_options.compression = CompressionForLevel(options_, 0);
+    status = BuildTable(dbname_, env_, table_options, table_cache_, iter,
+                        range_del_iter, &meta, &skipped);
     delete iter;
+    delete range_del_iter;
     if (status.ok()) {
       if (meta.file_size > 0) {
         table_numbers_.push_back(meta.number);
@@ -312,6 +319,37 @@ class Repairer {
         status = iter->status();
       }
       delete iter;
+
+      // Widen the key range to cover the table's range tombstones
+      iter = table_cache_->NewRangeTombstoneIterator(
+          ReadOptions(), t->meta.number);
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        RangeTombstone tombstone;
+        if (!ParseRangeTombstone(iter->key(), iter->value(), &tombstone)) {
+          Log(env_, options_.info_log, "Table #%llu: bad range tombstone",
+              (unsigned long long) t->meta.number);
+          continue;
+        }
+        InternalKey start, end;
+        start.DecodeFrom(iter->key());
+        end = InternalKey(tombstone.end, kMaxSequenceNumber,
+                          kTypeRangeDeletion);
+        if (empty || icmp_.Compare(start, t->meta.smallest) < 0) {
+          t->meta.smallest = start;
+        }
+        if (empty || icmp_.Compare(end, t->meta.largest) > 0) {
+          t->meta.largest = end;
+        }
+        empty = false;
+        t->meta.has_range_tombstones = true;
+        if (tombstone.sequence > t->max_sequence) {
+          t->max_sequence = tombstone.sequence;
+        }
+      }
+      if (status.ok() && !iter->status().ok()) {
+        status = iter->status();
+      }
+      delete iter;
     }
     Log(env_, options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long) t->meta.number,
@@ -344,7 +382,8 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size,
-                    t.meta.smallest, t.meta.largest);
+                    t.meta.smallest, t.meta.largest,
+                    t.meta.has_range_tombstones);
     }
 
     //fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -60,6 +60,12 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but may be called by several threads at once as long
+  // as no thread calls Insert() meanwhile.  Nodes are linked in with
+  // compare-and-swap and allocated with Arena::AllocateConcurrently().
+  // REQUIRES: nothing that compares equal to key is currently in the list.
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -127,8 +133,13 @@ class SkipList {
   // Read/written only by Insert().
   Random rnd_;
 
+  // Random seed of InsertConcurrently(), advanced with compare-and-swap
+  port::AtomicPointer concurrent_seed_;
+
   Node* NewNode(const Key& key, int height);
   int RandomHeight();
+  int RandomHeightConcurrently();
+  Node* NewNodeConcurrently(const Key& key, int height);
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -186,6 +197,12 @@ struct SkipList<Key,Comparator>::Node {
     next_[n].NoBarrier_Store(x);
   }
 
+  // Link in "x" at level "n" iff the successor there is still "expected".
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].CompareAndSwap(expected, x);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   //
@@ -283,6 +300,37 @@ int SkipList<Key,Comparator>::RandomHeight() {
   return height;
 }
 
+template<typename Key, class Comparator>
+int SkipList<Key,Comparator>::RandomHeightConcurrently() {
+  void* seed;
+  uint32_t r;
+  do {
+    seed = concurrent_seed_.NoBarrier_Load();
+    Random rnd(static_cast<uint32_t>(reinterpret_cast<uintptr_t>(seed)));
+    r = rnd.Next();
+  } while (!concurrent_seed_.CompareAndSwap(
+               seed, reinterpret_cast<void*>(static_cast<uintptr_t>(r))));
+
+  // Same distribution as RandomHeight(), spending two bits of the one
+  // draw per level
+  int height = 1;
+  while (height < kMaxHeight && (r & 3) == 0) {
+    height++;
+    r >>= 2;
+  }
+  assert(height > 0);
+  assert(height <= kMaxHeight);
+  return height;
+}
+
+template<typename Key, class Comparator>
+typename SkipList<Key,Comparator>::Node*
+SkipList<Key,Comparator>::NewNodeConcurrently(const Key& key, int height) {
+  char* mem = arena_->AllocateConcurrently(
+      sizeof(Node) + sizeof(port::AtomicPointer) * (height - 1));
+  return new (mem) Node(key);
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
   // NULL n is considered infinite
@@ -366,7 +414,8 @@ SkipList<Key,Comparator>::SkipList(Comparator cmp, Arena* arena)
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
       max_height_(reinterpret_cast<void*>(1)),
-      rnd_(0xdeadbeef) {
+      rnd_(0xdeadbeef),
+      concurrent_seed_(reinterpret_cast<void*>(0xdeadbeef)) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, NULL);
   }
@@ -414,6 +463,46 @@ void SkipList<Key,Comparator>::Insert(const Key& key) {
   }
 }
 
+template<typename Key, class Comparator>
+void SkipList<Key,Comparator>::InsertConcurrently(const Key& key) {
+  // Raise max_height_ first so that the search below fills in prev[]
+  // for every level of the new node.
+  const int height = RandomHeightConcurrently();
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.CompareAndSwap(reinterpret_cast<void*>(max_height),
+                                   reinterpret_cast<void*>(height))) {
+      break;
+    }
+    max_height = GetMaxHeight();
+  }
+
+  Node* prev[kMaxHeight];
+  Node* x = FindGreaterOrEqual(key, prev);
+
+  // Our data structure does not allow duplicate insertion
+  assert(x == NULL || !Equal(key, x->key));
+
+  // Link the node in bottom-up so that it is reachable through level 0
+  // before any higher level.  If another thread links a node in after
+  // prev[i] first, the CAS fails and we move forward from prev[i]; nodes
+  // are never removed, so prev[i] stays a valid starting point.
+  x = NewNodeConcurrently(key, height);
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      Node* next = prev[i]->Next(i);
+      if (KeyIsAfterNode(key, next)) {
+        prev[i] = next;
+        continue;
+      }
+      x->NoBarrier_SetNext(i, next);
+      if (prev[i]->CASNext(i, next, x)) {
+        break;
+      }
+    }
+  }
+}
+
 template<typename Key, class Comparator>
 bool SkipList<Key,Comparator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, NULL);
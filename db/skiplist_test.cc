@@ -371,6 +371,83 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads calling InsertConcurrently() on the same list.
+struct InsertState {
+  SkipList<Key, Comparator>* list;
+  int num_threads;
+  int keys_per_thread;
+  port::Mutex mu;
+  port::CondVar cv;
+  int running;
+
+  InsertState() : cv(&mu) { }
+};
+
+struct InsertThread {
+  InsertState* state;
+  int id;
+};
+
+static void ConcurrentInserter(void* arg) {
+  InsertThread* t = reinterpret_cast<InsertThread*>(arg);
+  InsertState* state = t->state;
+  // Interleave the keys of all threads so that they race for the same
+  // links; go backwards in every other thread.
+  for (int i = 0; i < state->keys_per_thread; i++) {
+    const int j = (t->id % 2 == 0) ? i : state->keys_per_thread - 1 - i;
+    state->list->InsertConcurrently(
+        static_cast<Key>(j) * state->num_threads + t->id);
+  }
+  state->mu.Lock();
+  if (--state->running == 0) {
+    state->cv.Signal();
+  }
+  state->mu.Unlock();
+}
+
+TEST(SkipTest, ConcurrentInsert) {
+  const int kThreads = 4;
+  const int kKeysPerThread = 20000;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  InsertState state;
+  state.list = &list;
+  state.num_threads = kThreads;
+  state.keys_per_thread = kKeysPerThread;
+  state.running = kThreads;
+  InsertThread threads[kThreads];
+  for (int id = 0; id < kThreads; id++) {
+    threads[id].state = &state;
+    threads[id].id = id;
+    Env::Default()->StartThread(ConcurrentInserter, &threads[id]);
+  }
+  state.mu.Lock();
+  while (state.running > 0) {
+    state.cv.Wait();
+  }
+  state.mu.Unlock();
+
+  // Every key is there exactly once, in order, at every level
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < kThreads * kKeysPerThread; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < kThreads * kKeysPerThread; k += 97) {
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    ASSERT_TRUE(list.Contains(k));
+  }
+  iter.SeekToLast();
+  ASSERT_EQ(kThreads * kKeysPerThread - 1, iter.key());
+}
+
 }
 
 int main(int argc, char** argv) {
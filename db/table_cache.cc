@@ -5,6 +5,7 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_del.h"
 #include "include/env.h"
 #include "include/table.h"
 #include "util/coding.h"
@@ -14,10 +15,13 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeTombstoneList* tombstones;   // NULL if the table has none
+  Status tombstone_status;          // Why tombstones is NULL if it has
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->tombstones;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -42,38 +46,60 @@ TableCache::~TableCache() {
   delete cache_;
 }
 
-Iterator* TableCache::NewIterator(const ReadOptions& options,
-                                  uint64_t file_number,
-                                  Table** tableptr) {
-  if (tableptr != NULL) {
-    *tableptr = NULL;
-  }
-
+Status TableCache::FindTable(uint64_t file_number, Cache::Handle** handle) {
+  Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
-  Cache::Handle* handle = cache_->Lookup(key);
-  if (handle == NULL) {
+  *handle = cache_->Lookup(key);
+  if (*handle == NULL) {
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = NULL;
     Table* table = NULL;
-    Status s = env_->NewRandomAccessFile(fname, &file);
+    s = env_->NewRandomAccessFile(fname, &file);
     if (s.ok()) {
       s = Table::Open(*options_, file, &table);
     }
+    // Reported by Get() only, so that the rest of the table stays
+    // readable, e.g. by Repairer.
+    RangeTombstoneList* tombstones = NULL;
+    Status tombstone_status;
+    if (s.ok() && table->HasRangeTombstones()) {
+      const Comparator* ucmp = static_cast<const InternalKeyComparator*>(
+          options_->comparator)->user_comparator();
+      Iterator* iter = table->NewRangeTombstoneIterator();
+      tombstone_status = RangeTombstoneList::Build(ucmp, iter, &tombstones);
+      delete iter;
+    }
 
     if (!s.ok()) {
       assert(table == NULL);
       delete file;
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
-      return NewErrorIterator(s);
+    } else {
+      TableAndFile* tf = new TableAndFile;
+      tf->file = file;
+      tf->table = table;
+      tf->tombstones = tombstones;
+      tf->tombstone_status = tombstone_status;
+      *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
+  }
+  return s;
+}
+
+Iterator* TableCache::NewIterator(const ReadOptions& options,
+                                  uint64_t file_number,
+                                  Table** tableptr) {
+  if (tableptr != NULL) {
+    *tableptr = NULL;
+  }
 
-    TableAndFile* tf = new TableAndFile;
-    tf->file = file;
-    tf->table = table;
-    handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
@@ -85,6 +111,46 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   return result;
 }
 
+Iterator* TableCache::NewRangeTombstoneIterator(const ReadOptions& options,
+                                                uint64_t file_number) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeTombstoneIterator();
+  result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  return result;
+}
+
+Status TableCache::Get(const ReadOptions& options,
+                       uint64_t file_number,
+                       const Slice& k,
+                       void* arg,
+                       void (*saver)(void*, const Slice&, const Slice&,
+                                     Iterator**),
+                       void (*handle_range_tombstones)(
+                           void*, const RangeTombstoneList&)) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, &handle);
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (handle_range_tombstones != NULL) {
+      s = tf->tombstone_status;
+      if (tf->tombstones != NULL) {
+        (*handle_range_tombstones)(arg, *tf->tombstones);
+      }
+    }
+    if (s.ok()) {
+      s = tf->table->InternalGet(options, k, arg, saver);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
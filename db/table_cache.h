@@ -17,6 +17,7 @@
 namespace leveldb {
 
 class Env;
+class RangeTombstoneList;
 
 
 /*
@@ -38,10 +39,32 @@ class TableCache {
                         uint64_t file_number,
                         Table** tableptr = NULL);
 
+  // Return an iterator over the range tombstones of the specified file.
+  Iterator* NewRangeTombstoneIterator(const ReadOptions& options,
+                                      uint64_t file_number);
+
+  // If a seek to internal key "k" in specified file finds an entry,
+  // call (*handle_result)(arg, found_key, found_value, block_iter); see
+  // Table::InternalGet() for "block_iter".  If the file
+  // holds range tombstones and "handle_range_tombstones" is non-NULL,
+  // first call (*handle_range_tombstones)(arg, tombstones), or give
+  // up if they could not be read.  The tombstones of a table are
+  // fragmented once, when it is opened.
+  Status Get(const ReadOptions& options,
+             uint64_t file_number,
+             const Slice& k,
+             void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&,
+                                   Iterator**),
+             void (*handle_range_tombstones)(
+                 void*, const RangeTombstoneList&) = NULL);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
+  Status FindTable(uint64_t file_number, Cache::Handle**);
+
   Env* const env_;
   const std::string dbname_;
   const Options* options_;
@@ -20,6 +20,8 @@ enum Tag {
   kDeletedFile          = 6,
   kNewFile              = 7,
   kLargeValueRef        = 8,
+  // Same as kNewFile, for a file that holds range tombstones
+  kNewRangeDelFile      = 9,
 };
 
 void VersionEdit::Clear() {
@@ -70,7 +72,7 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (int i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, f.has_range_tombstones ? kNewRangeDelFile : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
@@ -177,11 +179,13 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewRangeDelFile:
         if (GetLevel(&input, &level) &&
             GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_tombstones = (tag == kNewRangeDelFile);
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -264,6 +268,9 @@ std::string VersionEdit::DebugString() const {
     r.append("' .. '");
     AppendEscapedStringTo(&r, f.largest.Encode());
     r.append("'");
+    if (f.has_range_tombstones) {
+      r.append(" +rangedel");
+    }
   }
   for (int i = 0; i < large_refs_added_.size(); i++) {
     const VersionEdit::Large& l = large_refs_added_[i];
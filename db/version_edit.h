@@ -22,8 +22,12 @@ struct FileMetaData {
   uint64_t file_size;         // File size in bytes
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
+  bool being_compacted;       // Is an ongoing compaction reading this file?
+  bool has_range_tombstones;  // Does the table hold range tombstones?
 
-  FileMetaData() : refs(0), file_size(0) { }
+  FileMetaData()
+      : refs(0), file_size(0), being_compacted(false),
+        has_range_tombstones(false) { }
 };
 
 
@@ -61,12 +65,14 @@ class VersionEdit {
   void AddFile(int level, uint64_t file,
                uint64_t file_size,
                const InternalKey& smallest,
-               const InternalKey& largest) {
+               const InternalKey& largest,
+               bool has_range_tombstones) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_tombstones = has_range_tombstones;
     new_files_.push_back(std::make_pair(level, f));
   }
 
@@ -27,7 +27,8 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeLargeValueRef),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 i % 2 == 0);
     edit.DeleteFile(4, kBig + 700 + i);
     edit.AddLargeValueRef(LargeValueRef::Make("big", kNoCompression),
                           kBig + 800 + i, "foobar");
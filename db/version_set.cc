@@ -10,6 +10,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_del.h"
 #include "db/table_cache.h"
 #include "include/env.h"
 #include "include/table_builder.h"
@@ -54,6 +55,27 @@ std::string IntSetToString(const std::set<uint64_t>& s) {
 }
 }
 
+int FindFile(const InternalKeyComparator& icmp,
+             const std::vector<FileMetaData*>& files,
+             const Slice& key) {
+  uint32_t left = 0;
+  uint32_t right = files.size();
+  while (left < right) {
+    uint32_t mid = (left + right) / 2;
+    const FileMetaData* f = files[mid];
+    if (icmp.Compare(f->largest.Encode(), key) < 0) {
+      // Key at "mid.largest" is < "target".  Therefore all
+      // files at or before "mid" are uninteresting.
+      left = mid + 1;
+    } else {
+      // Key at "mid.largest" is >= "target".  Therefore all files
+      // after "mid" are uninteresting.
+      right = mid;
+    }
+  }
+  return right;
+}
+
 Version::~Version() {
   assert(refs_ == 0);
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -181,6 +203,225 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+Status Version::AddRangeTombstones(const ReadOptions& options,
+                                  RangeDelAggregator* range_del) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      if (!files_[level][i]->has_range_tombstones) {
+        continue;   // Do not open tables just to find no tombstones
+      }
+      Iterator* iter = vset_->table_cache_->NewRangeTombstoneIterator(
+          options, files_[level][i]->number);
+      s = range_del->AddTombstones(iter);
+      delete iter;
+    }
+  }
+  return s;
+}
+
+// Callback from TableCache::Get()
+namespace {
+enum SaverState {
+  kNotFound,
+  kFound,
+  kCorrupt,
+  kMerge,
+};
+struct Saver {
+  SaverState state;
+  const Comparator* ucmp;
+  Slice user_key;
+  SequenceNumber snapshot;
+  SequenceNumber* max_covering_tombstone;
+  ValueType type;
+  std::string* value;
+  PinnableSlice* pinned;    // Pin plain values here if non-NULL
+};
+}
+static void SaveRangeTombstones(void* arg,
+                                const RangeTombstoneList& tombstones) {
+  Saver* s = reinterpret_cast<Saver*>(arg);
+  const SequenceNumber seq =
+      tombstones.MaxCoveringSequence(s->user_key, s->snapshot);
+  if (seq > *s->max_covering_tombstone) {
+    *s->max_covering_tombstone = seq;
+  }
+}
+static void DeleteIterator(void* arg1, void* arg2) {
+  delete reinterpret_cast<Iterator*>(arg1);
+}
+
+static void SaveValue(void* arg, const Slice& ikey, const Slice& v,
+                      Iterator** block_iter) {
+  Saver* s = reinterpret_cast<Saver*>(arg);
+  ParsedInternalKey parsed_key;
+  if (!ParseInternalKey(ikey, &parsed_key)) {
+    s->state = kCorrupt;
+  } else if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+    if (parsed_key.sequence < *s->max_covering_tombstone) {
+      s->state = kFound;
+      s->type = kTypeDeletion;  // Deleted by a range tombstone
+      return;
+    }
+    if (parsed_key.type == kTypeMerge) {
+      // Older entries in the same file are needed too; see
+      // Version::Get().
+      s->state = kMerge;
+      return;
+    }
+    s->state = kFound;
+    s->type = parsed_key.type;
+    if (s->type == kTypeValue && s->pinned != NULL) {
+      // The block iterator keeps the block holding "v" alive
+      s->pinned->PinSlice(v, &DeleteIterator, *block_iter, NULL);
+      *block_iter = NULL;
+    } else if (s->type != kTypeDeletion) {
+      s->value->assign(v.data(), v.size());
+    }
+  }
+}
+
+static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  return a->number > b->number;
+}
+
+// Walk the entries for the user key of "ikey" in table "file_number",
+// starting at "ikey", appending merge operands to *merge_operands
+// until an entry of another type is found.  Stores that entry in
+// *saver and sets its state to kFound, or leaves the state kNotFound
+// if the file holds nothing but operands for the key.
+static Status CollectMergeOperands(TableCache* table_cache,
+                                   const ReadOptions& options,
+                                   uint64_t file_number,
+                                   const Slice& ikey,
+                                   Saver* saver,
+                                   std::vector<std::string>* merge_operands) {
+  saver->state = kNotFound;
+  Iterator* iter = table_cache->NewIterator(options, file_number);
+  for (iter->Seek(ikey); iter->Valid(); iter->Next()) {
+    ParsedInternalKey parsed_key;
+    if (!ParseInternalKey(iter->key(), &parsed_key)) {
+      saver->state = kCorrupt;
+      break;
+    }
+    if (saver->ucmp->Compare(parsed_key.user_key, saver->user_key) != 0) {
+      break;
+    }
+    if (parsed_key.sequence < *saver->max_covering_tombstone) {
+      saver->state = kFound;
+      saver->type = kTypeDeletion;
+      break;
+    }
+    if (parsed_key.type == kTypeMerge) {
+      merge_operands->push_back(iter->value().ToString());
+      continue;
+    }
+    saver->state = kFound;
+    saver->type = parsed_key.type;
+    if (saver->type != kTypeDeletion) {
+      saver->value->assign(iter->value().data(), iter->value().size());
+    }
+    break;
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+Status Version::Get(const ReadOptions& options,
+                    const LookupKey& k,
+                    ValueType* type,
+                    std::string* value,
+                    std::vector<std::string>* merge_operands,
+                    SequenceNumber* max_covering_tombstone,
+                    PinnableSlice* pinned) {
+  Slice ikey = k.internal_key();
+  Slice user_key = k.user_key();
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  Status s;
+
+  std::vector<FileMetaData*> tmp;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    size_t num_files = files_[level].size();
+    if (num_files == 0) continue;
+
+    // Get the list of files to search in this level
+    FileMetaData* const* files = &files_[level][0];
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Find all files that
+      // overlap user_key and process them in order from newest to oldest.
+      tmp.clear();
+      for (size_t i = 0; i < num_files; i++) {
+        FileMetaData* f = files[i];
+        if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+            ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+          tmp.push_back(f);
+        }
+      }
+      if (tmp.empty()) continue;
+
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      files = &tmp[0];
+      num_files = tmp.size();
+    } else {
+      // Binary search to find earliest index whose largest key >= ikey.
+      uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
+      if (index >= num_files) {
+        files = NULL;
+        num_files = 0;
+      } else {
+        FileMetaData* f = files[index];
+        if (ucmp->Compare(user_key, f->smallest.user_key()) < 0) {
+          // All of "f" is past any data for user_key
+          files = NULL;
+          num_files = 0;
+        } else {
+          files = &files[index];
+          num_files = 1;
+        }
+      }
+    }
+
+    for (size_t i = 0; i < num_files; ++i) {
+      FileMetaData* f = files[i];
+      Saver saver;
+      saver.state = kNotFound;
+      saver.ucmp = ucmp;
+      saver.user_key = user_key;
+      saver.snapshot = k.sequence();
+      saver.max_covering_tombstone = max_covering_tombstone;
+      saver.value = value;
+      // Merge operands have to be applied to a copy
+      saver.pinned = merge_operands->empty() ? pinned : NULL;
+      s = vset_->table_cache_->Get(options, f->number,
+                                   ikey, &saver, SaveValue,
+                                   SaveRangeTombstones);
+      if (s.ok() && saver.state == kMerge) {
+        s = CollectMergeOperands(vset_->table_cache_, options, f->number,
+                                 ikey, &saver, merge_operands);
+      }
+      if (!s.ok()) {
+        return s;
+      }
+      switch (saver.state) {
+        case kNotFound:
+          break;      // Keep searching in other files
+        case kFound:
+          *type = saver.type;
+          return s;
+        case kCorrupt:
+          return Status::Corruption("corrupted key for ", user_key);
+        case kMerge:
+          assert(false);  // Resolved by CollectMergeOperands()
+          break;
+      }
+    }
+  }
+
+  return Status::NotFound(Slice());  // Use an empty error message for speed
+}
+
 void Version::Ref() {
   ++refs_;
 }
@@ -604,6 +845,7 @@ Status VersionSet::Finalize(Version* v) {
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
+  uint64_t pending_bytes = 0;
 
   Status s;
   for (int level = 0; s.ok() && level < config::kNumLevels; level++) {
@@ -630,7 +872,8 @@ Status VersionSet::Finalize(Version* v) {
       // too many level-0 files increase merging costs. 按我理解, 根据程序局部性原理, 大多数读取操作将落在
       // 内存中的 memtable 或者 level 0 中, 如果 level 0 文件数目过多, 那么很显然将导致这些读取操作延迟增加.
       // 毕竟当读取操作落在 level 0 文件中时, 会不得不遍历相当多 level 0 文件来查找结果.
-      double count_score = v->files_[level].size() / 4.0;
+      double count_score = v->files_[level].size() /
+          static_cast<double>(config::kL0_CompactionTrigger);
       if (count_score > score) {
         score = count_score;
       }
@@ -638,6 +881,25 @@ Status VersionSet::Finalize(Version* v) {
       // 0. 原文实现的较为温和.
     }
 
+    // Estimate the work needed to bring this level back under its
+    // limit: every byte pushed down is merged with about ten bytes of
+    // the next level.  A level-0 compaction takes all of level-0 and
+    // rewrites the overlapping part of level-1, which is usually all
+    // of it.
+    if (level == 0) {
+      if (v->files_[0].size() >= config::kL0_CompactionTrigger) {
+        pending_bytes += level_bytes;
+        for (int i = 0; i < v->files_[1].size(); i++) {
+          pending_bytes += v->files_[1][i]->file_size;
+        }
+      }
+    } else if (level_bytes > MaxBytesForLevel(level) &&
+               level + 1 < config::kNumLevels) {
+      pending_bytes += static_cast<uint64_t>(
+          (level_bytes - MaxBytesForLevel(level)) * 11);
+    }
+
+    v->level_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -646,6 +908,7 @@ Status VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+  v->pending_compaction_bytes_ = pending_bytes;
   return s;
 }
 
@@ -670,7 +933,8 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (int i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->has_range_tombstones);
     }
   }
 
@@ -731,6 +995,16 @@ int VersionSet::NumLevelFiles(int level) const {
   return current_->files_[level].size();
 }
 
+int64_t VersionSet::NumLevelBytes(int level) const {
+  assert(level >= 0);
+  assert(level < config::kNumLevels);
+  int64_t sum = 0;
+  for (size_t i = 0; i < current_->files_[level].size(); i++) {
+    sum += current_->files_[level][i]->file_size;
+  }
+  return sum;
+}
+
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   uint64_t result = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -796,7 +1070,8 @@ bool VersionSet::RegisterLargeValueRef(const LargeValueRef& large_ref,
 }
 
 void VersionSet::CleanupLargeValueRefs(const std::set<uint64_t>& live_tables,
-                                       uint64_t log_file_num) {
+                                       uint64_t log_file_num,
+                                       uint64_t prev_log_file_num) {
   for (LargeValueMap::iterator it = large_value_refs_.begin();
        it != large_value_refs_.end();
        ) {
@@ -805,6 +1080,7 @@ void VersionSet::CleanupLargeValueRefs(const std::set<uint64_t>& live_tables,
          ref_it != refs->end();
          ) {
       if (ref_it->first != log_file_num &&              // Not in log file
+          ref_it->first != prev_log_file_num &&         // Not in prev log
           live_tables.count(ref_it->first) == 0) {      // Not in a live table
         // No longer live: erase
         LargeReferencesSet::iterator to_erase = ref_it;
@@ -957,35 +1233,199 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (int i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int VersionSet::PickLevelForIngestedFile(const Slice& smallest_user_key,
+                                         const Slice& largest_user_key) {
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
+  std::vector<FileMetaData*> overlaps;
+  int level = 0;
+  while (level < config::kNumLevels) {
+    GetOverlappingInputs(level, start, limit, &overlaps);
+    if (!overlaps.empty()) break;
+    level++;
+  }
+
+  // The file has to sit above the older data it overlaps.  Level-0 files
+  // may overlap each other and newer ones are read first.
+  level = (level > 0) ? level - 1 : 0;
+
+  // Do not land next to the output of a running compaction
+  while (level > 0 && OverlapsRunningCompaction(level - 1, start, limit)) {
+    level--;
+  }
+  return level;
+}
+
+bool VersionSet::OverlapsFilesAfter(uint64_t number,
+                                    const Slice& smallest_user_key,
+                                    const Slice& largest_user_key) const {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      const FileMetaData* f = files[i];
+      if (f->number > number &&
+          user_cmp->Compare(f->smallest.user_key(), largest_user_key) <= 0 &&
+          user_cmp->Compare(f->largest.user_key(), smallest_user_key) >= 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int VersionSet::AddFileDeletionsInRange(const Slice& begin,
+                                        const Slice& end,
+                                        VersionEdit* edit) {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  int deleted = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (f->being_compacted ||
+          user_cmp->Compare(f->smallest.user_key(), begin) < 0 ||
+          user_cmp->Compare(f->largest.user_key(), end) > 0) {
+        continue;
+      }
+      edit->DeleteFile(level, f->number);
+      deleted++;
+    }
+  }
+  return deleted;
+}
+
+bool VersionSet::OverlapsRunningCompaction(int level,
+                                           const InternalKey& smallest,
+                                           const InternalKey& largest) const {
+  const Comparator* user_cmp = icmp_.user_comparator();
+  for (std::set<Compaction*>::const_iterator it =
+           compactions_in_progress_.begin();
+       it != compactions_in_progress_.end(); ++it) {
+    const Compaction* c = *it;
+    if (c->level() == level &&
+        user_cmp->Compare(smallest.user_key(), c->largest_.user_key()) <= 0 &&
+        user_cmp->Compare(largest.user_key(), c->smallest_.user_key()) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VersionSet::RegisterCompaction(Compaction* c) {
+  assert(!c->registered_);
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->inputs_[which].size(); i++) {
+      assert(!c->inputs_[which][i]->being_compacted);
+      c->inputs_[which][i]->being_compacted = true;
+    }
+  }
+  compactions_in_progress_.insert(c);
+  c->registered_ = true;
+}
+
+void VersionSet::UnregisterCompaction(Compaction* c) {
+  assert(c->registered_);
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->inputs_[which].size(); i++) {
+      c->inputs_[which][i]->being_compacted = false;
+    }
+  }
+  compactions_in_progress_.erase(c);
+  c->registered_ = false;
+}
+
 Compaction* VersionSet::PickCompaction() {
   if (!NeedsCompaction()) {
     return NULL;
   }
-  const int level = current_->compaction_level_;
-  assert(level >= 0);
 
-  Compaction* c = new Compaction(level);
-  c->input_version_ = current_;
-  c->input_version_->Ref();
+  // Try the levels that need a compaction in decreasing order of score.
+  // A level is skipped if every candidate conflicts with an ongoing
+  // compaction.
+  int order[config::kNumLevels];
+  for (int level = 0; level < config::kNumLevels; level++) {
+    order[level] = level;
+  }
+  for (int i = 1; i < config::kNumLevels; i++) {
+    for (int j = i; j > 0 && (current_->level_scores_[order[j]] >
+                              current_->level_scores_[order[j-1]]); j--) {
+      std::swap(order[j], order[j-1]);
+    }
+  }
 
-  // Pick the first file that comes after compact_pointer_[level]
-  for (int i = 0; i < current_->files_[level].size(); i++) {
-    FileMetaData* f = current_->files_[level][i];
-    if (compact_pointer_[level].empty() ||
-        // QA: compact_pointer_ 是如何更新的? 为啥选择 f->largest 来比较, 而不是 smallest?
-        // A: compact_pointer_ 如何更新, 见下. 按我理解这里也可以使用 f->smallest 来更新, 因为可以根据
-        // 下面的代码流程结合反证法证明出:
-        // 不会存在 f, 使得 compact_pointer_[level] 落在 f.smallest, f.largest 之间.
-        // 所以可以得出当 f.largest > compact_pointer[level] 时, f.smallest 也大于 compact ponter level.
-        icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-      c->inputs_[0].push_back(f);
-      break;
+  bool level0_running = false;
+  for (std::set<Compaction*>::const_iterator it =
+           compactions_in_progress_.begin();
+       it != compactions_in_progress_.end(); ++it) {
+    if ((*it)->level() == 0) {
+      level0_running = true;
     }
   }
-  if (c->inputs_[0].empty()) {
-    // Wrap-around to the beginning of the key space
-    c->inputs_[0].push_back(current_->files_[level][0]);
+
+  for (int i = 0; i < config::kNumLevels; i++) {
+    const int level = order[i];
+    if (current_->level_scores_[level] < 1) {
+      break;
+    }
+    if (level == 0 && level0_running) {
+      // Level-0 files overlap each other, so a second level-0 compaction
+      // could reorder versions of a key.
+      continue;
+    }
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    if (files.empty()) {
+      continue;
+    }
+
+    // Pick the first file that comes after compact_pointer_[level]
+    int start = 0;
+    for (int k = 0; k < files.size(); k++) {
+      FileMetaData* f = files[k];
+      if (compact_pointer_[level].empty() ||
+          // QA: compact_pointer_ 是如何更新的? 为啥选择 f->largest 来比较, 而不是 smallest?
+          // A: compact_pointer_ 如何更新, 见下. 按我理解这里也可以使用 f->smallest 来更新, 因为可以根据
+          // 下面的代码流程结合反证法证明出:
+          // 不会存在 f, 使得 compact_pointer_[level] 落在 f.smallest, f.largest 之间.
+          // 所以可以得出当 f.largest > compact_pointer[level] 时, f.smallest 也大于 compact ponter level.
+          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
+        start = k;
+        break;
+      }
+    }
+    // If no file comes after the pointer, start == 0 wraps around to the
+    // beginning of the key space.
+
+    // Files read by ongoing compactions are skipped; try the following
+    // ones in key order.
+    for (int k = 0; k < files.size(); k++) {
+      FileMetaData* f = files[(start + k) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = SetupCompaction(level, f);
+      if (c != NULL) {
+        return c;
+      }
+    }
   }
+  return NULL;
+}
+
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* f) {
+  Compaction* c = new Compaction(level);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].push_back(f);
 
   // Find the range we are compacting
   InternalKey smallest, largest;
@@ -1003,6 +1443,10 @@ Compaction* VersionSet::PickCompaction() {
   }
 
   GetOverlappingInputs(level+1, smallest, largest, &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    delete c;
+    return NULL;
+  }
 
   // See if we can grow the number of inputs in "level" without
   // changing the number of "level+1" files we pick up.
@@ -1023,7 +1467,8 @@ Compaction* VersionSet::PickCompaction() {
     // 此时 expanded0.size() >= inputs[0].size(), 并且当 expanded0.size() == inputs[0].size() 时,
     // expanded0 == inputs[0]. 这是因为 [allstart, alllimit] 包括了 [smallest, largest], 所以
     // inputs[0] 是 expanded0 的子集.
-    if (expanded0.size() > c->inputs_[0].size()) {
+    if (expanded0.size() > c->inputs_[0].size() &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1052,6 +1497,17 @@ Compaction* VersionSet::PickCompaction() {
         EscapeString(largest.Encode()).c_str());
   }
 
+  // The outputs go to level+1 and fall in the range of all inputs; they
+  // must not interleave with what another compaction is writing there.
+  std::vector<FileMetaData*> all = c->inputs_[0];
+  all.insert(all.end(), c->inputs_[1].begin(), c->inputs_[1].end());
+  GetRange(all, &c->smallest_, &c->largest_);
+  if (OverlapsRunningCompaction(level, c->smallest_, c->largest_)) {
+    delete c;
+    return NULL;
+  }
+  RegisterCompaction(c);
+
   // Update the place where we will do the next compaction for this level.
   // We update this immediately instead of waiting for the VersionEdit
   // to be applied so that if the compaction fails, we will try a different
@@ -1086,6 +1542,15 @@ Compaction* VersionSet::CompactRange(
   GetRange(c->inputs_[0], &smallest, &largest);
 
   GetOverlappingInputs(level+1, smallest, largest, &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    // The caller is expected to wait for background compactions first
+    delete c;
+    return NULL;
+  }
+  std::vector<FileMetaData*> all = c->inputs_[0];
+  all.insert(all.end(), c->inputs_[1].begin(), c->inputs_[1].end());
+  GetRange(all, &c->smallest_, &c->largest_);
+  RegisterCompaction(c);
   if (false) {
     Log(env_, options_->info_log, "Compacting %d '%s' .. '%s'",
         level,
@@ -1100,17 +1565,12 @@ Compaction::Compaction(int level)
       // 我觉得 max_output_file_size_ 应该初始化 MaxFileSizeForLevel(level + 1) 吧, 毕竟输出的是
       // level + 1 层的文件.
       max_output_file_size_(MaxFileSizeForLevel(level)),
-      input_version_(NULL) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;  // QA: 由于不知道 level_ptrs_ 干啥的, 所以也不知道这里为啥这样.
-    // A: 现在我终于知道了哈哈
-  }
+      input_version_(NULL),
+      registered_(false) {
 }
 
 Compaction::~Compaction() {
-  if (input_version_ != NULL) {
-    input_version_->Unref();
-  }
+  ReleaseInputs();
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
@@ -1121,13 +1581,14 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   int* level_ptrs) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    for (; level_ptrs[lvl] < files.size(); ) {
+      FileMetaData* f = files[level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1138,22 +1599,69 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
           // 来判断 f 中是否真的存在 user_key, 但是原文很显然并没有这么做.
           return false;
         } /* else {
-            user_key < f->smallest.user_key(); 此时不需要继续往下遍历了, 而且也不需要更新 level_ptrs_[lvl].
+            user_key < f->smallest.user_key(); 此时不需要继续往下遍历了, 而且也不需要更新 level_ptrs[lvl].
             所以 break.
         } */
         break;
       } /* else {
-        f->largest < user_key, 所以应该更新 level_ptrs_[lvl] 的值, 就像下面一样.
+        f->largest < user_key, 所以应该更新 level_ptrs[lvl] 的值, 就像下面一样.
       }*/
-      level_ptrs_[lvl]++;
+      level_ptrs[lvl]++;
     }
   }
-  // 这时候我们可以确认 user_key 不再高层存在, 而且我们还更新 level_ptrs_.
+  // 这时候我们可以确认 user_key 不再高层存在, 而且我们还更新 level_ptrs.
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin,
+                                     const Slice& end) const {
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
+      if (user_cmp->Compare(f->smallest.user_key(), end) < 0 &&
+          user_cmp->Compare(f->largest.user_key(), begin) >= 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void Compaction::GetSubcompactionBoundaries(
+    int max_pieces,
+    std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  // Level-0 files overlap each other, so their boundaries say little
+  // about how the data is spread.
+  const int which = (inputs_[1].size() >= 2 || level_ == 0) ? 1 : 0;
+  const std::vector<FileMetaData*>& files = inputs_[which];
+  const int num_files = files.size();
+  const int pieces = std::min(max_pieces, num_files);
+  if (pieces <= 1) {
+    return;
+  }
+
+  // "files" is sorted and non-overlapping, so the largest keys of the
+  // files are increasing.  Cut after every (num_files/pieces)th file.
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  for (int i = 1; i < pieces; i++) {
+    const Slice key = files[i * num_files / pieces - 1]->largest.user_key();
+    if (boundaries->empty() ||
+        user_cmp->Compare(key, Slice(boundaries->back())) > 0) {
+      boundaries->push_back(key.ToString());
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
+    // The input files are only guaranteed to be alive while
+    // input_version_ is referenced.
+    if (registered_) {
+      input_version_->vset_->UnregisterCompaction(this);
+    }
     input_version_->Unref();
     input_version_ = NULL;
   }
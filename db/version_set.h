@@ -20,6 +20,7 @@
 #include <vector>
 #include "db/dbformat.h"
 #include "db/version_edit.h"
+#include "include/pinnable_slice.h"
 #include "port/port.h"
 
 namespace leveldb {
@@ -28,6 +29,9 @@ namespace leveldb {
 // parameters set via options.
 namespace config {
 static const int kNumLevels = 7;
+
+// Level-0 compaction is started when we hit this many files.
+static const int kL0_CompactionTrigger = 4;
 }
 
 namespace log { class Writer; }
@@ -35,12 +39,19 @@ namespace log { class Writer; }
 class Compaction;
 class Iterator;
 class MemTable;
+class RangeDelAggregator;
 class TableBuilder;
 class TableCache;
 class Version;
 class VersionSet;
 class WritableFile;
 
+// Return the smallest index i such that files[i]->largest >= key.
+// Return files.size() if there is no such file.
+// REQUIRES: "files" contains a sorted list of non-overlapping files.
+extern int FindFile(const InternalKeyComparator& icmp,
+                    const std::vector<FileMetaData*>& files,
+                    const Slice& key);
 
 // Version, 参见 version.README.md
 class Version {
@@ -58,6 +69,26 @@ class Version {
    */
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of every file of this Version to
+  // *range_del.  Opens every table that is not in the table cache yet.
+  Status AddRangeTombstones(const ReadOptions&, RangeDelAggregator* range_del);
+
+  // Lookup the value for key.  If found, store the type of the newest
+  // entry for key in *type and, unless it is a deletion, its value in
+  // *val, and return OK.  Else return a non-OK status.  Only the files
+  // whose key range covers key are probed, newest first.  Merge
+  // operands met on the way are appended to *merge_operands, newest
+  // first; see MemTable::Get().  Range tombstones of the probed files
+  // raise *max_covering_tombstone as they do in MemTable::Get().
+  // If "pinned" is non-NULL and a plain value is found with no merge
+  // operands to apply, *pinned points at the value in its data block
+  // instead of copying it into *val.
+  // REQUIRES: lock is not held
+  Status Get(const ReadOptions&, const LookupKey& key, ValueType* type,
+             std::string* val, std::vector<std::string>* merge_operands,
+             SequenceNumber* max_covering_tombstone,
+             PinnableSlice* pinned = NULL);
+
   // Reference count management (so Versions do not disappear out from
   // under live iterators)
   /* 按我理解, Version 依附于 VersionSet, VersionSet 负责 Version 的分配构造以及析构回收.
@@ -112,11 +143,23 @@ class Version {
   double compaction_score_;
   int compaction_level_;
 
+  // Compaction score of every level, also computed by Finalize().  Used
+  // to fall back to other levels when the best one is busy.
+  double level_scores_[config::kNumLevels];
+
+  // Estimated bytes to compact until no level is over its limit.
+  // Computed by Finalize().
+  uint64_t pending_compaction_bytes_;
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(NULL), refs_(0),
         cleanup_mem_(NULL),
         compaction_score_(-1),
-        compaction_level_(-1) {
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      level_scores_[level] = -1;
+    }
   }
 
   ~Version();
@@ -169,10 +212,45 @@ class VersionSet {
   // Return the number of Table files at the specified level. 基于 current version.
   int NumLevelFiles(int level) const;
 
+  // Return the combined file size of the specified level.
+  int64_t NumLevelBytes(int level) const;
+
+  // Return the level at which to add a file holding user keys
+  // [smallest_user_key,largest_user_key] that are newer than any data
+  // already in the DB: the deepest level above every level with an
+  // overlapping file that no running compaction writes into.
+  int PickLevelForIngestedFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
+  // Return true iff a file of the current version numbered above
+  // "number" overlaps user keys [smallest_user_key,largest_user_key].
+  bool OverlapsFilesAfter(uint64_t number,
+                          const Slice& smallest_user_key,
+                          const Slice& largest_user_key) const;
+
+  // Record in *edit the deletion of every file of the current version
+  // whose key range lies entirely within user keys [begin,end] and
+  // that no running compaction reads.  Returns the number of files
+  // recorded.
+  int AddFileDeletionsInRange(const Slice& begin, const Slice& end,
+                              VersionEdit* edit);
+
+  // Return an estimate of the bytes compactions have to rewrite before
+  // every level of the current version is back under its size limit.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Pick level and inputs for a new compaction.
   // Returns NULL if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  //
+  // Several compactions may be in progress at once.  Files read by an
+  // ongoing compaction are never picked again, and a new compaction is
+  // only returned if its key range does not overlap the range another
+  // ongoing compaction is writing into the same output level.  At most
+  // one level-0 compaction runs at a time since level-0 files overlap.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
@@ -196,6 +274,12 @@ class VersionSet {
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const { return current_->compaction_score_ >= 1; }
 
+  // Return the number of compactions returned by PickCompaction() or
+  // CompactRange() whose inputs have not been released yet.
+  int NumRunningCompactions() const {
+    return compactions_in_progress_.size();
+  }
+
   // Add all files listed in any live version to *live.
   // May also mutate some internal state.
   // 根据实现, 目前是把 VersionSet 中所有 version, 所有 file 都 add 到 *live 中. 并且貌似没有更改 internal
@@ -221,12 +305,14 @@ class VersionSet {
                              const InternalKey& internal_key);
 
   // Cleanup the large value reference state by eliminating any
-  // references from files that are not includes in either "live_tables"
-  // or "log_file".
+  // references from files that are not includes in either "live_tables",
+  // "log_file" or "prev_log_file" (the log of a memtable that is still
+  // being compacted, 0 if none).
   // 根据 impl 文档, 当 large value ref 不被 live tables, log file 引用时, 那么这个 large value 就可以被
   // 安全删除掉了.
   void CleanupLargeValueRefs(const std::set<uint64_t>& live_tables,
-                             uint64_t log_file_num);
+                             uint64_t log_file_num,
+                             uint64_t prev_log_file_num);
 
   // Returns true if a large value with the given reference is live.
   bool LargeValueIsLive(const LargeValueRef& large_ref);
@@ -257,6 +343,21 @@ class VersionSet {
                 InternalKey* smallest,
                 InternalKey* largest);
 
+  // Build a compaction of "level" that starts from file "f", or return
+  // NULL if it would conflict with an ongoing compaction.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+
+  // Returns true iff [smallest,largest] overlaps the key range of an
+  // ongoing compaction from "level" into "level+1".
+  bool OverlapsRunningCompaction(int level,
+                                 const InternalKey& smallest,
+                                 const InternalKey& largest) const;
+
+  // Mark the inputs of "c" as being compacted and track "c" until
+  // Compaction::ReleaseInputs() is called.
+  void RegisterCompaction(Compaction* c);
+  void UnregisterCompaction(Compaction* c);
+
   Env* const env_;
   const std::string dbname_;
   const Options* const options_;
@@ -297,6 +398,9 @@ class VersionSet {
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
 
+  // Compactions whose inputs are still marked as being compacted.
+  std::set<Compaction*> compactions_in_progress_;
+
   // No copying allowed
   VersionSet(const VersionSet&);
   void operator=(const VersionSet&);
@@ -336,10 +440,40 @@ class Compaction {
   /* 当返回 true 时, 表明在任何 level( > L + 1) 层不再存在 user_key. 若返回 false, 则表明**可能**存在.
    * 关于 IsBaseLevelForKey 的使用场景, 参考 DoCompactionWork().
    */
-  bool IsBaseLevelForKey(const Slice& user_key);
+  //
+  // "level_ptrs" holds the scan state, an array of config::kNumLevels
+  // ints that must start out as zero: for each level L >= level()+2 we
+  // are positioned at one of the file ranges of L.  Successive calls that
+  // share "level_ptrs" must pass increasing user keys.  Calls with
+  // different "level_ptrs" may run concurrently.
+  /* 之所以 level_ptrs 存在, 是因为外界总是按照 ukey 从小到大的顺序调用 IsBaseLevelForKey():
+   * IsBaseLevelForKey(ukey1), IsBaseLevelForKey(ukey2), ... 此时 ukey1 < ukey2. 所以如果我们在
+   * IsBaseLevelForKey(ukey1) 时发现 input_version_->files_[level][idx].largest < ukey1, 那么在
+   * IsBaseLevelForKey(ukey2) 时, 我们总是可以跳过 idx, 而从 input_version_->files_[level][idx + 1]
+   * 开始搜索起.
+   */
+  bool IsBaseLevelForKey(const Slice& user_key, int* level_ptrs) const;
+
+  // Returns true if no file in a level greater than "level+1" overlaps
+  // the user key range [begin,end), so that a range tombstone over it
+  // has nothing left to delete once written to "level+1".
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end) const;
+
+  // Store in *boundaries at most "max_pieces"-1 user keys, in increasing
+  // order, that split the key range of this compaction into pieces of
+  // roughly the same number of input files.  Piece i holds the user keys
+  // in (boundaries[i-1], boundaries[i]].  The split points are taken from
+  // the file boundaries of the "level+1" inputs, or of the "level" inputs
+  // for a compaction that reads a single "level+1" file.  Leaves
+  // *boundaries empty if the compaction should not be split.
+  void GetSubcompactionBoundaries(int max_pieces,
+                                  std::vector<std::string>* boundaries) const;
 
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also clears the being_compacted mark of the inputs
+  // so that other compactions may pick them.  Called by the destructor
+  // if the compaction did not succeed.
+  // REQUIRES: external synchronization, as for the VersionSet
   void ReleaseInputs();
 
  private:
@@ -365,22 +499,11 @@ class Compaction {
   // 的处理, 所以 input_version 各个 level 都符合 flist 的参数说明.
   std::vector<FileMetaData*> inputs_[2];      // The two sets of inputs
 
-  // State for implementing IsBaseLevelForKey
-
-  // QA: 这里 input_version_->levels_ 应该是指 input_version_->files_
-  // 这个变量干啥用的啊?
-  // A: 指定了在 IsBaseLevelForKey(ukey) 中, 在各个 level(level >= level_ + 2)上搜索 ukey 是否可能存在时
-  // 的搜索起点, 即搜索将从下标 level_ptrs_[level] 开始, 而不总是从 0 开始. 之所以存在该变量的原因是因为外界
-  // (目测就 DoCompactionWork() 一个调用者)总是按照 ukey 从小到大的顺序调用 IsBaseLevelForKey():
-  // IsBaseLevelForKey(ukey1), IsBaseLevelForKey(ukey2), ... 此时 ukey1 < ukey2. 所以如果我们在
-  // IsBaseLevelForKey(ukey1) 时发现 input_version_->files_[level][idx].largest < ukey1, 那么在
-  // IsBaseLevelForKey(ukey2) 时, 我们总是可以跳过 idx, 而从 input_version_->files_[level][idx + 1]
-  // 开始搜索起. 所以 level_ptrs_ 就保存着这么个信息, 每次调用 IsBaseLevelForKey() 都会更新 level_ptrs_.
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  int level_ptrs_[config::kNumLevels];
+  // Range of user keys covered by inputs_[0] and inputs_[1]; the outputs
+  // of the compaction fall in this range too.
+  InternalKey smallest_;
+  InternalKey largest_;
+  bool registered_;  // Is this in vset's compactions_in_progress_?
 };
 
 }
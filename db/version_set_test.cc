@@ -0,0 +1,230 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/version_set.h"
+
+#include "db/table_cache.h"
+#include "include/db.h"
+#include "include/env.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+class VersionSetTest {
+ public:
+  std::string dbname_;
+  Env* env_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  TableCache* table_cache_;
+  VersionSet* vset_;
+
+  VersionSetTest()
+      : env_(Env::Default()),
+        icmp_(BytewiseComparator()) {
+    dbname_ = test::TmpDir() + "/version_set_test";
+    DestroyDB(dbname_, Options());
+
+    // Let DB::Open create the initial descriptor
+    options_.create_if_missing = true;
+    DB* db = NULL;
+    ASSERT_OK(DB::Open(options_, dbname_, &db));
+    delete db;
+
+    options_.comparator = &icmp_;
+    ASSERT_OK(env_->NewWritableFile(dbname_ + "/test.log",
+                                    &options_.info_log));
+    table_cache_ = new TableCache(dbname_, &options_, 100);
+    vset_ = new VersionSet(dbname_, &options_, table_cache_, &icmp_);
+    uint64_t log_number;
+    SequenceNumber last_sequence;
+    ASSERT_OK(vset_->Recover(&log_number, &last_sequence));
+  }
+
+  ~VersionSetTest() {
+    delete vset_;
+    delete table_cache_;
+    delete options_.info_log;
+    DestroyDB(dbname_, Options());
+  }
+
+  // Add a (nonexistent) table file covering [smallest,largest].  Only
+  // the metadata matters for picking compactions.
+  void Add(int level, uint64_t size, const char* smallest,
+           const char* largest) {
+    VersionEdit edit;
+    edit.AddFile(level, vset_->NewFileNumber(), size,
+                 InternalKey(smallest, 100, kTypeValue),
+                 InternalKey(largest, 100, kTypeValue), false);
+    ASSERT_OK(vset_->LogAndApply(&edit, NULL));
+  }
+};
+
+static const uint64_t kMB = 1048576;
+
+TEST(VersionSetTest, DisjointCompactionsRunTogether) {
+  // Level-1 is twice its size limit
+  Add(1, 4 * kMB, "a", "b");
+  Add(1, 4 * kMB, "c", "d");
+  Add(1, 4 * kMB, "e", "f");
+  Add(1, 4 * kMB, "g", "h");
+  Add(1, 4 * kMB, "i", "j");
+  ASSERT_TRUE(vset_->NeedsCompaction());
+
+  std::vector<Compaction*> running;
+  Compaction* c;
+  while ((c = vset_->PickCompaction()) != NULL) {
+    ASSERT_EQ(1, c->level());
+    ASSERT_EQ(1, c->num_input_files(0));
+    running.push_back(c);
+  }
+  // Every level-1 file can be compacted at once
+  ASSERT_EQ(5, running.size());
+  ASSERT_EQ(5, vset_->NumRunningCompactions());
+  for (int i = 0; i < running.size(); i++) {
+    for (int j = 0; j < i; j++) {
+      ASSERT_TRUE(running[i]->input(0, 0) != running[j]->input(0, 0));
+    }
+  }
+
+  // Releasing a compaction makes its file available again
+  FileMetaData* f = running[2]->input(0, 0);
+  delete running[2];
+  ASSERT_EQ(4, vset_->NumRunningCompactions());
+  c = vset_->PickCompaction();
+  ASSERT_TRUE(c != NULL);
+  ASSERT_EQ(f, c->input(0, 0));
+  running[2] = c;
+
+  for (int i = 0; i < running.size(); i++) {
+    delete running[i];
+  }
+  ASSERT_EQ(0, vset_->NumRunningCompactions());
+}
+
+TEST(VersionSetTest, SharedOutputFileConflicts) {
+  Add(1, 6 * kMB, "a", "c");
+  Add(1, 6 * kMB, "d", "f");
+  Add(2, 1 * kMB, "b", "e");  // Overlaps both level-1 files
+  Add(2, 1 * kMB, "f", "g");  // Keeps the first pick from growing
+
+  Compaction* c1 = vset_->PickCompaction();
+  ASSERT_TRUE(c1 != NULL);
+  ASSERT_EQ(1, c1->num_input_files(0));
+  ASSERT_EQ(1, c1->num_input_files(1));
+
+  // The other level-1 file would need the same level-2 file
+  ASSERT_TRUE(vset_->PickCompaction() == NULL);
+
+  delete c1;
+  Compaction* c2 = vset_->PickCompaction();
+  ASSERT_TRUE(c2 != NULL);
+  delete c2;
+}
+
+TEST(VersionSetTest, OneLevel0CompactionAtATime) {
+  Add(0, 1 * kMB, "a", "b");
+  Add(0, 1 * kMB, "c", "d");
+  Add(0, 1 * kMB, "e", "f");
+  Add(0, 1 * kMB, "g", "h");
+  Add(0, 1 * kMB, "i", "j");
+
+  Compaction* c1 = vset_->PickCompaction();
+  ASSERT_TRUE(c1 != NULL);
+  ASSERT_EQ(0, c1->level());
+  ASSERT_TRUE(vset_->PickCompaction() == NULL);
+  delete c1;
+}
+
+TEST(VersionSetTest, PendingCompactionBytes) {
+  ASSERT_EQ(0, vset_->EstimatedPendingCompactionBytes());
+
+  // Level-1 is 10MB over its limit; pushing that down rewrites about
+  // ten times as much of level-2.
+  Add(1, 10 * kMB, "a", "b");
+  Add(1, 10 * kMB, "c", "d");
+  ASSERT_EQ(110 * kMB, vset_->EstimatedPendingCompactionBytes());
+
+  // Level-0 reaching its compaction trigger adds level-0 and level-1
+  Add(0, 1 * kMB, "a", "z");
+  Add(0, 1 * kMB, "a", "z");
+  Add(0, 1 * kMB, "a", "z");
+  ASSERT_EQ(110 * kMB, vset_->EstimatedPendingCompactionBytes());
+  Add(0, 1 * kMB, "a", "z");
+  ASSERT_EQ((110 + 4 + 20) * kMB, vset_->EstimatedPendingCompactionBytes());
+}
+
+TEST(VersionSetTest, PickLevelForIngestedFile) {
+  Add(0, 1 * kMB, "m", "n");
+  Add(2, 1 * kMB, "c", "e");
+  Add(4, 1 * kMB, "a", "z");
+
+  // Above the first level holding overlapping data
+  ASSERT_EQ(0, vset_->PickLevelForIngestedFile("n", "p"));
+  ASSERT_EQ(1, vset_->PickLevelForIngestedFile("d", "d"));
+  ASSERT_EQ(3, vset_->PickLevelForIngestedFile("f", "g"));
+  ASSERT_EQ(config::kNumLevels - 1,
+            vset_->PickLevelForIngestedFile("za", "zz"));
+}
+
+TEST(VersionSetTest, AddFileDeletionsInRange) {
+  Add(0, 1 * kMB, "c", "d");
+  Add(1, 1 * kMB, "a", "c");   // Straddles the start of the range
+  Add(1, 1 * kMB, "d", "e");
+  Add(2, 1 * kMB, "b", "f");
+  Add(3, 1 * kMB, "e", "h");   // Straddles the end of the range
+
+  VersionEdit edit;
+  ASSERT_EQ(3, vset_->AddFileDeletionsInRange("b", "g", &edit));
+  ASSERT_OK(vset_->LogAndApply(&edit, NULL));
+  ASSERT_EQ(0, vset_->NumLevelFiles(0));
+  ASSERT_EQ(1, vset_->NumLevelFiles(1));
+  ASSERT_EQ(0, vset_->NumLevelFiles(2));
+  ASSERT_EQ(1, vset_->NumLevelFiles(3));
+
+  // Files read by a running compaction are skipped
+  for (int i = 0; i < 4; i++) {
+    Add(0, 1 * kMB, "m", "n");
+  }
+  Compaction* c = vset_->PickCompaction();
+  ASSERT_TRUE(c != NULL);
+  ASSERT_EQ(0, c->level());
+  VersionEdit edit2;
+  ASSERT_EQ(2, vset_->AddFileDeletionsInRange("a", "z", &edit2));
+  delete c;
+  VersionEdit edit3;
+  ASSERT_EQ(6, vset_->AddFileDeletionsInRange("a", "z", &edit3));
+}
+
+TEST(VersionSetTest, CompactionFallsBackToOtherLevels) {
+  Add(0, 1 * kMB, "a", "z");
+  Add(0, 1 * kMB, "a", "z");
+  Add(0, 1 * kMB, "a", "z");
+  Add(0, 1 * kMB, "a", "z");
+  Add(0, 1 * kMB, "a", "z");
+  Add(2, 60 * kMB, "a", "b");
+  Add(2, 60 * kMB, "c", "d");
+
+  // Level-0 scores highest and is picked first
+  Compaction* c1 = vset_->PickCompaction();
+  ASSERT_TRUE(c1 != NULL);
+  ASSERT_EQ(0, c1->level());
+
+  // Level-2 is over its limit too and does not conflict
+  Compaction* c2 = vset_->PickCompaction();
+  ASSERT_TRUE(c2 != NULL);
+  ASSERT_EQ(2, c2->level());
+  ASSERT_EQ(2, vset_->NumRunningCompactions());
+
+  delete c1;
+  delete c2;
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -9,7 +9,9 @@
 // record :=
 //    kTypeValue varstring varstring         |
 //    kTypeLargeValueRef varstring varstring |
-//    kTypeDeletion varstring
+//    kTypeDeletion varstring                |
+//    kTypeMerge varstring varstring         |
+//    kTypeRangeDeletion varstring varstring
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -79,22 +81,47 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+}
+
+void WriteBatch::Merge(const Slice& key, const Slice& value) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeMerge));
+  PutLengthPrefixedSlice(&rep_, key);
+  PutLengthPrefixedSlice(&rep_, value);
+}
+
 Status WriteBatchInternal::InsertInto(const WriteBatch* b,
-                                      MemTable* memtable) {
+                                      MemTable* memtable,
+                                      bool concurrent) {
   const int count = WriteBatchInternal::Count(b); // expect count
   int found = 0;  // actual count
   Iterator it(*b);
   for (; !it.Done(); it.Next()) {
     switch (it.op()) {
       case kTypeDeletion:
-        memtable->Add(it.sequence_number(), kTypeDeletion, it.key(), Slice());
+        memtable->Add(it.sequence_number(), kTypeDeletion, it.key(), Slice(),
+                      concurrent);
         break;
       case kTypeValue:
-        memtable->Add(it.sequence_number(), kTypeValue, it.key(), it.value());
+        memtable->Add(it.sequence_number(), kTypeValue, it.key(), it.value(),
+                      concurrent);
         break;
       case kTypeLargeValueRef:
         memtable->Add(it.sequence_number(), kTypeLargeValueRef,
-                      it.key(), it.value());
+                      it.key(), it.value(), concurrent);
+        break;
+      case kTypeMerge:
+        memtable->Add(it.sequence_number(), kTypeMerge, it.key(), it.value(),
+                      concurrent);
+        break;
+      case kTypeRangeDeletion:
+        memtable->Add(it.sequence_number(), kTypeRangeDeletion,
+                      it.key(), it.value(), concurrent);
         break;
     }
     found++;
@@ -112,6 +139,12 @@ void WriteBatchInternal::SetContents(WriteBatch* b, const Slice& contents) {
   b->rep_.assign(contents.data(), contents.size());
 }
 
+void WriteBatchInternal::Append(WriteBatch* dst, const WriteBatch* src) {
+  SetCount(dst, Count(dst) + Count(src));
+  assert(src->rep_.size() >= 12);
+  dst->rep_.append(src->rep_.data() + 12, src->rep_.size() - 12);
+}
+
 WriteBatchInternal::Iterator::Iterator(const WriteBatch& batch)
     : input_(WriteBatchInternal::Contents(&batch)),
       done_(false) {
@@ -151,6 +184,26 @@ void WriteBatchInternal::Iterator::GetNextEntry() {
         input_.clear();  // 就放着呗? 为啥还要 clear().
       }
       break;
+    case kTypeMerge:
+      if (GetLengthPrefixedSlice(&input_, &key_) &&
+          GetLengthPrefixedSlice(&input_, &value_)) {
+        op_ = kTypeMerge;
+      } else {
+        status_ = Status::Corruption("bad WriteBatch Merge");
+        done_ = true;
+        input_.clear();
+      }
+      break;
+    case kTypeRangeDeletion:
+      if (GetLengthPrefixedSlice(&input_, &key_) &&
+          GetLengthPrefixedSlice(&input_, &value_)) {
+        op_ = kTypeRangeDeletion;
+      } else {
+        status_ = Status::Corruption("bad WriteBatch DeleteRange");
+        done_ = true;
+        input_.clear();
+      }
+      break;
     case kTypeDeletion:
       if (GetLengthPrefixedSlice(&input_, &key_)) {
         op_ = kTypeDeletion;
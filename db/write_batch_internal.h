@@ -42,7 +42,14 @@ class WriteBatchInternal {
   static void SetContents(WriteBatch* batch, const Slice& contents);
 
   // 就是将 batch 中记录的更改应用到 memtable 中.
-  static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
+  // If "concurrent" is true, other threads may be inserting into
+  // memtable at the same time; see MemTable::Add().
+  static Status InsertInto(const WriteBatch* batch, MemTable* memtable,
+                           bool concurrent = false);
+
+  // Append the records of "src" to "dst".  The sequence number stored
+  // in "dst" is left unchanged.
+  static void Append(WriteBatch* dst, const WriteBatch* src);
 
   // Iterate over the contents of a write batch. 可以参考 write_batch.cc 中 write batch 的格式.
   class Iterator {
@@ -41,11 +41,34 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(ikey.user_key.ToString());
         state.append(")");
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        break;
+      case kTypeRangeDeletion:
+        state.append("UnexpectedRangeDeletion()");
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
   }
   delete iter;
+  iter = mem.NewRangeTombstoneIterator();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+    ASSERT_EQ(kTypeRangeDeletion, ikey.type);
+    state.append("DeleteRange(");
+    state.append(ikey.user_key.ToString());
+    state.append(", ");
+    state.append(iter->value().ToString());
+    state.append(")@");
+    state.append(NumberToString(ikey.sequence));
+  }
+  delete iter;
   if (!s.ok()) {
     state.append("ParseError()");
   }
@@ -74,6 +97,33 @@ TEST(WriteBatchTest, Multiple) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("m1"));
+  batch.Merge(Slice("baz"), Slice("m2"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ("Merge(baz, m2)@102"
+            "Merge(foo, m1)@101"
+            "Put(foo, bar)@100",
+            PrintContents(&batch));
+}
+
+TEST(WriteBatchTest, DeleteRange) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.DeleteRange(Slice("a"), Slice("g"));
+  batch.DeleteRange(Slice("a"), Slice("c"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  // Tombstones are kept apart from the point entries
+  ASSERT_EQ("Put(foo, bar)@100"
+            "DeleteRange(a, c)@102"
+            "DeleteRange(a, g)@101",
+            PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, PutIndirect) {
   WriteBatch batch;
   batch.Put(Slice("baz"), Slice("boo"));
@@ -103,6 +153,33 @@ TEST(WriteBatchTest, Corruption) {
             PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Append) {
+  WriteBatch b1, b2;
+  WriteBatchInternal::SetSequence(&b1, 200);
+  WriteBatchInternal::SetSequence(&b2, 300);
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("",
+            PrintContents(&b1));
+  b2.Put("a", "va");
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a, va)@200",
+            PrintContents(&b1));
+  b2.Clear();
+  b2.Put("b", "vb");
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a, va)@200"
+            "Put(b, vb)@201",
+            PrintContents(&b1));
+  b2.Delete("foo");
+  WriteBatchInternal::Append(&b1, &b2);
+  ASSERT_EQ("Put(a, va)@200"
+            "Put(b, vb)@202"
+            "Put(b, vb)@201"
+            "Delete(foo)@203",
+            PrintContents(&b1));
+  ASSERT_EQ(4, WriteBatchInternal::Count(&b1));
+}
+
 }
 
 int main(int argc, char** argv) {
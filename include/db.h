@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include "include/iterator.h"
 #include "include/options.h"
+#include "include/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -58,6 +59,23 @@ class DB {
   // Note: consider setting options.sync = false.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for every key in the range
+  // ["begin","end").  The range is deleted by a single tombstone, so
+  // the cost does not depend on how many keys it holds.
+  // Note: consider setting options.sync = false.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin,
+                             const Slice& end) = 0;
+
+  // Record "value" as a merge operand for "key".  The operand is
+  // combined with the existing value of "key" by options.merge_operator
+  // when the key is read or compacted.  Returns InvalidArgument if the
+  // database was opened without a merge operator.
+  // Note: consider setting options.sync = false.
+  virtual Status Merge(const WriteOptions& options,
+                       const Slice& key,
+                       const Slice& value) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = false.
@@ -73,6 +91,13 @@ class DB {
   virtual Status Get(const ReadOptions& options,
                      const Slice& key, std::string* value) = 0;
 
+  // Same as above, but a value read from a table file is not copied:
+  // *value points into the data block that holds it and pins that block
+  // until *value is reset or destroyed.  See include/pinnable_slice.h.
+  // The default implementation copies the result of the Get() above.
+  virtual Status Get(const ReadOptions& options,
+                     const Slice& key, PinnableSlice* value);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -91,6 +116,28 @@ class DB {
   // use "snapshot" after this call.
   virtual void ReleaseSnapshot(const Snapshot* snapshot) = 0;
 
+  // Add the contents of the table file at "path" to the database as if
+  // all of its entries had been Put() in one batch.  The file must have
+  // been written with TableBuilder, using this database's comparator,
+  // and hold at least one entry and no duplicate keys.
+  //
+  // The entries bypass the log and the memtable: they are copied into
+  // a new table file which is added at the deepest level allowed by the
+  // data it overlaps.  Other writes go on during the copy; they only
+  // wait for it to be installed, or for a second copy if some of them,
+  // or a snapshot, overlapped the file meanwhile.  "path" itself is
+  // left untouched.
+  virtual Status IngestExternalFile(const std::string& path) = 0;
+
+  // Drop every table file whose keys all lie within [begin,end], at any
+  // level, without reading or rewriting data.  Files that straddle
+  // "begin" or "end", files a running compaction is reading, and
+  // entries still in memory are left alone, so keys in the range may
+  // survive the call.  Older entries hidden by the dropped data can
+  // also become visible again; delete the remaining keys of the range
+  // as usual to get rid of all of them.
+  virtual Status DeleteFilesInRange(const Slice& begin, const Slice& end) = 0;
+
   // DB implementations can export properties about their state
   // via this method.  If "property" is a valid property understood by this
   // DB implementation, fills "*value" with its current value and returns
@@ -101,8 +148,23 @@ class DB {
   //
   //  "leveldb.num-files-at-level<N>" - return the number of files at level <N>,
   //     where <N> is an ASCII representation of a level number (e.g. "0").
+  //  "leveldb.num-running-compactions" - return the number of level
+  //     compactions currently in progress.
+  //  "leveldb.stall-micros" - return the total number of microseconds
+  //     writes have been delayed or stopped to let compactions catch up.
+  //  "leveldb.estimated-pending-compaction-bytes" - return an estimate
+  //     of the bytes compactions have to rewrite to bring every level
+  //     back under its size limit.
   virtual bool GetProperty(const Slice& property, uint64_t* value) = 0;
 
+  // Same as above for properties with a string value.  Valid property
+  // names include:
+  //
+  //  "leveldb.stats" - return a multi-line report of the files, sizes,
+  //     compaction traffic and read/write amplification of each level,
+  //     followed by the database-wide counters.
+  virtual bool GetProperty(const Slice& property, std::string* value) = 0;
+
   // For each i in [0,n-1], store in "sizes[i]", the approximate
   // file system space used by keys in "[range[i].start .. range[i].limit)".
   //
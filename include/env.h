@@ -118,12 +118,25 @@ class Env {
   // added to the same Env may run concurrently in different threads.
   // I.e., the caller may not assume that background work items are
   // serialized.
+  //
+  // Work is queued on the thread pool for "pri".  Items in different
+  // pools never wait behind each other, so short urgent work (e.g.
+  // memtable compactions) can be scheduled at HIGH while long running
+  // work (e.g. level compactions) runs at LOW.
+  enum Priority { LOW, HIGH };
   virtual void Schedule(
       void (*function)(void* arg),
-      void* arg) = 0;
+      void* arg,
+      Priority pri = LOW) = 0;
+
+  // Set the number of background threads that will be used to run the
+  // work scheduled at priority "pri".  The default is one thread per
+  // priority.  Pools never shrink.
+  virtual void SetBackgroundThreads(int number, Priority pri = LOW) = 0;
 
   // Start a new thread, invoking "function(arg)" within the new thread.
-  // When "function(arg)" returns, the thread will be destroyed.
+  // When "function(arg)" returns, the thread will be destroyed and all of
+  // its resources released; it cannot be joined.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
 
   // *path is set to a temporary directory that can be used for testing. It may
@@ -267,8 +280,11 @@ class EnvWrapper : public Env {
     return target_->LockFile(f, l);
   }
   Status UnlockFile(FileLock* l) { return target_->UnlockFile(l); }
-  void Schedule(void (*f)(void*), void* a) {
-    return target_->Schedule(f, a);
+  void Schedule(void (*f)(void*), void* a, Priority pri = LOW) {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri = LOW) {
+    return target_->SetBackgroundThreads(number, pri);
   }
   void StartThread(void (*f)(void*), void* a) {
     return target_->StartThread(f, a);
@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom MergeOperator object.
+// DB::Merge() records an operand for a key instead of a full value;
+// the operator is consulted on reads and compactions to fold the
+// operands into the key's existing value.  This turns read-modify-write
+// updates (counters, appends, set unions) into a single blind write.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+namespace leveldb {
+
+class Slice;
+
+class MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.
+  virtual const char* Name() const = 0;
+
+  // Compute the value of "key" by applying "operands" to
+  // "*existing_value".  "existing_value" is NULL if the key has no
+  // value (it was never written or was deleted).  The operands are
+  // given oldest first.  Store the result in *new_value and return
+  // true, or return false if the operands cannot be applied; the read
+  // or compaction that needed the value then fails with a Corruption
+  // status.
+  virtual bool FullMerge(const Slice& key,
+                         const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine two consecutive operands for "key" into one without
+  // knowing the existing value.  "left_operand" was written before
+  // "right_operand".  Store the combined operand in *new_value and
+  // return true, or return false if the pair cannot be combined, in
+  // which case both are kept.
+  //
+  // The default implementation never combines operands.
+  virtual bool PartialMerge(const Slice& key,
+                            const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value) const;
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
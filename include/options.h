@@ -6,13 +6,18 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
+#include <vector>
 
 namespace leveldb {
 
 class Cache;
 class Comparator;
 class Env;
+class FilterPolicy;
+class MergeOperator;
 class Snapshot;
+class Statistics;
 class WritableFile;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -93,6 +98,64 @@ struct Options {
   // Default: 1000
   int max_open_files;
 
+  // Maximum number of compactions that may run concurrently.  Two
+  // compactions only run together if their key ranges do not overlap
+  // at any level they touch.  The Env's LOW priority thread pool is
+  // grown to at least this many threads when the DB is opened.
+  //
+  // Default: 1
+  int max_background_compactions;
+
+  // Maximum number of threads that a single compaction may use.  A
+  // compaction reading several "level+1" files is split on their
+  // boundaries into up to this many key ranges, which are merged in
+  // parallel.  The results are installed together.
+  //
+  // Default: 1
+  int max_subcompactions;
+
+  // If true, the writers grouped into one log record insert their own
+  // batches into the memtable in parallel once the record is written,
+  // instead of the group leader inserting all of them.  Pays off when
+  // many threads write at once on a machine with many cores.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
+  // Once level-0 holds this many files, each write is delayed so that
+  // the DB accepts data no faster than "delayed_write_rate", which
+  // gives compactions a chance to catch up.  Values below 4, the number
+  // of level-0 files that starts a level-0 compaction, are raised to 4.
+  //
+  // Default: 8
+  int level0_slowdown_writes_trigger;
+
+  // Once level-0 holds this many files, writes wait until a compaction
+  // brings the count back down.  Values below 4 are raised to 4.
+  //
+  // Default: 12
+  int level0_stop_writes_trigger;
+
+  // Writes are delayed like for level0_slowdown_writes_trigger once the
+  // compactions needed to bring every level back under its size limit
+  // would rewrite about this many bytes.  0 disables the limit.
+  //
+  // Default: 64GB
+  uint64_t soft_pending_compaction_bytes_limit;
+
+  // Writes wait once the estimated pending compaction bytes reach this
+  // many bytes.  0 disables the limit.
+  //
+  // Default: 256GB
+  uint64_t hard_pending_compaction_bytes_limit;
+
+  // Rate in bytes per second at which delayed writes are let through
+  // when a slowdown trigger is first reached.  The rate drops further
+  // as the DB gets closer to a stop trigger.
+  //
+  // Default: 16MB/s
+  uint64_t delayed_write_rate;
+
   // Handle values larger than "large_value_threshold" bytes
   // specially, by writing them into their own files (to avoid
   // compaction overhead) and doing content-based elimination of
@@ -143,6 +206,56 @@ struct Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression;
 
+  // If non-empty, entry i is the compression used for tables written
+  // to level i; levels beyond the end of the vector use the last entry.
+  // This lets flushes into the young levels skip compression while the
+  // bottom level, which holds most of the data, stays compressed.  For
+  // example {kNoCompression, kNoCompression, kLightweightCompression}.
+  // If empty, "compression" is used for every level.
+  //
+  // Default: empty
+  std::vector<CompressionType> compression_per_level;
+
+  // Number of background threads used to compress the data blocks of a
+  // table.  Finished blocks are handed to a compression pool shared by
+  // all table builders in the process, which grows to the largest value
+  // requested, and written to the file in their original order once
+  // compressed.  If 0, blocks are compressed by the thread building the
+  // table.
+  //
+  // Default: 0
+  int compression_threads;
+
+  // If non-NULL, use the specified filter policy to reduce disk reads.
+  // Each table file then carries a filter (e.g. a bloom filter, see
+  // NewBloomFilterPolicy() in include/filter_policy.h) that lets
+  // DB::Get() skip reading data blocks that cannot contain the key.
+  //
+  // Default: NULL
+  const FilterPolicy* filter_policy;
+
+  // If non-NULL, use the specified operator to combine the operands
+  // written by DB::Merge() (see include/merge_operator.h).  The same
+  // operator must be supplied on every open of a database that holds
+  // merge operands; DB::Merge() fails with InvalidArgument when no
+  // operator is set.
+  //
+  // Default: NULL
+  const MergeOperator* merge_operator;
+
+  // If non-NULL, collect database-wide counters and latency histograms
+  // in this object (see include/statistics.h).  It must outlive the
+  // database.
+  //
+  // Default: NULL
+  Statistics* statistics;
+
+  // If non-zero, write the "leveldb.stats" property to info_log every
+  // stats_dump_period_sec seconds.
+  //
+  // Default: 600
+  int stats_dump_period_sec;
+
   // Create an Options object with default values for all fields.
   Options();
 };
@@ -0,0 +1,71 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PerfContext collects counters and timings for the operations done
+// by one thread, which explains where the time of an individual slow
+// call went.  Collection is off by default; enable it for the calling
+// thread with SetPerfLevel(), then:
+//
+//   leveldb::GetPerfContext()->Reset();
+//   db->Get(leveldb::ReadOptions(), key, &value);
+//   fprintf(stderr, "%s\n", leveldb::GetPerfContext()->ToString().c_str());
+//
+// Building the library with -DLEVELDB_NPERF_CONTEXT removes all
+// collection code.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum PerfLevel {
+  kDisablePerf = 0,     // Collect nothing
+  kEnableCount = 1,     // Collect only the counters
+  kEnableTime = 2,      // Collect the counters and the timers
+};
+
+// Set or return the level of collection for the calling thread.
+// Default: kDisablePerf
+extern void SetPerfLevel(PerfLevel level);
+extern PerfLevel GetPerfLevel();
+
+struct PerfContext {
+  // Set every counter and timer to zero.
+  void Reset();
+
+  // Return the non-zero counters and timers as "name = value" pairs.
+  std::string ToString() const;
+
+  // Calls to the user comparator made while comparing internal keys
+  uint64_t user_key_comparison_count;
+
+  uint64_t block_read_count;            // Blocks read from table files
+  uint64_t block_read_byte;             // Bytes of the blocks read
+  uint64_t block_cache_hit_count;       // Blocks found in the block cache
+
+  // Internal keys an iterator stepped over: older versions, entries
+  // newer than its snapshot, and entries hidden by a deletion
+  uint64_t internal_key_skipped_count;
+  // Deletion markers and entries covered by a range tombstone that an
+  // iterator stepped over
+  uint64_t internal_delete_skipped_count;
+
+  uint64_t get_from_memtable_count;     // Get()s answered by a memtable
+  uint64_t get_from_table_count;        // Get()s answered by a table file
+
+  uint64_t db_mutex_lock_micros;        // Waiting for the DB mutexes
+  uint64_t write_wal_micros;            // Appending to the log
+  uint64_t wal_sync_micros;             // Syncing the log
+  uint64_t write_memtable_micros;       // Inserting into the memtable
+};
+
+// Return the PerfContext of the calling thread.
+extern PerfContext* GetPerfContext();
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is the result of DB::Get() that avoids copying the
+// value.  When the value is read from a table file, the slice points
+// straight into the data block that holds it, and keeps that block
+// alive (in the block cache or on its own) until the PinnableSlice is
+// reset or destroyed.  Values that do not live in a block, e.g. those in
+// a memtable or produced by merging, are copied into the PinnableSlice.
+//
+// A pinned slice holds on to block cache memory, so release it promptly,
+// and always before the DB is deleted.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+#include "include/slice.h"
+
+namespace leveldb {
+
+class PinnableSlice : public Slice {
+ public:
+  typedef void (*CleanupFunction)(void* arg1, void* arg2);
+
+  PinnableSlice();
+  ~PinnableSlice();
+
+  // Point at "s", which stays valid until (*cleanup)(arg1, arg2) is
+  // called.  That happens on the next Reset() or on destruction.
+  // REQUIRES: this slice is not pinned already
+  void PinSlice(const Slice& s, CleanupFunction cleanup,
+                void* arg1, void* arg2);
+
+  // Point at a copy of "s" kept inside this object.
+  void PinSelf(const Slice& s);
+
+  // The buffer used by PinSelf().  Fill it, then call PinSelf() to
+  // point at its contents without another copy.
+  std::string* GetSelf() { return &self_; }
+  void PinSelf();
+
+  // Release any pinned block and become empty.
+  void Reset();
+
+  // Return true iff the slice points into a pinned block rather than
+  // into its own buffer.
+  bool IsPinned() const { return cleanup_ != NULL; }
+
+ private:
+  std::string self_;
+  CleanupFunction cleanup_;
+  void* arg1_;
+  void* arg2_;
+
+  // No copying allowed
+  PinnableSlice(const PinnableSlice&);
+  void operator=(const PinnableSlice&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A Statistics object attached through Options::statistics collects
+// database-wide counters ("tickers") and latency histograms.  Unlike a
+// PerfContext (see include/perf_context.h) it aggregates the work of
+// every thread, and may be shared by several databases.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+#define STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace leveldb {
+
+enum Tickers {
+  kBlockCacheHit = 0,
+  kBlockCacheMiss,
+  kBytesWritten,          // User data passed to Write()
+  kBytesRead,             // Values returned by Get()
+  kStallMicros,           // Time writes were delayed or stopped
+  kFlushBytesWritten,     // Table bytes written by memtable compactions
+  kCompactionBytesRead,   // Table bytes read by compactions
+  kCompactionBytesWritten,
+  kNumTickers             // Must be last
+};
+
+enum Histograms {
+  kGetMicros = 0,
+  kWriteMicros,
+  kSeekMicros,            // DB iterator Seek()
+  kSyncMicros,            // Log file syncs
+  kNumHistograms          // Must be last
+};
+
+// Return the name of a ticker or histogram, e.g. "leveldb.block.cache.hit".
+extern const char* TickerName(Tickers ticker);
+extern const char* HistogramName(Histograms histogram);
+
+// Implementations must be thread-safe.
+class Statistics {
+ public:
+  virtual ~Statistics();
+
+  // Add "count" to "ticker".
+  virtual void RecordTick(Tickers ticker, uint64_t count) = 0;
+  virtual uint64_t GetTickerCount(Tickers ticker) const = 0;
+
+  // Add a sample of "micros" to "histogram".
+  virtual void MeasureTime(Histograms histogram, uint64_t micros) = 0;
+
+  // Return the number of samples added to "histogram".
+  virtual uint64_t GetHistogramCount(Histograms histogram) const = 0;
+
+  // Return a human-readable summary of "histogram".
+  virtual std::string GetHistogramString(Histograms histogram) const = 0;
+
+  // Return a human-readable dump of every ticker and histogram.
+  virtual std::string ToString() const = 0;
+};
+
+// Create a new Statistics object that keeps its counters in memory.
+// The caller must delete it once no database uses it any more.
+extern Statistics* NewStatistics();
+
+}
+
+#endif  // STORAGE_LEVELDB_INCLUDE_STATISTICS_H_
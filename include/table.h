@@ -12,6 +12,7 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+class Footer;
 struct Options;
 class RandomAccessFile;
 struct ReadOptions;
@@ -47,6 +48,12 @@ class Table {
   // A: 具体如何解析 iter->key(), iter->value() 由 caller 决定, Table 仅是提供遍历的功能!
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Returns a new iterator over the range tombstones stored in the
+  // table, see TableBuilder::AddRangeTombstone().  The tombstones are
+  // held in memory for as long as the table is open.
+  bool HasRangeTombstones() const;
+  Iterator* NewRangeTombstoneIterator() const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -62,6 +69,25 @@ class Table {
   explicit Table(Rep* rep) { rep_ = rep; }
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Load the filter named by options.filter_policy and the range
+  // tombstones, if any.  Filter errors are ignored: a table without a
+  // filter is still fully readable.
+  void ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value);
+  void ReadRangeDels(const Slice& handle_value);
+
+  // Calls (*handle_result)(arg, ...) with the entry found after a call
+  // to Seek(key).  May not make such a call if there is no such entry.
+  // Reads at most one data block.  The entry lives in that block, which
+  // stays alive as long as *block_iter does; handle_result may keep the
+  // entry past the call by taking over *block_iter and setting it to NULL.
+  friend class TableCache;
+  Status InternalGet(
+      const ReadOptions&, const Slice& key,
+      void* arg,
+      void (*handle_result)(void* arg, const Slice& k, const Slice& v,
+                            Iterator** block_iter));
+
   // No copying allowed
   Table(const Table&);
   void operator=(const Table&);
@@ -42,6 +42,15 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone to the table.  "key" is the internal key
+  // (start, sequence, kTypeRangeDeletion) and "value" the exclusive end
+  // key.  Tombstones are kept in their own meta block, so they do not
+  // count towards NumEntries() and need not be ordered with the keys
+  // passed to Add().
+  // REQUIRES: key is after any previously added tombstone key
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -75,6 +84,13 @@ class TableBuilder {
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+
+  // Parallel compression, see Options::compression_threads
+  static void CompressWork(void* arg);
+  void WaitForCompression();
+  size_t MaxQueuedBlocks() const;
+  void WriteCompletedBlocks(size_t max_queued);
 
   struct Rep;
   Rep* rep_;
@@ -43,6 +43,13 @@ class WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in ["begin","end").  Costs a single
+  // record however many keys the range holds.
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Record "value" as a merge operand for "key".  See DB::Merge().
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
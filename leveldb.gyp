@@ -66,6 +66,8 @@
         'db/log_writer.h',
         'db/memtable.cc',
         'db/memtable.h',
+        'db/range_del.cc',
+        'db/range_del.h',
         'db/repair.cc',
         'db/skiplist.h',
         'db/snapshot.h',
@@ -81,9 +83,14 @@
         'include/comparator.h',
         'include/db.h',
         'include/env.h',
+        'include/filter_policy.h',
         'include/iterator.h',
+        'include/merge_operator.h',
         'include/options.h',
+        'include/perf_context.h',
+        'include/pinnable_slice.h',
         'include/slice.h',
+        'include/statistics.h',
         'include/status.h',
         'include/table.h',
         'include/table_builder.h',
@@ -100,6 +107,8 @@
         'table/block.h',
         'table/block_builder.cc',
         'table/block_builder.h',
+        'table/filter_block.cc',
+        'table/filter_block.h',
         'table/format.cc',
         'table/format.h',
         'table/iterator.cc',
@@ -112,6 +121,7 @@
         'table/two_level_iterator.h',
         'util/arena.cc',
         'util/arena.h',
+        'util/bloom.cc',
         'util/cache.cc',
         'util/coding.cc',
         'util/coding.h',
@@ -121,14 +131,25 @@
         'util/env.cc',
         'util/env_chromium.cc',
         'util/env_posix.cc',
+        'util/filter_policy.cc',
         'util/hash.cc',
         'util/hash.h',
+        'util/histogram.cc',
+        'util/histogram.h',
         'util/logging.cc',
         'util/logging.h',
+        'util/merge_operator.cc',
         'util/mutexlock.h',
         'util/options.cc',
+        'util/perf_context.cc',
+        'util/perf_context_imp.h',
+        'util/pinnable_slice.cc',
         'util/random.h',
+        'util/statistics.cc',
+        'util/statistics_imp.h',
         'util/status.cc',
+        'util/thread_pool.cc',
+        'util/thread_pool.h',
       ],
       'sources/': [
         ['exclude', '_(android|example|portable|posix)\\.cc$'],
@@ -151,8 +172,6 @@
         'leveldb',
       ],
       'sources': [
-        'util/histogram.cc',
-        'util/histogram.h',
         'util/testharness.cc',
         'util/testharness.h',
         'util/testutil.cc',
@@ -169,6 +188,26 @@
         'util/arena_test.cc',
       ],
     },
+    {
+      'target_name': 'leveldb_bloom_test',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb_testutil',
+      ],
+      'sources': [
+        'util/bloom_test.cc',
+      ],
+    },
+    {
+      'target_name': 'leveldb_cache_bench',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb',
+      ],
+      'sources': [
+        'util/cache_bench.cc',
+      ],
+    },
     {
       'target_name': 'leveldb_cache_test',
       'type': 'executable',
@@ -199,6 +238,16 @@
         'db/corruption_test.cc',
       ],
     },
+    {
+      'target_name': 'leveldb_crc32c_bench',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb',
+      ],
+      'sources': [
+        'util/crc32c_bench.cc',
+      ],
+    },
     {
       'target_name': 'leveldb_crc32c_test',
       'type': 'executable',
@@ -259,6 +308,26 @@
         'db/filename_test.cc',
       ],
     },
+    {
+      'target_name': 'leveldb_filter_block_test',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb_testutil',
+      ],
+      'sources': [
+        'table/filter_block_test.cc',
+      ],
+    },
+    {
+      'target_name': 'leveldb_histogram_test',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb_testutil',
+      ],
+      'sources': [
+        'util/histogram_test.cc',
+      ],
+    },
     {
       'target_name': 'leveldb_log_test',
       'type': 'executable',
@@ -269,6 +338,28 @@
         'db/log_test.cc',
       ],
     },
+    {
+      'target_name': 'leveldb_merger_test',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb_testutil',
+      ],
+      'sources': [
+        'table/merger_test.cc',
+      ],
+    },
+    {
+      'target_name': 'leveldb_micro_bench',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb',
+      ],
+      'sources': [
+        'util/benchharness.cc',
+        'util/benchharness.h',
+        'util/micro_bench.cc',
+      ],
+    },
     {
       'target_name': 'leveldb_sha1_test',
       'type': 'executable',
@@ -299,6 +390,16 @@
         'table/table_test.cc',
       ],
     },
+    {
+      'target_name': 'leveldb_thread_pool_test',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb_testutil',
+      ],
+      'sources': [
+        'util/thread_pool_test.cc',
+      ],
+    },
     {
       'target_name': 'leveldb_version_edit_test',
       'type': 'executable',
@@ -309,6 +410,16 @@
         'db/version_edit_test.cc',
       ],
     },
+    {
+      'target_name': 'leveldb_version_set_test',
+      'type': 'executable',
+      'dependencies': [
+        'leveldb_testutil',
+      ],
+      'sources': [
+        'db/version_set_test.cc',
+      ],
+    },
     {
       'target_name': 'leveldb_write_batch_test',
       'type': 'executable',
@@ -5,6 +5,8 @@
 #include "port/port_android.h"
 
 #include <cstdlib>
+#include <errno.h>
+#include <time.h>
 
 extern "C" {
 size_t fread_unlocked(void *a, size_t b, size_t c, FILE *d) {
@@ -53,6 +55,18 @@ void CondVar::Wait() {
   PthreadCall("wait", pthread_cond_wait(&cv_, &mu_->mu_));
 }
 
+void CondVar::TimedWait(uint64_t micros) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  const uint64_t nanos = ts.tv_nsec + (micros % 1000000) * 1000;
+  ts.tv_sec += micros / 1000000 + nanos / 1000000000;
+  ts.tv_nsec = nanos % 1000000000;
+  int r = pthread_cond_timedwait(&cv_, &mu_->mu_, &ts);
+  if (r != ETIMEDOUT) {
+    PthreadCall("timedwait", r);
+  }
+}
+
 void CondVar::Signal(){
   PthreadCall("signal", pthread_cond_signal(&cv_));
 }
@@ -54,6 +54,7 @@ class CondVar {
   explicit CondVar(Mutex* mu);
   ~CondVar();
   void Wait();
+  void TimedWait(uint64_t micros);
   void Signal();
   void SignalAll();
  private:
@@ -80,6 +81,11 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     rep_.store(v, std::memory_order_relaxed);
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    return rep_.compare_exchange_strong(expected, v,
+                                        std::memory_order_release,
+                                        std::memory_order_relaxed);
+  }
 };
 
 /**
@@ -42,6 +42,10 @@ void CondVar::Wait() {
   cv_.Wait();
 }
 
+void CondVar::TimedWait(uint64_t micros) {
+  cv_.TimedWait(base::TimeDelta::FromMicroseconds(micros));
+}
+
 void CondVar::Signal(){
   cv_.Signal();
 }
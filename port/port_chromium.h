@@ -53,6 +53,7 @@ class CondVar {
   explicit CondVar(Mutex* mu);
   ~CondVar();
   void Wait();
+  void TimedWait(uint64_t micros);
   void Signal();
   void SignalAll();
 
@@ -81,6 +82,11 @@ class AtomicPointer {
   inline void NoBarrier_Store(void* v) {
     ::base::subtle::NoBarrier_Store(&rep_, reinterpret_cast<Rep>(v));
   }
+  inline bool CompareAndSwap(void* expected, void* v) {
+    Rep old = ::base::subtle::Release_CompareAndSwap(
+        &rep_, reinterpret_cast<Rep>(expected), reinterpret_cast<Rep>(v));
+    return old == reinterpret_cast<Rep>(expected);
+  }
 };
 
 inline void SHA1_Hash(const char* data, size_t len, char* hash_array) {
@@ -53,6 +53,10 @@ class CondVar {
   // REQUIRES: this thread holds *mu
   void Wait();
 
+  // Like Wait(), but also wakes up after "micros" microseconds.
+  // REQUIRES: this thread holds *mu
+  void TimedWait(uint64_t micros);
+
   // If there are some threads waiting, wake up at least one of them.
   void Signal();
 
@@ -87,6 +91,11 @@ class AtomicPointer {
 
   // Set va as the stored pointer with no ordering guarantees.
   void NoBarrier_Store(void* v);
+
+  // If the stored pointer equals "expected", atomically replace it
+  // with "v" and return true, else return false.  Like Release_Store(),
+  // no earlier memory access can be reordered after a successful swap.
+  bool CompareAndSwap(void* expected, void* v);
 };
 
 // ------------------ Checksumming -------------------
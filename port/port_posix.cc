@@ -5,8 +5,10 @@
 #include "port/port_posix.h"
 
 #include <cstdlib>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "util/logging.h"
 
 namespace leveldb {
@@ -38,6 +40,18 @@ void CondVar::Wait() {
   PthreadCall("wait", pthread_cond_wait(&cv_, &mu_->mu_));
 }
 
+void CondVar::TimedWait(uint64_t micros) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  const uint64_t nanos = ts.tv_nsec + (micros % 1000000) * 1000;
+  ts.tv_sec += micros / 1000000 + nanos / 1000000000;
+  ts.tv_nsec = nanos % 1000000000;
+  int r = pthread_cond_timedwait(&cv_, &mu_->mu_, &ts);
+  if (r != ETIMEDOUT) {
+    PthreadCall("timedwait", r);
+  }
+}
+
 void CondVar::Signal() {
   PthreadCall("signal", pthread_cond_signal(&cv_));
 }
@@ -65,11 +65,12 @@ Status Footer::DecodeFrom(Slice* input) {
   return result;
 }
 
-Status ReadBlock(RandomAccessFile* file,
-                 const ReadOptions& options,
-                 const BlockHandle& handle,
-                 Block** block) {
-  *block = NULL;
+Status ReadBlockContents(RandomAccessFile* file,
+                         const ReadOptions& options,
+                         const BlockHandle& handle,
+                         char** result,
+                         size_t* result_size) {
+  *result = NULL;
 
   // Read the block contents as well as the type/crc footer.
   // See table_builder.cc for the code that built this structure.
@@ -126,8 +127,23 @@ Status ReadBlock(RandomAccessFile* file,
       return Status::Corruption("bad block type");
   }
 
-  *block = new Block(buf, n);  // Block takes ownership of buf[]
+  *result = buf;
+  *result_size = n;
   return Status::OK();
 }
 
+Status ReadBlock(RandomAccessFile* file,
+                 const ReadOptions& options,
+                 const BlockHandle& handle,
+                 Block** block) {
+  *block = NULL;
+  char* buf;
+  size_t n;
+  Status s = ReadBlockContents(file, options, handle, &buf, &n);
+  if (s.ok()) {
+    *block = new Block(buf, n);  // Block takes ownership of buf[]
+  }
+  return s;
+}
+
 }
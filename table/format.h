@@ -83,6 +83,20 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Metaindex key of the block holding a table's range tombstones
+static const char kRangeDelBlockName[] = "leveldb.rangedel";
+
+// Read the contents of the block identified by "handle" from "file",
+// uncompressing them if needed.  On success, store a new[]-allocated
+// buffer holding the contents in *buf and their size in *n and return
+// OK; the caller must delete[] *buf.  On failure store NULL in *buf and
+// return non-OK.
+extern Status ReadBlockContents(RandomAccessFile* file,
+                                const ReadOptions& options,
+                                const BlockHandle& handle,
+                                char** buf,
+                                size_t* n);
+
 // Read the block identified by "handle" from "file".  On success,
 // store a pointer to the heap-allocated result in *block and return
 // OK.  On failure store NULL in *block and return non-OK.
@@ -4,6 +4,7 @@
 
 #include "table/merger.h"
 
+#include <vector>
 #include "include/comparator.h"
 #include "include/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -17,11 +18,13 @@ namespace {
  * MergingIterator, 可以认为是个多路归并的迭代器. 可以认为是把 children, n 包含着的迭代器按照 comparator 进行
  * 排序得到一个有序的序列, MergingIterator 就是在这个有序的序列上进行遍历.
  *
- * 在实现上, 我认为要遵守一个不变量 "任何一个时刻, current_->key() 始终是所有 children->key() 中最小的那个".
- * 但是 google 并没有这么做==.
- *
- * 这个版本的 MergingIterator 有很大 bug, 参考最新版 leveldb 实现. MergingIterator 仅使用元素不会重复的情况,
- * 当元素重复时, 就算是最新版 leveldb 实现也存在一个 bug.
+ * The valid children are kept in a binary heap ordered by their current
+ * key: a min-heap while moving forward and a max-heap while moving
+ * backward.  The top of the heap is current_.  Each Next()/Prev() thus
+ * costs O(log n) comparisons, and only two when the same child keeps
+ * winning.  Changing direction re-seeks the other children around key()
+ * and rebuilds the heap, so all non-current children are always
+ * positioned on the correct side of key().
  */
 class MergingIterator : public Iterator {
  public:
@@ -29,10 +32,12 @@ class MergingIterator : public Iterator {
       : comparator_(comparator),
         children_(new IteratorWrapper[n]),
         n_(n),
-        current_(NULL) {
+        current_(NULL),
+        direction_(kForward) {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   virtual ~MergingIterator() {
@@ -47,36 +52,83 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
+    direction_ = kForward;
+    InitHeap();
   }
 
   virtual void SeekToLast() {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
+    direction_ = kReverse;
+    InitHeap();
   }
 
   virtual void Seek(const Slice& target) {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
+    direction_ = kForward;
+    InitHeap();
   }
 
-  // QA: Next(), Prev() 实现貌似存在 bug. 已经在 merger-test 分支写好验证程序并验证了, 但是还有一点不确定, 等待
-  // 有缘人解答==
-  // A: 在元素不重复的情况下, 该 bug 并不存在, 事实上在整个 leveldb 中, 元素都是不重复的.
   virtual void Next() {
     assert(Valid());
+
+    // Ensure that all children are positioned after key().
+    // If we are moving in the forward direction, it is already
+    // true for all of the non-current children since current_ is
+    // the smallest child and key() == current_->key().  Otherwise,
+    // we explicitly position the non-current children.
+    if (direction_ != kForward) {
+      for (int i = 0; i < n_; i++) {
+        IteratorWrapper* child = &children_[i];
+        if (child != current_) {
+          child->Seek(key());
+          if (child->Valid() &&
+              comparator_->Compare(key(), child->key()) == 0) {
+            child->Next();
+          }
+        }
+      }
+      direction_ = kForward;
+      InitHeap();
+      assert(current_ == heap_[0]);
+    }
+
     current_->Next();
-    FindSmallest();
+    ReplaceTop();
   }
 
   virtual void Prev() {
     assert(Valid());
+
+    // Ensure that all children are positioned before key().
+    // If we are moving in the reverse direction, it is already
+    // true for all of the non-current children since current_ is
+    // the largest child and key() == current_->key().  Otherwise,
+    // we explicitly position the non-current children.
+    if (direction_ != kReverse) {
+      for (int i = 0; i < n_; i++) {
+        IteratorWrapper* child = &children_[i];
+        if (child != current_) {
+          child->Seek(key());
+          if (child->Valid()) {
+            // Child is at first entry >= key().  Step back one to be < key()
+            child->Prev();
+          } else {
+            // Child has no entries >= key().  Position at last entry.
+            child->SeekToLast();
+          }
+        }
+      }
+      direction_ = kReverse;
+      InitHeap();
+      assert(current_ == heap_[0]);
+    }
+
     current_->Prev();
-    FindLargest();
+    ReplaceTop();
   }
 
   virtual Slice key() const {
@@ -101,48 +153,83 @@ class MergingIterator : public Iterator {
   }
 
  private:
-  void FindSmallest();
-  void FindLargest();
-
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
-  //
-  // Q: 啥意思啊? simple array? 在 MergingIterator() 中不是使用 new 在 heap 上分配的内存么?!
+  // Which direction is the iterator moving?
+  enum Direction {
+    kForward,
+    kReverse
+  };
+
+  // Return true iff "a" belongs above "b" in the heap.  Ties are broken
+  // by child index, which keeps the order in which equal keys are
+  // yielded deterministic.
+  bool Above(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    int r = comparator_->Compare(a->key(), b->key());
+    if (r == 0) {
+      r = (a < b) ? -1 : +1;
+    }
+    return (direction_ == kForward) ? (r < 0) : (r > 0);
+  }
+
+  // Rebuild heap_ from the valid children and set current_ to its top.
+  void InitHeap();
+
+  // Restore the heap property after the top child has moved, dropping
+  // it if it became invalid, and set current_ to the new top.
+  void ReplaceTop();
+
+  void SiftDown(size_t index);
+
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
   IteratorWrapper* current_;
+  Direction direction_;
+  std::vector<IteratorWrapper*> heap_;  // Valid children, top at heap_[0]
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = NULL;
+void MergingIterator::InitHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == NULL) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t i = heap_.size() / 2; i > 0; i--) {
+    SiftDown(i - 1);
+  }
+  current_ = heap_.empty() ? NULL : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = NULL;
-  for (int i = n_-1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == NULL) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::ReplaceTop() {
+  assert(!heap_.empty() && current_ == heap_[0]);
+  if (!current_->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (!heap_.empty()) {
+    SiftDown(0);
+  }
+  current_ = heap_.empty() ? NULL : heap_[0];
+}
+
+void MergingIterator::SiftDown(size_t index) {
+  const size_t n = heap_.size();
+  IteratorWrapper* item = heap_[index];
+  while (true) {
+    size_t child = 2 * index + 1;
+    if (child >= n) {
+      break;
+    }
+    if (child + 1 < n && Above(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!Above(heap_[child], item)) {
+      break;
     }
+    heap_[index] = heap_[child];
+    index = child;
   }
-  current_ = largest;
+  heap_[index] = item;
 }
 }
 
@@ -0,0 +1,161 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "include/comparator.h"
+#include "include/iterator.h"
+#include "util/random.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+// An iterator over a sorted vector of keys.  The value of each entry
+// is the key prefixed with "v".
+class VectorIterator : public Iterator {
+ public:
+  explicit VectorIterator(const std::vector<std::string>& keys)
+      : keys_(keys), index_(keys.size()) { }
+
+  virtual bool Valid() const { return index_ < keys_.size(); }
+  virtual void SeekToFirst() { index_ = 0; }
+  virtual void SeekToLast() {
+    index_ = keys_.empty() ? 0 : keys_.size() - 1;
+  }
+  virtual void Seek(const Slice& target) {
+    index_ = std::lower_bound(keys_.begin(), keys_.end(),
+                              target.ToString()) - keys_.begin();
+  }
+  virtual void Next() { assert(Valid()); index_++; }
+  virtual void Prev() {
+    assert(Valid());
+    index_ = (index_ == 0) ? keys_.size() : index_ - 1;
+  }
+  virtual Slice key() const { assert(Valid()); return keys_[index_]; }
+  virtual Slice value() const {
+    assert(Valid());
+    value_ = "v" + keys_[index_];
+    return value_;
+  }
+  virtual Status status() const { return Status::OK(); }
+
+ private:
+  const std::vector<std::string> keys_;
+  size_t index_;
+  mutable std::string value_;
+};
+
+class MergerTest {
+ public:
+  std::vector<std::string> all_;   // Sorted union of all children
+  Iterator* iter_;
+  size_t pos_;                     // Model position in all_
+
+  MergerTest() : iter_(NULL), pos_(0) { }
+  ~MergerTest() { delete iter_; }
+
+  // Distribute "num_keys" distinct random keys over "n" children
+  void Build(Random* rnd, int n, int num_keys) {
+    delete iter_;
+    all_.clear();
+    std::vector<std::vector<std::string> > lists(n);
+    for (int i = 0; i < num_keys; i++) {
+      std::string k = test::RandomKey(rnd, 1 + rnd->Uniform(8));
+      if (std::find(all_.begin(), all_.end(), k) != all_.end()) continue;
+      all_.push_back(k);
+      lists[rnd->Uniform(n)].push_back(k);
+    }
+    std::sort(all_.begin(), all_.end());
+    std::vector<Iterator*> children;
+    for (int i = 0; i < n; i++) {
+      std::sort(lists[i].begin(), lists[i].end());
+      children.push_back(new VectorIterator(lists[i]));
+    }
+    iter_ = NewMergingIterator(BytewiseComparator(), &children[0], n);
+    pos_ = all_.size();
+  }
+
+  void Check() {
+    if (pos_ < all_.size()) {
+      ASSERT_TRUE(iter_->Valid());
+      ASSERT_EQ(all_[pos_], iter_->key().ToString());
+      ASSERT_EQ("v" + all_[pos_], iter_->value().ToString());
+    } else {
+      ASSERT_TRUE(!iter_->Valid());
+    }
+  }
+
+  void RandomOps(Random* rnd, int num_ops) {
+    for (int i = 0; i < num_ops; i++) {
+      const int op = rnd->Uniform(5);
+      if (op == 0) {
+        iter_->SeekToFirst();
+        pos_ = 0;
+      } else if (op == 1) {
+        iter_->SeekToLast();
+        pos_ = all_.empty() ? 0 : all_.size() - 1;
+      } else if (op == 2) {
+        std::string target = test::RandomKey(rnd, 1 + rnd->Uniform(8));
+        iter_->Seek(target);
+        pos_ = std::lower_bound(all_.begin(), all_.end(), target) -
+               all_.begin();
+      } else if (pos_ < all_.size()) {
+        if (op == 3) {
+          iter_->Next();
+          pos_++;
+        } else {
+          iter_->Prev();
+          pos_ = (pos_ == 0) ? all_.size() : pos_ - 1;
+        }
+      }
+      Check();
+    }
+  }
+};
+
+TEST(MergerTest, Empty) {
+  Random rnd(test::RandomSeed());
+  Build(&rnd, 3, 0);
+  iter_->SeekToFirst();
+  ASSERT_TRUE(!iter_->Valid());
+  iter_->SeekToLast();
+  ASSERT_TRUE(!iter_->Valid());
+  iter_->Seek("foo");
+  ASSERT_TRUE(!iter_->Valid());
+}
+
+TEST(MergerTest, ForwardAndBackward) {
+  Random rnd(test::RandomSeed());
+  Build(&rnd, 4, 200);
+  size_t n = 0;
+  for (iter_->SeekToFirst(); iter_->Valid(); iter_->Next()) {
+    ASSERT_EQ(all_[n], iter_->key().ToString());
+    n++;
+  }
+  ASSERT_EQ(all_.size(), n);
+  for (iter_->SeekToLast(); iter_->Valid(); iter_->Prev()) {
+    n--;
+    ASSERT_EQ(all_[n], iter_->key().ToString());
+  }
+  ASSERT_EQ(0, n);
+}
+
+TEST(MergerTest, Randomized) {
+  Random rnd(test::RandomSeed() + 1);
+  const int kSizes[] = { 1, 2, 3, 7, 16, 50 };
+  for (int i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+    Build(&rnd, kSizes[i], 500);
+    RandomOps(&rnd, 5000);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -5,26 +5,37 @@
 #include "include/table.h"
 
 #include "include/cache.h"
+#include "include/comparator.h"
 #include "include/env.h"
+#include "include/filter_policy.h"
 #include "table/block.h"
+#include "table/filter_block.h"
 #include "table/format.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
+#include "util/perf_context_imp.h"
+#include "util/statistics_imp.h"
 
 namespace leveldb {
 
 struct Table::Rep {
   ~Rep() {
+    delete filter;
+    delete[] filter_data;
     delete index_block;
+    delete range_del_block;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id; // 由 Cache.NewId() 返回.
+  FilterBlockReader* filter;
+  const char* filter_data;  // Owned by Rep, NULL if there is no filter
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  Block* range_del_block;   // NULL if the table has no range tombstones
 };
 
 Status Table::Open(const Options& options,
@@ -61,7 +72,16 @@ Status Table::Open(const Options& options,
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    rep->filter = NULL;
+    rep->filter_data = NULL;
+    rep->range_del_block = NULL;
     *table = new Table(rep);
+    (*table)->ReadMeta(footer);
+    s = rep->status;
+    if (!s.ok()) {
+      delete *table;
+      *table = NULL;
+    }
   } else {
     if (index_block) delete index_block;
   }
@@ -69,6 +89,65 @@ Status Table::Open(const Options& options,
   return s;
 }
 
+void Table::ReadMeta(const Footer& footer) {
+  ReadOptions opt;
+  Block* meta = NULL;
+  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &meta).ok()) {
+    // Do not propagate errors since meta info is not needed for operation
+    return;
+  }
+
+  Iterator* iter = meta->NewIterator(BytewiseComparator());
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    ReadRangeDels(iter->value());
+  }
+  delete iter;
+  delete meta;
+}
+
+void Table::ReadFilter(const Slice& filter_handle_value) {
+  Slice v = filter_handle_value;
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  // A missing or unreadable filter only costs us some extra block reads
+  ReadOptions opt;
+  char* data;
+  size_t n;
+  if (!ReadBlockContents(rep_->file, opt, filter_handle, &data, &n).ok()) {
+    return;
+  }
+  rep_->filter_data = data;
+  rep_->filter = new FilterBlockReader(rep_->options.filter_policy,
+                                       Slice(data, n));
+}
+
+void Table::ReadRangeDels(const Slice& handle_value) {
+  Slice v = handle_value;
+  BlockHandle handle;
+  if (!handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+  // Unlike a filter, the tombstones cannot be skipped without returning
+  // deleted data, so a read error fails Open().
+  Status s = ReadBlock(rep_->file, ReadOptions(), handle,
+                       &rep_->range_del_block);
+  if (!s.ok()) {
+    rep_->status = s;
+  }
+}
+
 Table::~Table() {
   delete rep_;
 }
@@ -114,8 +193,13 @@ Iterator* Table::BlockReader(void* arg,
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        PERF_COUNTER_ADD(block_cache_hit_count, 1);
+        RecordTick(table->rep_->options.statistics, kBlockCacheHit);
       } else {
+        RecordTick(table->rep_->options.statistics, kBlockCacheMiss);
         s = ReadBlock(table->rep_->file, options, handle, &block);
+        PERF_COUNTER_ADD(block_read_count, 1);
+        PERF_COUNTER_ADD(block_read_byte, handle.size());
         if (s.ok() && options.fill_cache) {
           cache_handle = block_cache->Insert(
               key, block, block->size(), &DeleteCachedBlock);
@@ -123,6 +207,8 @@ Iterator* Table::BlockReader(void* arg,
       }
     } else {
       s = ReadBlock(table->rep_->file, options, handle, &block);
+      PERF_COUNTER_ADD(block_read_count, 1);
+      PERF_COUNTER_ADD(block_read_byte, handle.size());
     }
   }
 
@@ -146,6 +232,51 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+bool Table::HasRangeTombstones() const {
+  return rep_->range_del_block != NULL;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == NULL) {
+    return NewEmptyIterator();
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
+Status Table::InternalGet(const ReadOptions& options, const Slice& k,
+                          void* arg,
+                          void (*saver)(void*, const Slice&, const Slice&,
+                                        Iterator**)) {
+  Status s;
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  iiter->Seek(k);
+  if (iiter->Valid()) {
+    Slice handle_value = iiter->value();
+    FilterBlockReader* filter = rep_->filter;
+    BlockHandle handle;
+    if (filter != NULL &&
+        handle.DecodeFrom(&handle_value).ok() &&
+        !filter->KeyMayMatch(handle.offset(), k)) {
+      // Not found
+    } else {
+      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      block_iter->Seek(k);
+      if (block_iter->Valid()) {
+        (*saver)(arg, block_iter->key(), block_iter->value(), &block_iter);
+      }
+      if (block_iter != NULL) {   // Else taken over along with a valid entry
+        s = block_iter->status();
+        delete block_iter;
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
       rep_->index_block->NewIterator(rep_->options.comparator);
@@ -6,16 +6,90 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <deque>
 #include "include/comparator.h"
 #include "include/env.h"
+#include "include/filter_policy.h"
+#include "port/port.h"
 #include "table/block_builder.h"
+#include "table/filter_block.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/thread_pool.h"
 
 namespace leveldb {
 
+// Compress "raw" with "type" into *compressed and point *contents at
+// the bytes to store.  Returns the type actually used, which falls back
+// to kNoCompression when compression does not pay off.
+static CompressionType CompressBlock(const Slice& raw, CompressionType type,
+                                     std::string* compressed,
+                                     Slice* contents) {
+  // TODO(postrelease): Support more compression options: zlib?
+  // 科科, 在代码里面大量使用了 <= kLightweightCompression 来判断 compress type 的合法性, 再加 compress
+  // method 不知道有多少坑.
+  switch (type) {
+    case kNoCompression:
+      *contents = raw;
+      break;
+
+    case kLightweightCompression: {
+      port::Lightweight_Compress(raw.data(), raw.size(), compressed);
+      *contents = *compressed;
+      if (contents->size() >= raw.size() - (raw.size() / 8u)) {
+        // Compressed less than 12.5%, so just store uncompressed form
+        *contents = raw;
+        type = kNoCompression;
+      }
+      break;
+    }
+  }
+  return type;
+}
+
+namespace {
+// A data block handed to the compression pool.  Blocks are written in
+// submission order; a block stays queued after being written until the
+// separator key for its index entry is known.
+struct BlockJob {
+  port::Mutex* mu;            // The builder's Rep::mu
+  port::CondVar* done_cv;     // Signalled once "done" is set
+  std::string raw;
+  std::string compressed;
+  Slice contents;             // Bytes to store, valid once "done"
+  CompressionType type;
+  std::string filter_keys;    // Length-prefixed keys for the filter block
+  bool done;                  // Compressed, guarded by *mu
+  bool written;
+  BlockHandle handle;         // Valid once "written"
+  bool has_index_key;
+  std::string index_key;
+};
+
+// Compression pool shared by every table builder in the process, so that
+// building a table starts no threads of its own.
+port::AtomicPointer compression_pool;
+
+ThreadPool* CompressionPool(int threads) {
+  ThreadPool* pool =
+      reinterpret_cast<ThreadPool*>(compression_pool.Acquire_Load());
+  if (pool == NULL) {
+    ThreadPool* created = new ThreadPool(Env::Default());
+    if (compression_pool.CompareAndSwap(NULL, created)) {
+      pool = created;
+    } else {
+      delete created;
+      pool = reinterpret_cast<ThreadPool*>(compression_pool.Acquire_Load());
+    }
+  }
+  pool->SetMinThreads(threads);
+  return pool;
+}
+}
+
 struct TableBuilder::Rep {
   Options options;
   Options index_block_options;
@@ -27,6 +101,8 @@ struct TableBuilder::Rep {
   std::string last_key;
   int64_t num_entries;
   bool closed;          // Either Finish() or Abandon() has been called.
+  FilterBlockBuilder* filter_block;
+  BlockBuilder range_del_block;   // Range tombstones, see AddRangeTombstone()
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -42,6 +118,16 @@ struct TableBuilder::Rep {
 
   std::string compressed_output;
 
+  // Parallel compression state, only used when "parallel" is true.  The
+  // filter keys of a block are buffered until the block is written since
+  // its filter depends on the block's final file offset.
+  bool parallel;
+  ThreadPool* pool;
+  port::Mutex mu;
+  port::CondVar done_cv;        // Signalled when a job is done
+  std::deque<BlockJob*> jobs;   // Unfinished jobs in file order
+  std::string filter_keys;      // Keys of the block being built
+
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
@@ -51,21 +137,117 @@ struct TableBuilder::Rep {
         index_block(&index_block_options),
         num_entries(0),
         closed(false),
-        pending_index_entry(false) {
+        filter_block(opt.filter_policy == NULL ? NULL
+                     : new FilterBlockBuilder(opt.filter_policy)),
+        range_del_block(&index_block_options),
+        pending_index_entry(false),
+        parallel(opt.compression_threads > 0 &&
+                 opt.compression != kNoCompression),
+        pool(NULL),
+        done_cv(&mu) {
     // Q: 按我理解此举是想要更多的 restart point 从而提高 find key 的效率.
     index_block_options.block_restart_interval = 1;
   }
+
+  ~Rep() {
+    for (size_t i = 0; i < jobs.size(); i++) {
+      delete jobs[i];
+    }
+  }
 };
 
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
     : rep_(new Rep(options, file)) {
+  if (rep_->filter_block != NULL) {
+    rep_->filter_block->StartBlock(0);
+  }
+  if (rep_->parallel) {
+    rep_->pool = CompressionPool(options.compression_threads);
+  }
 }
 
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
+  delete rep_->filter_block;
   delete rep_;
 }
 
+void TableBuilder::CompressWork(void* arg) {
+  BlockJob* job = reinterpret_cast<BlockJob*>(arg);
+  job->type = CompressBlock(job->raw, job->type, &job->compressed,
+                            &job->contents);
+  MutexLock l(job->mu);
+  job->done = true;
+  job->done_cv->SignalAll();
+}
+
+void TableBuilder::WaitForCompression() {
+  Rep* r = rep_;
+  if (!r->parallel) return;
+  // Jobs are only freed once written, so every scheduled job is queued
+  MutexLock l(&r->mu);
+  for (size_t i = 0; i < r->jobs.size(); i++) {
+    while (!r->jobs[i]->done) {
+      r->done_cv.Wait();
+    }
+  }
+}
+
+size_t TableBuilder::MaxQueuedBlocks() const {
+  // Enough to keep the pool busy while bounding memory use
+  return 2 * rep_->options.compression_threads;
+}
+
+void TableBuilder::WriteCompletedBlocks(size_t max_queued) {
+  Rep* r = rep_;
+  bool wrote = false;
+  size_t i = 0;
+  while (i < r->jobs.size()) {
+    BlockJob* job = r->jobs[i];
+    if (!job->written) {
+      {
+        MutexLock l(&r->mu);
+        while (!job->done && r->jobs.size() - i > max_queued) {
+          r->done_cv.Wait();
+        }
+        if (!job->done) {
+          break;
+        }
+      }
+      if (ok()) {
+        if (r->filter_block != NULL) {
+          Slice input = job->filter_keys;
+          Slice key;
+          while (GetLengthPrefixedSlice(&input, &key)) {
+            r->filter_block->AddKey(key);
+          }
+        }
+        WriteRawBlock(job->contents, job->type, &job->handle);
+        if (r->filter_block != NULL) {
+          r->filter_block->StartBlock(r->offset);
+        }
+        wrote = true;
+      }
+      job->written = true;
+    }
+    if (i == 0 && job->has_index_key) {
+      // The index entry is complete, so the job is no longer needed
+      if (ok()) {
+        std::string handle_encoding;
+        job->handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(job->index_key, Slice(handle_encoding));
+      }
+      delete job;
+      r->jobs.pop_front();
+    } else {
+      i++;
+    }
+  }
+  if (wrote && ok()) {
+    r->status = r->file->Flush();
+  }
+}
+
 Status TableBuilder::ChangeOptions(const Options& options) {
   // Note: if more fields are added to Options, update
   // this function to catch changes that should not be allowed to
@@ -73,6 +255,10 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.filter_policy != rep_->options.filter_policy) {
+    return Status::InvalidArgument(
+        "changing filter policy while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -93,12 +279,28 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    if (r->parallel) {
+      // The handle is not known until the block has been written
+      BlockJob* job = r->jobs.back();
+      job->index_key = r->last_key;
+      job->has_index_key = true;
+      WriteCompletedBlocks(MaxQueuedBlocks());
+    } else {
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+    }
     r->pending_index_entry = false;
   }
 
+  if (r->filter_block != NULL) {
+    if (r->parallel) {
+      PutLengthPrefixedSlice(&r->filter_keys, key);
+    } else {
+      r->filter_block->AddKey(key);
+    }
+  }
+
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
   r->data_block.Add(key, value);
@@ -109,12 +311,36 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
+  if (r->parallel) {
+    BlockJob* job = new BlockJob;
+    job->mu = &r->mu;
+    job->done_cv = &r->done_cv;
+    job->raw = r->data_block.Finish().ToString();
+    job->type = r->options.compression;
+    job->filter_keys.swap(r->filter_keys);
+    job->done = false;
+    job->written = false;
+    job->has_index_key = false;
+    r->data_block.Reset();
+    r->jobs.push_back(job);
+    r->pool->Schedule(&TableBuilder::CompressWork, job);
+    r->pending_index_entry = true;
+    WriteCompletedBlocks(MaxQueuedBlocks());
+    return;
+  }
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
     r->pending_index_entry = true;
@@ -122,6 +348,9 @@ void TableBuilder::Flush() {
     // 的语义.
     r->status = r->file->Flush();
   }
+  if (r->filter_block != NULL) {
+    r->filter_block->StartBlock(r->offset);
+  }
 }
 
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
@@ -134,26 +363,17 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   Slice raw = block->Finish();
 
   Slice block_contents;
-  CompressionType type = r->options.compression;
-  // TODO(postrelease): Support more compression options: zlib?
-  // 科科, 在代码里面大量使用了 <= kLightweightCompression 来判断 compress type 的合法性, 再加 compress
-  // method 不知道有多少坑.
-  switch (type) {
-    case kNoCompression:
-      block_contents = raw;
-      break;
+  CompressionType type = CompressBlock(raw, r->options.compression,
+                                       &r->compressed_output, &block_contents);
+  WriteRawBlock(block_contents, type, handle);
+  r->compressed_output.clear();
+  block->Reset();
+}
 
-    case kLightweightCompression: {
-      port::Lightweight_Compress(raw.data(), raw.size(), &r->compressed_output);
-      block_contents = r->compressed_output;
-      if (block_contents.size() >= raw.size() - (raw.size() / 8u)) {
-        // Compressed less than 12.5%, so just store uncompressed form
-        block_contents = raw;
-        type = kNoCompression;
-      }
-      break;
-    }
-  }
+void TableBuilder::WriteRawBlock(const Slice& block_contents,
+                                 CompressionType type,
+                                 BlockHandle* handle) {
+  Rep* r = rep_;
   handle->set_offset(r->offset);
   handle->set_size(block_contents.size());
   r->status = r->file->Append(block_contents);
@@ -168,8 +388,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
       r->offset += block_contents.size() + kBlockTrailerSize;
     }
   }
-  r->compressed_output.clear();
-  block->Reset();
 }
 
 Status TableBuilder::status() const {
@@ -181,10 +399,50 @@ Status TableBuilder::Finish() {
   Flush();
   assert(!r->closed);
   r->closed = true;
-  BlockHandle metaindex_block_handle;
-  BlockHandle index_block_handle;
+  if (r->parallel) {
+    WriteCompletedBlocks(0);
+    if (!r->jobs.empty()) {
+      // The last data block still needs its index entry
+      assert(r->jobs.size() == 1 && r->pending_index_entry);
+      r->pending_handle = r->jobs.front()->handle;
+      delete r->jobs.front();
+      r->jobs.clear();
+    }
+  }
+  BlockHandle filter_block_handle, metaindex_block_handle;
+  BlockHandle index_block_handle, range_del_block_handle;
+
+  // Write filter block.  It is stored uncompressed so that readers can
+  // use it without having to copy it.
+  if (ok() && r->filter_block != NULL) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+  }
+
+  // Write range tombstone block
+  const bool has_range_dels = !r->range_del_block.empty();
+  if (ok() && has_range_dels) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
+  // Write metaindex block
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
+    if (r->filter_block != NULL) {
+      // Add mapping from "filter.Name" to location of filter data
+      std::string key = "filter.";
+      key.append(r->options.filter_policy->Name());
+      std::string handle_encoding;
+      filter_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(key, handle_encoding);
+    }
+    if (has_range_dels) {
+      // "leveldb.rangedel" sorts after every "filter." key
+      std::string handle_encoding;
+      range_del_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add(kRangeDelBlockName, handle_encoding);
+    }
+
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
@@ -216,6 +474,7 @@ void TableBuilder::Abandon() {
   Rep* r = rep_;
   assert(!r->closed);
   r->closed = true;
+  WaitForCompression();
 }
 
 uint64_t TableBuilder::NumEntries() const {
@@ -10,6 +10,7 @@
 #include "db/write_batch_internal.h"
 #include "include/db.h"
 #include "include/env.h"
+#include "include/filter_policy.h"
 #include "include/iterator.h"
 #include "include/table_builder.h"
 #include "table/block.h"
@@ -411,30 +412,35 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  int compression_threads;
 };
 
 static const TestArgs kTestArgList[] = {
-  { TABLE_TEST, false, 16 },
-  { TABLE_TEST, false, 1 },
-  { TABLE_TEST, false, 1024 },
-  { TABLE_TEST, true, 16 },
-  { TABLE_TEST, true, 1 },
-  { TABLE_TEST, true, 1024 },
-
-  { BLOCK_TEST, false, 16 },
-  { BLOCK_TEST, false, 1 },
-  { BLOCK_TEST, false, 1024 },
-  { BLOCK_TEST, true, 16 },
-  { BLOCK_TEST, true, 1 },
-  { BLOCK_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, 0 },
+  { TABLE_TEST, false, 1, 0 },
+  { TABLE_TEST, false, 1024, 0 },
+  { TABLE_TEST, true, 16, 0 },
+  { TABLE_TEST, true, 1, 0 },
+  { TABLE_TEST, true, 1024, 0 },
+
+  // Parallel block compression
+  { TABLE_TEST, false, 16, 3 },
+  { TABLE_TEST, true, 1, 2 },
+
+  { BLOCK_TEST, false, 16, 0 },
+  { BLOCK_TEST, false, 1, 0 },
+  { BLOCK_TEST, false, 1024, 0 },
+  { BLOCK_TEST, true, 16, 0 },
+  { BLOCK_TEST, true, 1, 0 },
+  { BLOCK_TEST, true, 1024, 0 },
 
   // Restart interval does not matter for memtables
-  { MEMTABLE_TEST, false, 16 },
-  { MEMTABLE_TEST, true, 16 },
+  { MEMTABLE_TEST, false, 16, 0 },
+  { MEMTABLE_TEST, true, 16, 0 },
 
   // Do not bother with restart interval variations for DB
-  { DB_TEST, false, 16 },
-  { DB_TEST, true, 16 },
+  { DB_TEST, false, 16, 0 },
+  { DB_TEST, true, 16, 0 },
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -451,6 +457,7 @@ class Harness {
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.compression_threads = args.compression_threads;
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -801,6 +808,47 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"),    4000,   6000));
 }
 
+static std::string BuildTableContents(const Options& options, int n) {
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < n; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%08d", i);
+    builder.Add(key, test::RandomString(&rnd, rnd.Uniform(300), &value));
+  }
+  ASSERT_OK(builder.Finish());
+  ASSERT_EQ(sink.contents().size(), builder.FileSize());
+  return sink.contents();
+}
+
+TEST(TableTest, ParallelCompressionMatchesSerial) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  for (int with_filter = 0; with_filter < 2; with_filter++) {
+    Options options;
+    options.block_size = 512;
+    options.compression = kLightweightCompression;
+    options.filter_policy = with_filter ? policy : NULL;
+    const std::string serial = BuildTableContents(options, 2000);
+    for (int threads = 1; threads <= 4; threads++) {
+      options.compression_threads = threads;
+      ASSERT_TRUE(BuildTableContents(options, 2000) == serial);
+    }
+  }
+
+  // Building an empty table and abandoning a builder must not hang
+  Options options;
+  options.compression_threads = 2;
+  BuildTableContents(options, 0);
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  builder.Add("a", std::string(10000, 'x'));
+  builder.Add("b", "y");
+  builder.Abandon();
+  delete policy;
+}
+
 }
 
 int main(int argc, char** argv) {
@@ -4,6 +4,7 @@
 
 #include "util/arena.h"
 #include <assert.h>
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -58,6 +59,11 @@ char* Arena::AllocateAligned(size_t bytes) {
   return result;
 }
 
+char* Arena::AllocateConcurrently(size_t bytes) {
+  MutexLock l(&mu_);
+  return AllocateAligned(bytes);
+}
+
 char* Arena::AllocateNewBlock(size_t block_bytes) {
   char* result = new char[block_bytes];
   blocks_memory_ += block_bytes;
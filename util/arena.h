@@ -9,6 +9,7 @@
 #include <vector>
 #include <assert.h>
 #include <stdint.h>
+#include "port/port.h"
 
 namespace leveldb {
 
@@ -25,6 +26,11 @@ class Arena {
   // Allocate memory with the normal alignment guarantees provided by malloc
   char* AllocateAligned(size_t bytes);
 
+  // Like AllocateAligned(), but may be called by several threads at
+  // once.  Must not be mixed with concurrent calls of the other
+  // allocation methods.
+  char* AllocateConcurrently(size_t bytes);
+
   // Returns an estimate of the total memory usage of data allocated
   // by the arena (including space allocated but not yet used for user
   // allocations).
@@ -46,6 +52,9 @@ class Arena {
   // Bytes of memory in blocks allocated so far
   size_t blocks_memory_;
 
+  // Serializes AllocateConcurrently()
+  port::Mutex mu_;
+
   // No copying allowed
   Arena(const Arena&);
   void operator=(const Arena&);
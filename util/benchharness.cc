@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/benchharness.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "include/env.h"
+
+namespace leveldb {
+namespace test {
+
+namespace {
+struct Benchmark {
+  const char* name;
+  void (*func)(int iters);
+};
+std::vector<Benchmark>* benchmarks;
+
+// Nanoseconds taken by one call of "func" doing "iters" operations
+double TimeRun(void (*func)(int), int iters) {
+  Env* env = Env::Default();
+  const uint64_t start = env->NowMicros();
+  (*func)(iters);
+  return (env->NowMicros() - start) * 1e3;
+}
+}
+
+bool RegisterBenchmark(const char* name, void (*func)(int iters)) {
+  if (benchmarks == NULL) {
+    benchmarks = new std::vector<Benchmark>;
+  }
+  Benchmark b;
+  b.name = name;
+  b.func = func;
+  benchmarks->push_back(b);
+  return true;
+}
+
+int RunAllBenchmarks(int argc, char** argv) {
+  const char* filter = NULL;
+  int min_time_ms = 100;
+  int repetitions = 5;
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (sscanf(argv[i], "--min_time_ms=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      min_time_ms = n;
+    } else if (sscanf(argv[i], "--repetitions=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      repetitions = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  fprintf(stdout, "%-36s %12s %12s %12s\n",
+          "benchmark", "median ns/op", "min ns/op", "iters");
+  fprintf(stdout, "------------------------------------------------------"
+          "------------------------------\n");
+  if (benchmarks == NULL) return 0;
+  const double min_nanos = min_time_ms * 1e6;
+  for (size_t i = 0; i < benchmarks->size(); i++) {
+    const Benchmark& b = (*benchmarks)[i];
+    if (filter != NULL && strstr(b.name, filter) == NULL) continue;
+
+    // Let the benchmark build its lazily initialized state, then grow
+    // "iters" until a run is long enough.  These runs also warm up caches.
+    (*b.func)(1);
+    int iters = 1;
+    double nanos = TimeRun(b.func, iters);
+    while (nanos < min_nanos && iters < (1 << 30)) {
+      double scale = (nanos > 0) ? 1.4 * min_nanos / nanos : 10.0;
+      if (scale > 10.0) scale = 10.0;
+      if (scale < 2.0) scale = 2.0;
+      iters = static_cast<int>(std::min(iters * scale, 1073741824.0));
+      nanos = TimeRun(b.func, iters);
+    }
+
+    std::vector<double> per_op;
+    for (int r = 0; r < repetitions; r++) {
+      per_op.push_back(TimeRun(b.func, iters) / iters);
+    }
+    std::sort(per_op.begin(), per_op.end());
+    fprintf(stdout, "%-36s %12.2f %12.2f %12d\n",
+            b.name, per_op[per_op.size() / 2], per_op[0], iters);
+    fflush(stdout);
+  }
+  return 0;
+}
+
+}
+}
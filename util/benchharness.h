@@ -0,0 +1,63 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A minimal harness for microbenchmarks of inner loops, in the spirit of
+// util/testharness.h.  A benchmark is a function that performs its
+// operation "iters" times:
+//
+//   BENCHMARK(Hash_16) {
+//     char buf[16] = { 0 };
+//     for (int i = 0; i < iters; i++) {
+//       DoNotOptimize(Hash(buf, sizeof(buf), i));
+//     }
+//   }
+//
+// RunAllBenchmarks() first calls each benchmark once so that it can build
+// any state it initializes lazily, then runs it with a growing "iters"
+// until one run takes at least --min_time_ms, which also warms up caches.
+// It then repeats that run --repetitions times and reports the median and
+// fastest ns/op.
+
+#ifndef STORAGE_LEVELDB_UTIL_BENCHHARNESS_H_
+#define STORAGE_LEVELDB_UTIL_BENCHHARNESS_H_
+
+namespace leveldb {
+namespace test {
+
+// Run the benchmarks registered by the BENCHMARK() macro, configured by
+// the flags in argv:
+//   --filter=<substring>   only run benchmarks whose name contains it
+//   --min_time_ms=<n>      minimum duration of one timed run
+//   --repetitions=<n>      timed runs per benchmark
+// Returns 0 on success and non-zero for an invalid flag.
+extern int RunAllBenchmarks(int argc, char** argv);
+
+// Keep the computation of "value" from being optimized away.
+template <class T>
+inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static const T* volatile sink;
+  sink = &value;
+#endif
+}
+
+#define BCONCAT(a,b) BCONCAT1(a,b)
+#define BCONCAT1(a,b) a##b
+
+#define BENCHMARK(name)                                                 \
+static void BCONCAT(_Bench_,name)(int iters);                           \
+bool BCONCAT(_Bench_ignored_,name) =                                    \
+  ::leveldb::test::RegisterBenchmark(#name, &BCONCAT(_Bench_,name));    \
+static void BCONCAT(_Bench_,name)(int iters)
+
+// Register the specified benchmark.  Typically not used directly, but
+// invoked via the macro expansion of BENCHMARK.
+extern bool RegisterBenchmark(const char* name, void (*func)(int iters));
+
+}
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_BENCHHARNESS_H_
@@ -0,0 +1,173 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Measures the lookup throughput of the block cache returned by
+// NewLRUCache() with 1, 2, 4, ..., --max_threads concurrent readers.
+// Each lookup hashes a random key, finds it in the cache, reads the
+// value and releases the handle: the same work a table read does on
+// a cache hit.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/cache.h"
+#include "include/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+// Number of distinct keys in the cache
+static int FLAGS_num_keys = 100000;
+
+// Number of lookups done by each thread
+static int FLAGS_lookups = 1000000;
+
+// Largest number of concurrent threads to measure
+static int FLAGS_max_threads = 32;
+
+namespace leveldb {
+
+namespace {
+
+void NoopDeleter(const Slice& key, void* value) { }
+
+struct SharedState {
+  port::Mutex mu;
+  port::CondVar cv;
+  Cache* cache;
+  int total;
+  int num_initialized;
+  int num_done;
+  bool start;
+
+  SharedState() : cv(&mu) { }
+};
+
+struct ThreadState {
+  SharedState* shared;
+  int id;
+  uint64_t misses;
+};
+
+void LookupThread(void* arg) {
+  ThreadState* thread = reinterpret_cast<ThreadState*>(arg);
+  SharedState* shared = thread->shared;
+  {
+    MutexLock l(&shared->mu);
+    shared->num_initialized++;
+    if (shared->num_initialized >= shared->total) {
+      shared->cv.SignalAll();
+    }
+    while (!shared->start) {
+      shared->cv.Wait();
+    }
+  }
+
+  Random rnd(301 + thread->id);
+  char key[4];
+  for (int i = 0; i < FLAGS_lookups; i++) {
+    EncodeFixed32(key, rnd.Uniform(FLAGS_num_keys));
+    Cache::Handle* h = shared->cache->Lookup(Slice(key, sizeof(key)));
+    if (h == NULL) {
+      thread->misses++;
+    } else {
+      shared->cache->Value(h);
+      shared->cache->Release(h);
+    }
+  }
+
+  {
+    MutexLock l(&shared->mu);
+    shared->num_done++;
+    if (shared->num_done >= shared->total) {
+      shared->cv.SignalAll();
+    }
+  }
+}
+
+}  // anonymous namespace
+
+static void Run() {
+  Env* env = Env::Default();
+  Cache* cache = NewLRUCache(FLAGS_num_keys);
+  char key[4];
+  for (int k = 0; k < FLAGS_num_keys; k++) {
+    EncodeFixed32(key, k);
+    cache->Release(cache->Insert(Slice(key, sizeof(key)),
+                                 reinterpret_cast<void*>(k), 1,
+                                 &NoopDeleter));
+  }
+
+  fprintf(stdout, "Keys:       %d\n", FLAGS_num_keys);
+  fprintf(stdout, "Lookups:    %d per thread\n", FLAGS_lookups);
+  fprintf(stdout, "------------------------------------------------\n");
+  for (int n = 1; n <= FLAGS_max_threads; n *= 2) {
+    SharedState shared;
+    shared.cache = cache;
+    shared.total = n;
+    shared.num_initialized = 0;
+    shared.num_done = 0;
+    shared.start = false;
+
+    ThreadState* threads = new ThreadState[n];
+    for (int i = 0; i < n; i++) {
+      threads[i].shared = &shared;
+      threads[i].id = i;
+      threads[i].misses = 0;
+      env->StartThread(&LookupThread, &threads[i]);
+    }
+
+    uint64_t start, finish;
+    shared.mu.Lock();
+    while (shared.num_initialized < n) {
+      shared.cv.Wait();
+    }
+    start = env->NowMicros();
+    shared.start = true;
+    shared.cv.SignalAll();
+    while (shared.num_done < n) {
+      shared.cv.Wait();
+    }
+    finish = env->NowMicros();
+    shared.mu.Unlock();
+
+    uint64_t misses = 0;
+    for (int i = 0; i < n; i++) {
+      misses += threads[i].misses;
+    }
+    delete[] threads;
+
+    const double ops = static_cast<double>(n) * FLAGS_lookups;
+    const double seconds = (finish - start) * 1e-6;
+    fprintf(stdout, "threads %3d : %10.0f lookups/sec; %7.3f micros/op "
+            "(%llu misses)\n",
+            n, ops / seconds, (finish - start) / ops * n,
+            static_cast<unsigned long long>(misses));
+    fflush(stdout);
+  }
+  delete cache;
+}
+
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--num_keys=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_num_keys = n;
+    } else if (sscanf(argv[i], "--lookups=%d%c", &n, &junk) == 1) {
+      FLAGS_lookups = n;
+    } else if (sscanf(argv[i], "--max_threads=%d%c", &n, &junk) == 1) {
+      FLAGS_max_threads = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  leveldb::Run();
+  return 0;
+}
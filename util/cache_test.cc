@@ -5,7 +5,10 @@
 #include "include/cache.h"
 
 #include <vector>
+#include "include/env.h"
+#include "port/port.h"
 #include "util/coding.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -32,7 +35,7 @@ class CacheTest {
     current_->deleted_values_.push_back(DecodeValue(v));
   }
 
-  static const int kCacheSize = 100;
+  static const int kCacheSize = 1000;
   std::vector<int> deleted_keys_;
   std::vector<int> deleted_values_;
   Cache* cache_;
@@ -136,24 +139,43 @@ TEST(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
 
-  // Frequently used entry must be kept around
-  for (int i = 0; i < kCacheSize; i++) {
+  // Frequently used entry must be kept around.  The cache is sharded,
+  // so each shard evicts its own least recently used entries: insert
+  // enough entries to overflow every shard.
+  for (int i = 0; i < kCacheSize + 100; i++) {
     Insert(1000+i, 2000+i);
     ASSERT_EQ(2000+i, Lookup(1000+i));
     ASSERT_EQ(101, Lookup(100));
   }
   ASSERT_EQ(101, Lookup(100));
-  ASSERT_EQ(2, deleted_keys_.size());
-  ASSERT_EQ(200, deleted_keys_[0]);
-  ASSERT_EQ(201, deleted_values_[0]);
+  ASSERT_EQ(-1, Lookup(200));
 }
 
-TEST(CacheTest, HeavyEntry) {
-  Insert(100, 101);
-  Insert(200, 201, kCacheSize);
-  ASSERT_EQ(1, deleted_keys_.size());
-  ASSERT_EQ(100, deleted_keys_[0]);
-  ASSERT_EQ(101, deleted_values_[0]);
+TEST(CacheTest, HeavyEntries) {
+  // Add a bunch of light and heavy entries and then count the combined
+  // size of items still in the cache, which must be approximately the
+  // same as the total capacity.
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2*kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000+index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000+i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize/10);
 }
 
 TEST(CacheTest, NewId) {
@@ -162,6 +184,65 @@ TEST(CacheTest, NewId) {
   ASSERT_NE(a, b);
 }
 
+static const int kNumThreads = 8;
+static const int kOpsPerThread = 20000;
+static const int kNumKeys = 2000;
+
+static void NoopDeleter(const Slice& key, void* v) { }
+
+struct ConcurrentState {
+  Cache* cache;
+  port::AtomicPointer failed;
+  port::AtomicPointer done[kNumThreads];
+};
+
+struct ConcurrentThread {
+  ConcurrentState* state;
+  int id;
+};
+
+static void ConcurrentBody(void* arg) {
+  ConcurrentThread* t = reinterpret_cast<ConcurrentThread*>(arg);
+  Cache* cache = t->state->cache;
+  Random rnd(1000 + t->id);
+  for (int i = 0; i < kOpsPerThread; i++) {
+    const int k = rnd.Uniform(kNumKeys);
+    const std::string key = EncodeKey(k);
+    Cache::Handle* h = cache->Lookup(key);
+    if (h == NULL) {
+      h = cache->Insert(key, EncodeValue(k), 1, &NoopDeleter);
+    }
+    if (DecodeValue(cache->Value(h)) != k) {
+      t->state->failed.Release_Store(t);
+    }
+    cache->Release(h);
+    if (rnd.OneIn(100)) {
+      cache->Erase(key);
+    }
+  }
+  t->state->done[t->id].Release_Store(t);
+}
+
+TEST(CacheTest, ConcurrentAccess) {
+  ConcurrentState state;
+  state.cache = NewLRUCache(kNumKeys / 2);
+  state.failed.Release_Store(NULL);
+  ConcurrentThread threads[kNumThreads];
+  for (int id = 0; id < kNumThreads; id++) {
+    state.done[id].Release_Store(NULL);
+    threads[id].state = &state;
+    threads[id].id = id;
+    Env::Default()->StartThread(&ConcurrentBody, &threads[id]);
+  }
+  for (int id = 0; id < kNumThreads; id++) {
+    while (state.done[id].Acquire_Load() == NULL) {
+      Env::Default()->SleepForMicroseconds(10000);
+    }
+  }
+  ASSERT_TRUE(state.failed.Acquire_Load() == NULL);
+  delete state.cache;
+}
+
 }
 
 int main(int argc, char** argv) {
@@ -3,13 +3,19 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 //
 // A portable implementation of crc32c, optimized to handle
-// four bytes at a time.
+// four bytes at a time, and one using the SSE4.2 crc32 instruction that
+// is picked at runtime on CPUs supporting it.
 
 #include "util/crc32c.h"
 
 #include <stdint.h>
 #include "util/coding.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LEVELDB_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#endif
+
 namespace leveldb {
 namespace crc32c {
 
@@ -283,7 +289,7 @@ static inline uint32_t LE_LOAD32(const uint8_t *p) {
   return DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
   const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
   const uint8_t *e = p + size;
   uint32_t l = crc ^ 0xffffffffu;
@@ -328,5 +334,114 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
   return l ^ 0xffffffffu;
 }
 
+#ifdef LEVELDB_CRC32C_SSE42
+
+// Large buffers are split into three streams of kStride bytes whose
+// crcs are computed together, hiding the latency of the crc32
+// instruction.  The three crcs are then combined by shifting the
+// earlier ones over kStride zero bytes, which is a linear map of the
+// crc state precomputed as byte-wise lookup tables.
+static const size_t kStride = 256;
+
+namespace {
+struct ShiftTable {
+  uint32_t table[4][256];
+
+  __attribute__((target("sse4.2")))
+  ShiftTable() {
+    // Image of each single-bit state after kStride zero bytes
+    uint32_t basis[32];
+    for (int i = 0; i < 32; i++) {
+      uint64_t l = 1u << i;
+      for (size_t j = 0; j < kStride; j += 8) {
+        l = _mm_crc32_u64(l, 0);
+      }
+      basis[i] = static_cast<uint32_t>(l);
+    }
+    for (int k = 0; k < 4; k++) {
+      for (int b = 0; b < 256; b++) {
+        uint32_t v = 0;
+        for (int i = 0; i < 8; i++) {
+          if (b & (1 << i)) {
+            v ^= basis[8 * k + i];
+          }
+        }
+        table[k][b] = v;
+      }
+    }
+  }
+
+  uint32_t Shift(uint32_t l) const {
+    return table[0][l & 0xff] ^ table[1][(l >> 8) & 0xff] ^
+           table[2][(l >> 16) & 0xff] ^ table[3][l >> 24];
+  }
+};
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t ExtendHardware(uint32_t crc, const char* buf, size_t size) {
+  static const ShiftTable shift;
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
+  const uint8_t *e = p + size;
+  uint64_t l = crc ^ 0xffffffffu;
+
+  // Process bytes until p is 8-byte aligned
+  while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+  while (static_cast<size_t>(e - p) >= 3 * kStride) {
+    uint64_t l1 = 0;
+    uint64_t l2 = 0;
+    for (size_t i = 0; i < kStride; i += 8) {
+      l = _mm_crc32_u64(l, DecodeFixed64(
+          reinterpret_cast<const char*>(p + i)));
+      l1 = _mm_crc32_u64(l1, DecodeFixed64(
+          reinterpret_cast<const char*>(p + kStride + i)));
+      l2 = _mm_crc32_u64(l2, DecodeFixed64(
+          reinterpret_cast<const char*>(p + 2 * kStride + i)));
+    }
+    l = shift.Shift(shift.Shift(static_cast<uint32_t>(l)) ^
+                    static_cast<uint32_t>(l1)) ^ static_cast<uint32_t>(l2);
+    p += 3 * kStride;
+  }
+  // Process bytes 8 at a time
+  while ((e-p) >= 8) {
+    l = _mm_crc32_u64(l, DecodeFixed64(reinterpret_cast<const char*>(p)));
+    p += 8;
+  }
+  // Process the last few bytes
+  while (p != e) {
+    l = _mm_crc32_u8(l, *p++);
+  }
+  return static_cast<uint32_t>(l) ^ 0xffffffffu;
+}
+
+#endif  // LEVELDB_CRC32C_SSE42
+
+#ifdef LEVELDB_CRC32C_SSE42
+static bool DetectSSE42() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+bool IsHardwareAccelerated() {
+#ifdef LEVELDB_CRC32C_SSE42
+  static const bool supported = DetectSSE42();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+#ifdef LEVELDB_CRC32C_SSE42
+  if (IsHardwareAccelerated()) {
+    return ExtendHardware(crc, buf, size);
+  }
+#endif
+  return ExtendPortable(crc, buf, size);
+}
+
 }
 }
@@ -18,8 +18,16 @@ namespace crc32c {
 // Return the crc32c of concat(A, data[0,n-1]) where init_crc is the
 // crc32c of some string A.  Extend() is often used to maintain the
 // crc32c of a stream of data.
+// Uses the SSE4.2 crc32 instruction when the CPU supports it.
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// Same as Extend() but always uses the portable table-driven code.
+// Exposed for tests and benchmarks.
+extern uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n);
+
+// Return true iff Extend() uses the crc32 instruction.
+extern bool IsHardwareAccelerated();
+
 // Return the crc32c of data[0,n-1]
 inline uint32_t Value(const char* data, size_t n) {
   return Extend(0, data, n);
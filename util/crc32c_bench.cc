@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Measures the throughput of crc32c::Extend() and of the portable
+// table-driven crc32c::ExtendPortable() for buffers of 16 bytes (a small
+// log record) up to 1MB.  Both run over the same data, checksumming
+// about --total_mb of bytes per buffer size.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/env.h"
+#include "util/crc32c.h"
+#include "util/random.h"
+
+// Megabytes checksummed for each buffer size
+static int FLAGS_total_mb = 1000;
+
+namespace leveldb {
+
+typedef uint32_t (*ExtendFunction)(uint32_t, const char*, size_t);
+
+static double Measure(ExtendFunction extend, const std::string& data,
+                      size_t size, uint32_t* crc) {
+  Env* env = Env::Default();
+  const size_t count = data.size() / size;
+  const long long total = static_cast<long long>(FLAGS_total_mb) << 20;
+  long long done = 0;
+  uint64_t start = env->NowMicros();
+  while (done < total) {
+    // Rotate through the buffer so the data is not always in L1
+    for (size_t i = 0; i < count && done < total; i++) {
+      *crc = (*extend)(*crc, data.data() + i * size, size);
+      done += size;
+    }
+  }
+  uint64_t finish = env->NowMicros();
+  return (done / 1048576.0) / ((finish - start) * 1e-6);
+}
+
+static void Run() {
+  Random rnd(301);
+  std::string data;
+  for (int i = 0; i < (4 << 20); i++) {
+    data.push_back(static_cast<char>(rnd.Uniform(256)));
+  }
+
+  fprintf(stdout, "Hardware:   %s\n",
+          crc32c::IsHardwareAccelerated() ? "sse4.2" : "not available");
+  fprintf(stdout, "Total:      %d MB per size\n", FLAGS_total_mb);
+  fprintf(stdout, "------------------------------------------------\n");
+  for (size_t size = 16; size <= (1 << 20); size *= 4) {
+    uint32_t crc = 0;
+    const double portable = Measure(&crc32c::ExtendPortable, data, size, &crc);
+    const double fast = Measure(&crc32c::Extend, data, size, &crc);
+    fprintf(stdout, "%8d bytes : portable %8.1f MB/s; extend %8.1f MB/s "
+            "(%.1fx) crc=0x%08x\n",
+            static_cast<int>(size), portable, fast, fast / portable, crc);
+    fflush(stdout);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--total_mb=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_total_mb = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  leveldb::Run();
+  return 0;
+}
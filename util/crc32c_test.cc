@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "util/crc32c.h"
+#include "util/random.h"
 #include "util/testharness.h"
 
 namespace leveldb {
@@ -56,6 +57,22 @@ TEST(CRC, Extend) {
             Extend(Value("hello ", 6), "world", 5));
 }
 
+TEST(CRC, MatchesPortable) {
+  // Cover every alignment and the lengths around the interleaved path
+  Random rnd(301);
+  std::string data;
+  for (int i = 0; i < 4096; i++) {
+    data.push_back(static_cast<char>(rnd.Uniform(256)));
+  }
+  for (int offset = 0; offset < 8; offset++) {
+    for (size_t n = 0; n + offset <= data.size(); n += 1 + n / 16) {
+      const char* p = data.data() + offset;
+      ASSERT_EQ(ExtendPortable(0, p, n), Extend(0, p, n));
+      ASSERT_EQ(ExtendPortable(0x12345678, p, n), Extend(0x12345678, p, n));
+    }
+  }
+}
+
 TEST(CRC, Mask) {
   uint32_t crc = Value("foo", 3);
   ASSERT_NE(crc, Mask(crc));
@@ -222,6 +222,37 @@ class ChromiumFileLock : public FileLock {
   ::base::PlatformFile file_;
 };
 
+// A FIFO of background work items served by a growable set of threads.
+// ChromiumEnv keeps one pool per Env::Priority.
+class ChromiumThreadPool {
+ public:
+  ChromiumThreadPool();
+
+  void Schedule(void (*function)(void*), void* arg);
+  void SetBackgroundThreads(int number);
+
+ private:
+  // Start threads until total_threads_ are running.
+  // REQUIRES: mu_ is held
+  void StartThreadsLocked();
+
+  // BGThread() is the body of each background thread
+  void BGThread();
+  static void BGThreadWrapper(void* arg) {
+    reinterpret_cast<ChromiumThreadPool*>(arg)->BGThread();
+  }
+
+  ::base::Lock mu_;
+  ::base::ConditionVariable bgsignal_;
+  int started_threads_;
+  int total_threads_;
+
+  // Entry per Schedule() call
+  struct BGItem { void* arg; void (*function)(void*); };
+  typedef std::deque<BGItem> BGQueue;
+  BGQueue queue_;
+};
+
 class ChromiumEnv : public Env {
  public:
   ChromiumEnv();
@@ -373,7 +404,10 @@ class ChromiumEnv : public Env {
     return result;
   }
 
-  virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void Schedule(void (*function)(void*), void* arg,
+                        Priority pri = LOW);
+
+  virtual void SetBackgroundThreads(int number, Priority pri = LOW);
 
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
@@ -469,8 +503,12 @@ class ChromiumEnv : public Env {
       }
 
       assert(p <= limit);
-      info_log->Append(Slice(base, p - base));
-      info_log->Flush();
+      {
+        // Several background threads of a DB may log to it at once
+        ::base::AutoLock l(log_mu_);
+        info_log->Append(Slice(base, p - base));
+        info_log->Flush();
+      }
       if (base != buffer) {
         delete[] base;
       }
@@ -502,29 +540,15 @@ class ChromiumEnv : public Env {
   }
 
  private:
-  // BGThread() is the body of the background thread
-  void BGThread();
-  static void BGThreadWrapper(void* arg) {
-    reinterpret_cast<ChromiumEnv*>(arg)->BGThread();
-  }
-
   FilePath test_directory_;
 
   size_t page_size_;
-  ::base::Lock mu_;
-  ::base::ConditionVariable bgsignal_;
-  bool started_bgthread_;
-
-  // Entry per Schedule() call
-  struct BGItem { void* arg; void (*function)(void*); };
-  typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+  ChromiumThreadPool pools_[2];  // Indexed by Env::Priority
+  ::base::Lock log_mu_;  // Serializes Logv() writes
 };
 
 ChromiumEnv::ChromiumEnv()
-    : page_size_(::base::SysInfo::VMAllocationGranularity()),
-      bgsignal_(&mu_),
-      started_bgthread_(false) {
+    : page_size_(::base::SysInfo::VMAllocationGranularity()) {
 #if defined(OS_MACOSX)
   ::base::EnableTerminationOnHeapCorruption();
   ::base::EnableTerminationOnOutOfMemory();
@@ -535,8 +559,8 @@ class Thread : public ::base::PlatformThread::Delegate {
  public:
   Thread(void (*function)(void* arg), void* arg)
       : function_(function), arg_(arg) {
-    ::base::PlatformThreadHandle handle;
-    bool success = ::base::PlatformThread::Create(0, this, &handle);
+    // Nobody joins the thread, so let it release its stack when it exits
+    bool success = ::base::PlatformThread::CreateNonJoinable(0, this);
     DCHECK(success);
   }
   virtual ~Thread() {}
@@ -550,30 +574,48 @@ class Thread : public ::base::PlatformThread::Delegate {
   void* arg_;
 };
 
-void ChromiumEnv::Schedule(void (*function)(void*), void* arg) {
-  mu_.Acquire();
+ChromiumThreadPool::ChromiumThreadPool()
+    : bgsignal_(&mu_),
+      started_threads_(0),
+      total_threads_(1) {
+}
 
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
-    StartThread(&ChromiumEnv::BGThreadWrapper, this);
+void ChromiumThreadPool::StartThreadsLocked() {
+  while (started_threads_ < total_threads_) {
+    started_threads_++;
+    // Will self-delete.
+    new Thread(&ChromiumThreadPool::BGThreadWrapper, this);
   }
+}
 
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    bgsignal_.Signal();
+void ChromiumThreadPool::SetBackgroundThreads(int number) {
+  mu_.Acquire();
+  if (number > total_threads_) {
+    total_threads_ = number;
+    if (started_threads_ > 0) {
+      StartThreadsLocked();
+    }
   }
+  mu_.Release();
+}
+
+void ChromiumThreadPool::Schedule(void (*function)(void*), void* arg) {
+  mu_.Acquire();
+
+  // Start background threads if necessary
+  StartThreadsLocked();
 
-  // Add to priority queue
   queue_.push_back(BGItem());
   queue_.back().function = function;
   queue_.back().arg = arg;
 
+  // Wake one idle thread
+  bgsignal_.Signal();
+
   mu_.Release();
 }
 
-void ChromiumEnv::BGThread() {
+void ChromiumThreadPool::BGThread() {
   while (true) {
     // Wait until there is an item that is ready to run
     mu_.Acquire();
@@ -590,6 +632,14 @@ void ChromiumEnv::BGThread() {
   }
 }
 
+void ChromiumEnv::Schedule(void (*function)(void*), void* arg, Priority pri) {
+  pools_[pri].Schedule(function, arg);
+}
+
+void ChromiumEnv::SetBackgroundThreads(int number, Priority pri) {
+  pools_[pri].SetBackgroundThreads(number);
+}
+
 void ChromiumEnv::StartThread(void (*function)(void* arg), void* arg) {
   new Thread(function, arg); // Will self-delete.
 }
@@ -3,6 +3,7 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <deque>
+#include <vector>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -23,6 +24,7 @@
 #include "include/slice.h"
 #include "port/port.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -276,8 +278,108 @@ class PosixFileLock : public FileLock {
   int fd_;
 };
 
+static void PthreadCall(const char* label, int result) {
+  if (result != 0) {
+    fprintf(stderr, "pthread %s: %s\n", label, strerror(result));
+    exit(1);
+  }
+}
+
+// A FIFO of background work items served by a growable set of threads.
+// PosixEnv keeps one pool per Env::Priority.
+class PosixThreadPool {
+ public:
+  PosixThreadPool();
+
+  void Schedule(void (*function)(void*), void* arg);
+  void SetBackgroundThreads(int number);
+
+ private:
+  // Start threads until total_threads_ are running.
+  // REQUIRES: mu_ is held
+  void StartThreadsLocked();
+
+  // BGThread() is the body of each background thread
+  void BGThread();
+  static void* BGThreadWrapper(void* arg) {
+    reinterpret_cast<PosixThreadPool*>(arg)->BGThread();
+    return NULL;
+  }
+
+  pthread_mutex_t mu_;
+  pthread_cond_t bgsignal_;
+  std::vector<pthread_t> bgthreads_;
+  int total_threads_;
+
+  // Entry per Schedule() call
+  struct BGItem { void* arg; void (*function)(void*); };
+  typedef std::deque<BGItem> BGQueue;
+  BGQueue queue_;
+};
+
+PosixThreadPool::PosixThreadPool() : total_threads_(1) {
+  PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
+  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
+}
+
+void PosixThreadPool::StartThreadsLocked() {
+  while (static_cast<int>(bgthreads_.size()) < total_threads_) {
+    pthread_t t;
+    PthreadCall(
+        "create thread",
+        pthread_create(&t, NULL,  &PosixThreadPool::BGThreadWrapper, this));
+    bgthreads_.push_back(t);
+  }
+}
+
+void PosixThreadPool::SetBackgroundThreads(int number) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+  if (number > total_threads_) {
+    total_threads_ = number;
+    if (!bgthreads_.empty()) {
+      StartThreadsLocked();
+    }
+  }
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
+
+void PosixThreadPool::Schedule(void (*function)(void*), void* arg) {
+  PthreadCall("lock", pthread_mutex_lock(&mu_));
+
+  // Start background threads if necessary
+  StartThreadsLocked();
+
+  queue_.push_back(BGItem());
+  queue_.back().function = function;
+  queue_.back().arg = arg;
+
+  // Wake one idle thread.  With several threads in the pool we cannot
+  // skip this when the queue was non-empty: the running threads may all
+  // be busy while another sleeps.
+  PthreadCall("signal", pthread_cond_signal(&bgsignal_));
+
+  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+}
+
+void PosixThreadPool::BGThread() {
+  while (true) {
+    // Wait until there is an item that is ready to run
+    PthreadCall("lock", pthread_mutex_lock(&mu_));
+    while (queue_.empty()) {
+      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
+    }
+
+    void (*function)(void*) = queue_.front().function;
+    void* arg = queue_.front().arg;
+    queue_.pop_front();
+
+    PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+    (*function)(arg);
+  }
+}
+
 /*
- * PosixEnv 仅使用 1 个线程来负责处理 Env::Schedule().
+ * PosixEnv 为每个 Env::Priority 维护一个线程池来负责处理 Env::Schedule(), 默认每个线程池 1 个线程.
  */
 class PosixEnv : public Env {
  public:
@@ -421,7 +523,10 @@ class PosixEnv : public Env {
     return result;
   }
 
-  virtual void Schedule(void (*function)(void*), void* arg);
+  virtual void Schedule(void (*function)(void*), void* arg,
+                        Priority pri = LOW);
+
+  virtual void SetBackgroundThreads(int number, Priority pri = LOW);
 
   virtual void StartThread(void (*function)(void* arg), void* arg);
 
@@ -509,8 +614,12 @@ class PosixEnv : public Env {
       }
 
       assert(p <= limit);
-      info_log->Append(Slice(base, p - base));
-      info_log->Flush();
+      {
+        // Several background threads of a DB may log to it at once
+        MutexLock l(&log_mu_);
+        info_log->Append(Slice(base, p - base));
+        info_log->Flush();
+      }
       if (base != buffer) {
         delete[] base;
       }
@@ -529,78 +638,22 @@ class PosixEnv : public Env {
   }
 
  private:
-  void PthreadCall(const char* label, int result) {
-    if (result != 0) {
-      fprintf(stderr, "pthread %s: %s\n", label, strerror(result));
-      exit(1);
-    }
-  }
-
-  // BGThread() is the body of the background thread
-  void BGThread();
-  static void* BGThreadWrapper(void* arg) {
-    reinterpret_cast<PosixEnv*>(arg)->BGThread();
-    return NULL;
-  }
-
   size_t page_size_;
-  pthread_mutex_t mu_;
-  pthread_cond_t bgsignal_;
-  pthread_t bgthread_;
-  bool started_bgthread_;
-
-  // Entry per Schedule() call
-  struct BGItem { void* arg; void (*function)(void*); };
-  typedef std::deque<BGItem> BGQueue;
-  BGQueue queue_;
+  PosixThreadPool pools_[2];  // Indexed by Env::Priority
+  port::Mutex log_mu_;  // Serializes Logv() writes
 };
 
-PosixEnv::PosixEnv() : page_size_(getpagesize()),
-                       started_bgthread_(false) {
-  PthreadCall("mutex_init", pthread_mutex_init(&mu_, NULL));
-  PthreadCall("cvar_init", pthread_cond_init(&bgsignal_, NULL));
+PosixEnv::PosixEnv() : page_size_(getpagesize()) {
 }
 
-void PosixEnv::Schedule(void (*function)(void*), void* arg) {
-  PthreadCall("lock", pthread_mutex_lock(&mu_));
-
-  // Start background thread if necessary
-  if (!started_bgthread_) {
-    started_bgthread_ = true;
-    PthreadCall(
-        "create thread",
-        pthread_create(&bgthread_, NULL,  &PosixEnv::BGThreadWrapper, this));
-  }
-
-  // If the queue is currently empty, the background thread may currently be
-  // waiting.
-  if (queue_.empty()) {
-    PthreadCall("signal", pthread_cond_signal(&bgsignal_));
-  }
-
-  // Add to priority queue
-  queue_.push_back(BGItem());
-  queue_.back().function = function;
-  queue_.back().arg = arg;
-
-  PthreadCall("unlock", pthread_mutex_unlock(&mu_));
+void PosixEnv::Schedule(void (*function)(void*), void* arg, Priority pri) {
+  assert(pri == LOW || pri == HIGH);
+  pools_[pri].Schedule(function, arg);
 }
 
-void PosixEnv::BGThread() {
-  while (true) {
-    // Wait until there is an item that is ready to run
-    PthreadCall("lock", pthread_mutex_lock(&mu_));
-    while (queue_.empty()) {
-      PthreadCall("wait", pthread_cond_wait(&bgsignal_, &mu_));
-    }
-
-    void (*function)(void*) = queue_.front().function;
-    void* arg = queue_.front().arg;
-    queue_.pop_front();
-
-    PthreadCall("unlock", pthread_mutex_unlock(&mu_));
-    (*function)(arg);
-  }
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  assert(pri == LOW || pri == HIGH);
+  pools_[pri].SetBackgroundThreads(number);
 }
 
 namespace {
@@ -623,6 +676,8 @@ void PosixEnv::StartThread(void (*function)(void* arg), void* arg) {
   state->arg = arg;
   PthreadCall("start thread",
               pthread_create(&t, NULL,  &StartThreadWrapper, state));
+  // Nobody joins the thread, so let it release its stack when it exits
+  PthreadCall("detach thread", pthread_detach(t));
 }
 
 }
@@ -95,6 +95,71 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+// A work item that blocks until released, for checking which pools
+// keep making progress while one of their threads is busy.
+struct Gate {
+  port::Mutex mu;
+  port::CondVar cv;
+  bool open;
+  int entered;
+  Gate() : cv(&mu), open(false), entered(0) { }
+
+  static void Block(void* arg) {
+    Gate* g = reinterpret_cast<Gate*>(arg);
+    g->mu.Lock();
+    g->entered++;
+    while (!g->open) {
+      g->cv.Wait();
+    }
+    g->mu.Unlock();
+  }
+
+  void Open() {
+    mu.Lock();
+    open = true;
+    cv.SignalAll();
+    mu.Unlock();
+  }
+
+  int Entered() {
+    mu.Lock();
+    int result = entered;
+    mu.Unlock();
+    return result;
+  }
+};
+
+TEST(EnvPosixTest, HighPriorityDoesNotWaitForLow) {
+  Gate gate;
+  env_->Schedule(&Gate::Block, &gate, Env::LOW);
+  bool low_called = false;
+  env_->Schedule(&SetBool, &low_called, Env::LOW);
+  bool high_called = false;
+  env_->Schedule(&SetBool, &high_called, Env::HIGH);
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_EQ(1, gate.Entered());
+  ASSERT_TRUE(high_called);
+  ASSERT_TRUE(!low_called);
+
+  gate.Open();
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_TRUE(low_called);
+}
+
+// Must be last: the extra threads stay in Env::Default() and would
+// break the FIFO ordering checked by RunMany.
+TEST(EnvPosixTest, SetBackgroundThreads) {
+  env_->SetBackgroundThreads(3, Env::LOW);
+  Gate gate;
+  for (int i = 0; i < 3; i++) {
+    env_->Schedule(&Gate::Block, &gate, Env::LOW);
+  }
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+  ASSERT_EQ(3, gate.Entered());
+  gate.Open();
+  Env::Default()->SleepForMicroseconds(kDelayMicros);
+}
+
 }
 
 int main(int argc, char** argv) {
@@ -4,30 +4,32 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <algorithm>
 #include "port/port.h"
 #include "util/histogram.h"
 
 namespace leveldb {
 
 const double Histogram::kBucketLimit[kNumBuckets] = {
-  1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 16, 18, 20, 25, 30, 35, 40, 45,
-  50, 60, 70, 80, 90, 100, 120, 140, 160, 180, 200, 250, 300, 350, 400, 450,
-  500, 600, 700, 800, 900, 1000, 1200, 1400, 1600, 1800, 2000, 2500, 3000,
-  3500, 4000, 4500, 5000, 6000, 7000, 8000, 9000, 10000, 12000, 14000,
-  16000, 18000, 20000, 25000, 30000, 35000, 40000, 45000, 50000, 60000,
-  70000, 80000, 90000, 100000, 120000, 140000, 160000, 180000, 200000,
-  250000, 300000, 350000, 400000, 450000, 500000, 600000, 700000, 800000,
-  900000, 1000000, 1200000, 1400000, 1600000, 1800000, 2000000, 2500000,
-  3000000, 3500000, 4000000, 4500000, 5000000, 6000000, 7000000, 8000000,
-  9000000, 10000000, 12000000, 14000000, 16000000, 18000000, 20000000,
-  25000000, 30000000, 35000000, 40000000, 45000000, 50000000, 60000000,
-  70000000, 80000000, 90000000, 100000000, 120000000, 140000000, 160000000,
-  180000000, 200000000, 250000000, 300000000, 350000000, 400000000,
-  450000000, 500000000, 600000000, 700000000, 800000000, 900000000,
-  1000000000, 1200000000, 1400000000, 1600000000, 1800000000, 2000000000,
-  2500000000.0, 3000000000.0, 3500000000.0, 4000000000.0, 4500000000.0,
-  5000000000.0, 6000000000.0, 7000000000.0, 8000000000.0, 9000000000.0,
-  1e200,
+  0.25, 0.5, 0.75, 1, 1.5, 2, 2.5, 3, 3.5, 4, 4.5, 5, 5.5, 6, 6.5, 7, 7.5, 8,
+  8.5, 9, 9.5, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 25, 30, 35, 40,
+  45, 50, 55, 60, 65, 70, 75, 80, 85, 90, 95, 100, 110, 120, 130, 140, 150,
+  160, 170, 180, 190, 200, 250, 300, 350, 400, 450, 500, 550, 600, 650, 700,
+  750, 800, 850, 900, 950, 1000, 1200, 1400, 1600, 1800, 2000, 2500, 3000,
+  3500, 4000, 4500, 5000, 6000, 7000, 8000, 9000, 10000, 12000, 14000, 16000,
+  18000, 20000, 25000, 30000, 35000, 40000, 45000, 50000, 60000, 70000,
+  80000, 90000, 100000, 120000, 140000, 160000, 180000, 200000, 250000,
+  300000, 350000, 400000, 450000, 500000, 600000, 700000, 800000, 900000,
+  1000000, 1200000, 1400000, 1600000, 1800000, 2000000, 2500000, 3000000,
+  3500000, 4000000, 4500000, 5000000, 6000000, 7000000, 8000000, 9000000,
+  10000000, 12000000, 14000000, 16000000, 18000000, 20000000, 25000000,
+  30000000, 35000000, 40000000, 45000000, 50000000, 60000000, 70000000,
+  80000000, 90000000, 100000000, 120000000, 140000000, 160000000, 180000000,
+  200000000, 250000000, 300000000, 350000000, 400000000, 450000000,
+  500000000, 600000000, 700000000, 800000000, 900000000, 1000000000,
+  1200000000, 1400000000, 1600000000, 1800000000, 2000000000, 2500000000.0,
+  3000000000.0, 3500000000.0, 4000000000.0, 4500000000.0, 5000000000.0,
+  6000000000.0, 7000000000.0, 8000000000.0, 9000000000.0, 1e200,
 };
 
 void Histogram::Clear() {
@@ -42,11 +44,9 @@ void Histogram::Clear() {
 }
 
 void Histogram::Add(double value) {
-  // Linear search is fast enough for our usage in db_bench
-  int b = 0;
-  while (b < kNumBuckets - 1 && kBucketLimit[b] <= value) {
-    b++;
-  }
+  // First bucket whose limit is above "value"; the last limit is 1e200
+  int b = std::upper_bound(kBucketLimit, kBucketLimit + kNumBuckets - 1,
+                           value) - kBucketLimit;
   buckets_[b] += 1.0;
   if (min_ > value) min_ = value;
   if (max_ < value) max_ = value;
@@ -55,11 +55,23 @@ void Histogram::Add(double value) {
   sum_squares_ += (value * value);
 }
 
+void Histogram::Merge(const Histogram& other) {
+  if (other.min_ < min_) min_ = other.min_;
+  if (other.max_ > max_) max_ = other.max_;
+  num_ += other.num_;
+  sum_ += other.sum_;
+  sum_squares_ += other.sum_squares_;
+  for (int b = 0; b < kNumBuckets; b++) {
+    buckets_[b] += other.buckets_[b];
+  }
+}
+
 double Histogram::Median() const {
   return Percentile(50.0);
 }
 
 double Histogram::Percentile(double p) const {
+  if (num_ == 0.0) return 0;
   double threshold = num_ * (p / 100.0);
   double sum = 0;
   for (int b = 0; b < kNumBuckets; b++) {
@@ -102,7 +114,12 @@ std::string Histogram::ToString() const {
   r.append(buf);
   snprintf(buf, sizeof(buf),
            "Min: %.4f  Median: %.4f  Max: %.4f\n",
-           (num_ == 0.0 ? 0.0 : min_), Median(), max_);
+           Min(), Median(), max_);
+  r.append(buf);
+  snprintf(buf, sizeof(buf),
+           "P50: %.2f  P95: %.2f  P99: %.2f  P99.9: %.2f  P99.99: %.2f\n",
+           Percentile(50), Percentile(95), Percentile(99), Percentile(99.9),
+           Percentile(99.99));
   r.append(buf);
   r.append("------------------------------------------------------\n");
   const double mult = 100.0 / num_;
@@ -111,7 +128,7 @@ std::string Histogram::ToString() const {
     if (buckets_[b] <= 0.0) continue;
     sum += buckets_[b];
     snprintf(buf, sizeof(buf),
-             "[ %7.0f, %7.0f ) %7.0f %7.3f%% %7.3f%% ",
+             "[ %9.2f, %9.2f ) %7.0f %7.3f%% %7.3f%% ",
              ((b == 0) ? 0.0 : kBucketLimit[b-1]),      // left
              kBucketLimit[b],                           // right
              buckets_[b],                               // count
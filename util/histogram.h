@@ -22,6 +22,22 @@ class Histogram {
   void Clear();
   void Add(double value);
 
+  // Fold the values added to "other" into this histogram.
+  void Merge(const Histogram& other);
+
+  // Number of values added since the last Clear()
+  double Count() const { return num_; }
+  double Min() const { return num_ == 0.0 ? 0.0 : min_; }
+  double Max() const { return max_; }
+  double Average() const;
+  double StandardDeviation() const;  // 标准差, 参见 wiki
+
+  double Median() const;
+  // 计算 p% 的值的边界. 如: Percentile(90.0) == 1.3 表明 90% 的值都小于 1.3
+  // The value is interpolated inside its bucket, and never falls outside
+  // [Min(), Max()], so Percentile(100.0) == Max().
+  double Percentile(double p) const;
+
   std::string ToString() const;
 
  private:
@@ -31,16 +47,10 @@ class Histogram {
   double sum_;  // 待统计值之和.
   double sum_squares_;  // 待统计值平方的和. 所以不应该叫 squares_sum_ 么?==
 
-  enum { kNumBuckets = 154 };
+  enum { kNumBuckets = 186 };
   static const double kBucketLimit[kNumBuckets];
   // buckets_[i] 存放着取值介于 [kBucketLimit[i - 1], kBucketLimit[i]) 之间的值的个数.
   double buckets_[kNumBuckets];
-
-  double Median() const;
-  // 计算 p% 的值的边界. 如: Percentile(90.0) == 1.3 表明 90% 的值都小于 1.3
-  double Percentile(double p) const;
-  double Average() const;
-  double StandardDeviation() const;  // 标准差, 参见 wiki
 };
 
 }
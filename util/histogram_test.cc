@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/histogram.h"
+
+#include <math.h>
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class HistogramTest { };
+
+TEST(HistogramTest, Empty) {
+  Histogram h;
+  h.Clear();
+  ASSERT_EQ(0.0, h.Count());
+  ASSERT_EQ(0.0, h.Min());
+  ASSERT_EQ(0.0, h.Max());
+  ASSERT_EQ(0.0, h.Percentile(99.0));
+}
+
+TEST(HistogramTest, Percentiles) {
+  Histogram h;
+  h.Clear();
+  for (int i = 1; i <= 10000; i++) {
+    h.Add(i * 0.1);
+  }
+  ASSERT_EQ(10000.0, h.Count());
+  ASSERT_TRUE(fabs(h.Min() - 0.1) < 1e-9);
+  ASSERT_TRUE(fabs(h.Max() - 1000.0) < 1e-9);
+  ASSERT_TRUE(fabs(h.Average() - 500.05) < 1e-6);
+  ASSERT_EQ(h.Max(), h.Percentile(100.0));
+
+  // Interpolation inside a bucket can only be off by the bucket width
+  ASSERT_TRUE(fabs(h.Percentile(50.0) - 500.0) <= 50.0);
+  ASSERT_TRUE(fabs(h.Percentile(99.0) - 990.0) <= 50.0);
+  ASSERT_TRUE(fabs(h.Percentile(1.0) - 10.0) <= 1.0);
+  ASSERT_TRUE(h.Percentile(99.9) <= h.Percentile(99.99));
+}
+
+TEST(HistogramTest, SubMicrosecondBuckets) {
+  Histogram h;
+  h.Clear();
+  for (int i = 0; i < 99; i++) {
+    h.Add(0.1);
+  }
+  h.Add(5.0);
+  ASSERT_TRUE(h.Percentile(50.0) <= 0.25);
+  ASSERT_EQ(5.0, h.Percentile(100.0));
+}
+
+TEST(HistogramTest, Merge) {
+  Histogram a, b, all;
+  a.Clear();
+  b.Clear();
+  all.Clear();
+  for (int i = 0; i < 1000; i++) {
+    const double v = (i * 7919) % 5000;
+    if (i % 3 == 0) {
+      a.Add(v);
+    } else {
+      b.Add(v);
+    }
+    all.Add(v);
+  }
+  a.Merge(b);
+  ASSERT_EQ(all.Count(), a.Count());
+  ASSERT_EQ(all.Min(), a.Min());
+  ASSERT_EQ(all.Max(), a.Max());
+  ASSERT_EQ(all.Average(), a.Average());
+  ASSERT_EQ(all.Percentile(99.0), a.Percentile(99.0));
+  ASSERT_EQ(all.ToString(), a.ToString());
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
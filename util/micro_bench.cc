@@ -0,0 +1,344 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Microbenchmarks of the inner loops that end-to-end db_bench runs are too
+// noisy to judge: SkipList, Block seeks, varint coding, Arena, the LRU
+// cache, crc32c and Hash.  Run them with "make bench"; util/benchharness.h
+// describes the flags of ./micro_bench.
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "db/skiplist.h"
+#include "include/cache.h"
+#include "include/comparator.h"
+#include "include/iterator.h"
+#include "include/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "util/arena.h"
+#include "util/benchharness.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+#include "util/random.h"
+
+namespace leveldb {
+namespace test {
+
+namespace {
+
+// Distinct for distinct "i", and spread over the whole key space
+inline uint64_t Scramble(uint64_t i) {
+  return i * 0x9e3779b97f4a7c15ull;
+}
+
+// Fill "key" with "size - 8" bytes of a common prefix followed by the
+// big-endian "v", so that comparisons have to look at the whole key.
+inline void MakeKey(char* key, size_t size, uint64_t v) {
+  memset(key, 'k', size - 8);
+  for (int i = 0; i < 8; i++) {
+    key[size - 1 - i] = static_cast<char>(v >> (i * 8));
+  }
+}
+
+struct FixedKeyComparator {
+  size_t size;
+  explicit FixedKeyComparator(size_t s) : size(s) { }
+  int operator()(const char* a, const char* b) const {
+    return memcmp(a, b, size);
+  }
+};
+
+typedef SkipList<const char*, FixedKeyComparator> KeyList;
+
+// The benchmarks below build their inputs once, in a static, so that a
+// timed call only runs the operation under test.  Target sets are a
+// power of two in size so that they are indexed with a mask.
+static const int kNumTargets = 1 << 16;
+
+// kNumTargets distinct keys in random order, to insert
+std::vector<const char*>* BuildInsertKeys(size_t key_size) {
+  Arena* arena = new Arena;   // Never freed
+  std::vector<const char*>* keys = new std::vector<const char*>;
+  for (int i = 0; i < kNumTargets; i++) {
+    char* key = arena->Allocate(key_size);
+    MakeKey(key, key_size, Scramble(i));
+    keys->push_back(key);
+  }
+  return keys;
+}
+
+// Inserts into lists of at most kNumTargets keys, so that the cost of an
+// insert does not depend on "iters".  A fresh list is started whenever
+// the keys run out, since a list cannot hold duplicates.
+void SkipListInsert(int iters, size_t key_size,
+                    const std::vector<const char*>& keys) {
+  int i = 0;
+  while (i < iters) {
+    Arena arena;
+    KeyList list(FixedKeyComparator(key_size), &arena);
+    for (int j = 0; j < kNumTargets && i < iters; j++, i++) {
+      list.Insert(keys[j]);
+    }
+  }
+}
+
+// A list of 100000 keys, and seek targets half of which are missing
+struct SkipListFixture {
+  KeyList* list;
+  std::vector<const char*> targets;
+};
+
+SkipListFixture* BuildSkipListFixture(size_t key_size) {
+  Arena* arena = new Arena;   // Never freed
+  SkipListFixture* f = new SkipListFixture;
+  f->list = new KeyList(FixedKeyComparator(key_size), arena);
+  for (int i = 0; i < 200000; i += 2) {
+    char* key = arena->Allocate(key_size);
+    MakeKey(key, key_size, Scramble(i));
+    f->list->Insert(key);
+  }
+  Random rnd(301);
+  for (int i = 0; i < kNumTargets; i++) {
+    char* target = arena->Allocate(key_size);
+    MakeKey(target, key_size, Scramble(rnd.Uniform(200000)));
+    f->targets.push_back(target);
+  }
+  return f;
+}
+
+void SkipListSeek(int iters, SkipListFixture* f) {
+  KeyList::Iterator iter(f->list);
+  for (int i = 0; i < iters; i++) {
+    iter.Seek(f->targets[i & (kNumTargets - 1)]);
+    DoNotOptimize(iter.Valid());
+  }
+}
+
+// A 32KB block of 16 byte keys "%016d" of the even numbers, and seek
+// targets half of which are missing
+struct BlockFixture {
+  Block* block;
+  std::vector<std::string> targets;
+};
+
+BlockFixture* BuildBlockFixture(int restart_interval) {
+  Options options;
+  options.block_restart_interval = restart_interval;
+  BlockBuilder builder(&options);
+  const std::string value(16, 'v');
+  int n = 0;
+  while (builder.CurrentSizeEstimate() < 32768) {
+    char key[20];
+    snprintf(key, sizeof(key), "%016d", 2 * n);
+    builder.Add(key, value);
+    n++;
+  }
+  Slice contents = builder.Finish();
+  char* data = new char[contents.size()];
+  memcpy(data, contents.data(), contents.size());
+
+  BlockFixture* f = new BlockFixture;   // Never freed
+  f->block = new Block(data, contents.size());
+  Random rnd(301);
+  for (int i = 0; i < kNumTargets; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "%016d", rnd.Uniform(2 * n));
+    f->targets.push_back(key);
+  }
+  return f;
+}
+
+void BlockSeek(int iters, BlockFixture* f) {
+  Iterator* iter = f->block->NewIterator(BytewiseComparator());
+  for (int i = 0; i < iters; i++) {
+    iter->Seek(f->targets[i & (kNumTargets - 1)]);
+    DoNotOptimize(iter->Valid());
+  }
+  delete iter;
+}
+
+void DeleteNothing(const Slice& key, void* value) { }
+
+}
+
+BENCHMARK(SkipList_Insert_16) {
+  static std::vector<const char*>* keys = BuildInsertKeys(16);
+  SkipListInsert(iters, 16, *keys);
+}
+
+BENCHMARK(SkipList_Insert_64) {
+  static std::vector<const char*>* keys = BuildInsertKeys(64);
+  SkipListInsert(iters, 64, *keys);
+}
+
+BENCHMARK(SkipList_Insert_256) {
+  static std::vector<const char*>* keys = BuildInsertKeys(256);
+  SkipListInsert(iters, 256, *keys);
+}
+
+BENCHMARK(SkipList_Seek_16) {
+  static SkipListFixture* f = BuildSkipListFixture(16);
+  SkipListSeek(iters, f);
+}
+
+BENCHMARK(SkipList_Seek_64) {
+  static SkipListFixture* f = BuildSkipListFixture(64);
+  SkipListSeek(iters, f);
+}
+
+BENCHMARK(SkipList_Seek_256) {
+  static SkipListFixture* f = BuildSkipListFixture(256);
+  SkipListSeek(iters, f);
+}
+
+BENCHMARK(Block_Seek_Restart1) {
+  static BlockFixture* f = BuildBlockFixture(1);
+  BlockSeek(iters, f);
+}
+
+BENCHMARK(Block_Seek_Restart16) {
+  static BlockFixture* f = BuildBlockFixture(16);
+  BlockSeek(iters, f);
+}
+
+BENCHMARK(Block_Seek_Restart64) {
+  static BlockFixture* f = BuildBlockFixture(64);
+  BlockSeek(iters, f);
+}
+
+// Values of 1 to 5 bytes, in the mix a table index sees
+BENCHMARK(Coding_GetVarint32) {
+  std::string buf;
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    PutVarint32(&buf, rnd.Next() >> rnd.Uniform(32));
+  }
+  uint32_t sum = 0;
+  int done = 0;
+  while (done < iters) {
+    Slice input(buf);
+    uint32_t v;
+    while (done < iters && GetVarint32(&input, &v)) {
+      sum += v;
+      done++;
+    }
+  }
+  DoNotOptimize(sum);
+}
+
+BENCHMARK(Coding_PutVarint64) {
+  std::string buf;
+  buf.reserve(10 * 1024);
+  uint64_t v = 1;
+  for (int i = 0; i < iters; i++) {
+    if (buf.size() > 9 * 1024) buf.clear();
+    PutVarint64(&buf, v);
+    v = v * 3 + 1;
+  }
+  DoNotOptimize(buf);
+}
+
+BENCHMARK(Arena_Allocate_16) {
+  Arena* arena = new Arena;
+  for (int i = 0; i < iters; i++) {
+    // Bound the memory held by long runs
+    if ((i & 0xffff) == 0xffff) {
+      delete arena;
+      arena = new Arena;
+    }
+    DoNotOptimize(arena->Allocate(16));
+  }
+  delete arena;
+}
+
+BENCHMARK(Arena_AllocateAligned_Mixed) {
+  Arena* arena = new Arena;
+  for (int i = 0; i < iters; i++) {
+    if ((i & 0xffff) == 0xffff) {
+      delete arena;
+      arena = new Arena;
+    }
+    DoNotOptimize(arena->AllocateAligned(8 + (i & 0x7f)));
+  }
+  delete arena;
+}
+
+BENCHMARK(Cache_Lookup) {
+  static const int kEntries = 100000;
+  static Cache* cache = NULL;
+  if (cache == NULL) {
+    cache = NewLRUCache(kEntries);
+    for (int i = 0; i < kEntries; i++) {
+      char key[4];
+      EncodeFixed32(key, i);
+      cache->Release(cache->Insert(Slice(key, 4), NULL, 1, &DeleteNothing));
+    }
+  }
+  Random rnd(301);
+  for (int i = 0; i < iters; i++) {
+    char key[4];
+    EncodeFixed32(key, rnd.Uniform(kEntries));
+    Cache::Handle* h = cache->Lookup(Slice(key, 4));
+    if (h != NULL) cache->Release(h);
+  }
+}
+
+// Every insert evicts the least recently used entry once the cache is full
+BENCHMARK(Cache_Insert) {
+  Cache* cache = NewLRUCache(10000);
+  for (int i = 0; i < iters; i++) {
+    char key[4];
+    EncodeFixed32(key, i);
+    cache->Release(cache->Insert(Slice(key, 4), NULL, 1, &DeleteNothing));
+  }
+  delete cache;
+}
+
+BENCHMARK(Crc32c_Extend_64) {
+  std::string data(64, 'x');
+  uint32_t crc = 0;
+  for (int i = 0; i < iters; i++) {
+    crc = crc32c::Extend(crc, data.data(), data.size());
+  }
+  DoNotOptimize(crc);
+}
+
+BENCHMARK(Crc32c_Extend_4096) {
+  std::string data(4096, 'x');
+  uint32_t crc = 0;
+  for (int i = 0; i < iters; i++) {
+    crc = crc32c::Extend(crc, data.data(), data.size());
+  }
+  DoNotOptimize(crc);
+}
+
+BENCHMARK(Hash_16) {
+  char key[16];
+  memset(key, 'h', sizeof(key));
+  uint32_t sum = 0;
+  for (int i = 0; i < iters; i++) {
+    sum += Hash(key, sizeof(key), i);
+  }
+  DoNotOptimize(sum);
+}
+
+BENCHMARK(Hash_256) {
+  char key[256];
+  memset(key, 'h', sizeof(key));
+  uint32_t sum = 0;
+  for (int i = 0; i < iters; i++) {
+    sum += Hash(key, sizeof(key), i);
+  }
+  DoNotOptimize(sum);
+}
+
+}
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllBenchmarks(argc, argv);
+}
@@ -18,11 +18,24 @@ Options::Options()
       info_log(NULL),
       write_buffer_size(1<<20),
       max_open_files(1000),
+      max_background_compactions(1),
+      max_subcompactions(1),
+      allow_concurrent_memtable_write(false),
+      level0_slowdown_writes_trigger(8),
+      level0_stop_writes_trigger(12),
+      soft_pending_compaction_bytes_limit(64ull << 30),
+      hard_pending_compaction_bytes_limit(256ull << 30),
+      delayed_write_rate(16 << 20),
       large_value_threshold(65536),
       block_cache(NULL),
       block_size(8192),
       block_restart_interval(16),
-      compression(kLightweightCompression) {
+      compression(kLightweightCompression),
+      compression_threads(0),
+      filter_policy(NULL),
+      merge_operator(NULL),
+      statistics(NULL),
+      stats_dump_period_sec(600) {
 }
 
 
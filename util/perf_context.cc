@@ -0,0 +1,83 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "include/perf_context.h"
+
+#include <stdio.h>
+#include "util/perf_context_imp.h"
+
+namespace leveldb {
+
+#ifndef LEVELDB_NPERF_CONTEXT
+thread_local PerfLevel perf_level = kDisablePerf;
+thread_local PerfContext perf_context;
+#else
+// Collection is compiled out, but callers may still read the context
+static PerfContext perf_context;
+#endif
+
+void SetPerfLevel(PerfLevel level) {
+#ifndef LEVELDB_NPERF_CONTEXT
+  perf_level = level;
+#endif
+}
+
+PerfLevel GetPerfLevel() {
+#ifndef LEVELDB_NPERF_CONTEXT
+  return perf_level;
+#else
+  return kDisablePerf;
+#endif
+}
+
+PerfContext* GetPerfContext() {
+  return &perf_context;
+}
+
+void PerfContext::Reset() {
+  user_key_comparison_count = 0;
+  block_read_count = 0;
+  block_read_byte = 0;
+  block_cache_hit_count = 0;
+  internal_key_skipped_count = 0;
+  internal_delete_skipped_count = 0;
+  get_from_memtable_count = 0;
+  get_from_table_count = 0;
+  db_mutex_lock_micros = 0;
+  write_wal_micros = 0;
+  wal_sync_micros = 0;
+  write_memtable_micros = 0;
+}
+
+static void AppendField(std::string* result, const char* name,
+                        uint64_t value) {
+  if (value != 0) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%s%s = %llu",
+             result->empty() ? "" : ", ", name,
+             static_cast<unsigned long long>(value));
+    result->append(buf);
+  }
+}
+
+std::string PerfContext::ToString() const {
+  std::string result;
+  AppendField(&result, "user_key_comparison_count", user_key_comparison_count);
+  AppendField(&result, "block_read_count", block_read_count);
+  AppendField(&result, "block_read_byte", block_read_byte);
+  AppendField(&result, "block_cache_hit_count", block_cache_hit_count);
+  AppendField(&result, "internal_key_skipped_count",
+              internal_key_skipped_count);
+  AppendField(&result, "internal_delete_skipped_count",
+              internal_delete_skipped_count);
+  AppendField(&result, "get_from_memtable_count", get_from_memtable_count);
+  AppendField(&result, "get_from_table_count", get_from_table_count);
+  AppendField(&result, "db_mutex_lock_micros", db_mutex_lock_micros);
+  AppendField(&result, "write_wal_micros", write_wal_micros);
+  AppendField(&result, "wal_sync_micros", wal_sync_micros);
+  AppendField(&result, "write_memtable_micros", write_memtable_micros);
+  return result;
+}
+
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Macros used inside the library to update the PerfContext of the
+// calling thread.  When collection is disabled they cost a thread-local
+// load and a branch; with LEVELDB_NPERF_CONTEXT defined they vanish.
+
+#ifndef STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+#define STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
+
+#include "include/env.h"
+#include "include/perf_context.h"
+
+namespace leveldb {
+
+#ifndef LEVELDB_NPERF_CONTEXT
+
+extern thread_local PerfLevel perf_level;
+extern thread_local PerfContext perf_context;
+
+// Adds the time from its construction until Stop() or its destruction
+// to *metric when the calling thread collects timings.
+class PerfTimer {
+ public:
+  PerfTimer(uint64_t* metric, Env* env)
+      : metric_(metric),
+        env_(perf_level >= kEnableTime ? env : NULL),
+        start_(env_ != NULL ? env_->NowMicros() : 0) {
+  }
+  ~PerfTimer() { Stop(); }
+
+  void Stop() {
+    if (env_ != NULL) {
+      *metric_ += env_->NowMicros() - start_;
+      env_ = NULL;
+    }
+  }
+
+ private:
+  uint64_t* const metric_;
+  Env* env_;            // NULL if stopped or timings are not collected
+  const uint64_t start_;
+
+  // No copying allowed
+  PerfTimer(const PerfTimer&);
+  void operator=(const PerfTimer&);
+};
+
+#define PERF_COUNTER_ADD(metric, value)            \
+  do {                                             \
+    if (perf_level >= kEnableCount) {              \
+      perf_context.metric += (value);              \
+    }                                              \
+  } while (0)
+
+// Time the rest of the enclosing scope, or until PERF_TIMER_STOP(metric)
+#define PERF_TIMER_GUARD(metric, env) \
+  PerfTimer perf_timer_##metric(&perf_context.metric, (env))
+#define PERF_TIMER_STOP(metric) perf_timer_##metric.Stop()
+
+#else
+
+#define PERF_COUNTER_ADD(metric, value)
+#define PERF_TIMER_GUARD(metric, env)
+#define PERF_TIMER_STOP(metric)
+
+#endif  // LEVELDB_NPERF_CONTEXT
+
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_PERF_CONTEXT_IMP_H_
@@ -0,0 +1,50 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "include/pinnable_slice.h"
+
+#include <assert.h>
+
+namespace leveldb {
+
+PinnableSlice::PinnableSlice()
+    : cleanup_(NULL),
+      arg1_(NULL),
+      arg2_(NULL) {
+}
+
+PinnableSlice::~PinnableSlice() {
+  Reset();
+}
+
+void PinnableSlice::PinSlice(const Slice& s, CleanupFunction cleanup,
+                             void* arg1, void* arg2) {
+  assert(cleanup_ == NULL);
+  Slice::operator=(s);
+  cleanup_ = cleanup;
+  arg1_ = arg1;
+  arg2_ = arg2;
+}
+
+void PinnableSlice::PinSelf(const Slice& s) {
+  assert(cleanup_ == NULL);
+  self_.assign(s.data(), s.size());
+  PinSelf();
+}
+
+void PinnableSlice::PinSelf() {
+  assert(cleanup_ == NULL);
+  Slice::operator=(Slice(self_));
+}
+
+void PinnableSlice::Reset() {
+  if (cleanup_ != NULL) {
+    (*cleanup_)(arg1_, arg2_);
+    cleanup_ = NULL;
+  }
+  self_.clear();
+  clear();
+}
+
+}
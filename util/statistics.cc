@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "include/statistics.h"
+
+#include <stdio.h>
+#include <atomic>
+#include "port/port.h"
+#include "util/histogram.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+static const char* const kTickerNames[kNumTickers] = {
+  "leveldb.block.cache.hit",
+  "leveldb.block.cache.miss",
+  "leveldb.bytes.written",
+  "leveldb.bytes.read",
+  "leveldb.stall.micros",
+  "leveldb.flush.bytes.written",
+  "leveldb.compaction.bytes.read",
+  "leveldb.compaction.bytes.written",
+};
+
+static const char* const kHistogramNames[kNumHistograms] = {
+  "leveldb.db.get.micros",
+  "leveldb.db.write.micros",
+  "leveldb.db.seek.micros",
+  "leveldb.wal.sync.micros",
+};
+
+const char* TickerName(Tickers ticker) {
+  return kTickerNames[ticker];
+}
+
+const char* HistogramName(Histograms histogram) {
+  return kHistogramNames[histogram];
+}
+
+Statistics::~Statistics() { }
+
+namespace {
+
+class InMemoryStatistics : public Statistics {
+ public:
+  InMemoryStatistics() {
+    for (int i = 0; i < kNumTickers; i++) {
+      tickers_[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < kNumHistograms; i++) {
+      histograms_[i].Clear();
+    }
+  }
+
+  virtual void RecordTick(Tickers ticker, uint64_t count) {
+    tickers_[ticker].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  virtual uint64_t GetTickerCount(Tickers ticker) const {
+    return tickers_[ticker].load(std::memory_order_relaxed);
+  }
+
+  virtual void MeasureTime(Histograms histogram, uint64_t micros) {
+    MutexLock l(&mu_[histogram]);
+    histograms_[histogram].Add(micros);
+  }
+
+  virtual uint64_t GetHistogramCount(Histograms histogram) const {
+    MutexLock l(&mu_[histogram]);
+    return static_cast<uint64_t>(histograms_[histogram].Count());
+  }
+
+  virtual std::string GetHistogramString(Histograms histogram) const {
+    MutexLock l(&mu_[histogram]);
+    return histograms_[histogram].ToString();
+  }
+
+  virtual std::string ToString() const {
+    std::string result;
+    char buf[200];
+    for (int i = 0; i < kNumTickers; i++) {
+      snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", kTickerNames[i],
+               static_cast<unsigned long long>(
+                   GetTickerCount(static_cast<Tickers>(i))));
+      result.append(buf);
+    }
+    for (int i = 0; i < kNumHistograms; i++) {
+      result.append(kHistogramNames[i]);
+      result.append(":\n");
+      result.append(GetHistogramString(static_cast<Histograms>(i)));
+    }
+    return result;
+  }
+
+ private:
+  std::atomic<uint64_t> tickers_[kNumTickers];
+  // Histogram is not thread-safe, so each one has its own lock
+  mutable port::Mutex mu_[kNumHistograms];
+  Histogram histograms_[kNumHistograms];
+};
+
+}
+
+Statistics* NewStatistics() {
+  return new InMemoryStatistics;
+}
+
+}
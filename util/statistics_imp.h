@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Helpers for updating an optional Statistics object from inside the
+// library.  All of them do nothing when the object is NULL.
+
+#ifndef STORAGE_LEVELDB_UTIL_STATISTICS_IMP_H_
+#define STORAGE_LEVELDB_UTIL_STATISTICS_IMP_H_
+
+#include "include/env.h"
+#include "include/statistics.h"
+
+namespace leveldb {
+
+inline void RecordTick(Statistics* statistics, Tickers ticker,
+                       uint64_t count = 1) {
+  if (statistics != NULL) {
+    statistics->RecordTick(ticker, count);
+  }
+}
+
+// Adds the time from its construction to its destruction to a
+// histogram.
+class StopWatch {
+ public:
+  StopWatch(Env* env, Statistics* statistics, Histograms histogram)
+      : env_(env),
+        statistics_(statistics),
+        histogram_(histogram),
+        start_(statistics != NULL ? env->NowMicros() : 0) {
+  }
+
+  ~StopWatch() {
+    if (statistics_ != NULL) {
+      statistics_->MeasureTime(histogram_, env_->NowMicros() - start_);
+    }
+  }
+
+ private:
+  Env* const env_;
+  Statistics* const statistics_;
+  const Histograms histogram_;
+  const uint64_t start_;
+
+  // No copying allowed
+  StopWatch(const StopWatch&);
+  void operator=(const StopWatch&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_STATISTICS_IMP_H_
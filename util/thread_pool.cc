@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_pool.h"
+
+#include <assert.h>
+#include "include/env.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+ThreadPool::ThreadPool(Env* env)
+    : env_(env),
+      cv_(&mu_),
+      num_threads_(0),
+      shutting_down_(false) {
+}
+
+ThreadPool::~ThreadPool() {
+  MutexLock l(&mu_);
+  shutting_down_ = true;
+  cv_.SignalAll();
+  while (num_threads_ > 0) {
+    cv_.Wait();
+  }
+}
+
+void ThreadPool::SetMinThreads(int n) {
+  MutexLock l(&mu_);
+  assert(!shutting_down_);
+  while (num_threads_ < n) {
+    num_threads_++;
+    env_->StartThread(&ThreadPool::BGThreadWrapper, this);
+  }
+}
+
+void ThreadPool::Schedule(void (*function)(void*), void* arg) {
+  MutexLock l(&mu_);
+  assert(num_threads_ > 0 && !shutting_down_);
+  Task task;
+  task.function = function;
+  task.arg = arg;
+  queue_.push_back(task);
+  cv_.Signal();
+}
+
+void ThreadPool::BGThreadWrapper(void* arg) {
+  reinterpret_cast<ThreadPool*>(arg)->BGThread();
+}
+
+void ThreadPool::BGThread() {
+  mu_.Lock();
+  while (true) {
+    while (queue_.empty() && !shutting_down_) {
+      cv_.Wait();
+    }
+    if (queue_.empty()) {
+      break;
+    }
+    Task task = queue_.front();
+    queue_.pop_front();
+    mu_.Unlock();
+    (*task.function)(task.arg);
+    mu_.Lock();
+  }
+  num_threads_--;
+  cv_.SignalAll();
+  mu_.Unlock();
+}
+
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
+
+#include <deque>
+#include "port/port.h"
+
+namespace leveldb {
+
+class Env;
+
+// A bounded set of long-lived threads that run scheduled tasks in FIFO
+// order.  Unlike the Env::Schedule() pools, it is meant for work that
+// the threads of those pools wait on, so its tasks must never block on
+// other tasks of the same pool.
+//
+// Thread-safe.
+class ThreadPool {
+ public:
+  explicit ThreadPool(Env* env);
+
+  // Runs the tasks still queued, then waits for every thread to exit.
+  ~ThreadPool();
+
+  // Start threads until at least "n" are running.  The pool never shrinks.
+  void SetMinThreads(int n);
+
+  // Arrange to run "(*function)(arg)" once on one of the pool threads.
+  // REQUIRES: SetMinThreads() has been called with a positive count.
+  void Schedule(void (*function)(void*), void* arg);
+
+ private:
+  struct Task {
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void BGThreadWrapper(void* arg);
+  void BGThread();
+
+  Env* const env_;
+  port::Mutex mu_;
+  port::CondVar cv_;            // Signalled on new tasks, shutdown and exits
+  std::deque<Task> queue_;      // Guarded by mu_
+  int num_threads_;             // Guarded by mu_
+  bool shutting_down_;          // Guarded by mu_
+
+  // No copying allowed
+  ThreadPool(const ThreadPool&);
+  void operator=(const ThreadPool&);
+};
+
+}
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_pool.h"
+
+#include <utility>
+#include <vector>
+#include "include/env.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class ThreadPoolTest { };
+
+namespace {
+struct Counter {
+  port::Mutex mu;
+  int count;
+};
+}
+
+static void Increment(void* arg) {
+  Counter* c = reinterpret_cast<Counter*>(arg);
+  MutexLock l(&c->mu);
+  c->count++;
+}
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+  Counter c;
+  c.count = 0;
+  {
+    ThreadPool pool(Env::Default());
+    pool.SetMinThreads(3);
+    pool.SetMinThreads(1);
+    for (int i = 0; i < 1000; i++) {
+      pool.Schedule(&Increment, &c);
+    }
+    // The destructor runs the tasks that are still queued
+  }
+  ASSERT_EQ(1000, c.count);
+}
+
+static void Append(void* arg) {
+  std::pair<std::vector<int>*, int>* p =
+      reinterpret_cast<std::pair<std::vector<int>*, int>*>(arg);
+  p->first->push_back(p->second);
+}
+
+TEST(ThreadPoolTest, SingleThreadRunsInOrder) {
+  std::vector<int> order;
+  std::pair<std::vector<int>*, int> args[100];
+  {
+    ThreadPool pool(Env::Default());
+    pool.SetMinThreads(1);
+    for (int i = 0; i < 100; i++) {
+      args[i] = std::make_pair(&order, i);
+      pool.Schedule(&Append, &args[i]);
+    }
+  }
+  ASSERT_EQ(100, order.size());
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(i, order[i]);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}